@@ -0,0 +1,29 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Battery save writer ; a thread of each cartridge with a battery writes its saves so the emulation never waits for the disk
+
+#ifndef BATTERY_H
+#define BATTERY_H
+
+struct gameboy_battery {
+    pthread_t thread;
+    pthread_mutex_t lock; // protects staging, pending and quit
+    pthread_cond_t wake;
+    uint8_t *staging; // cartridge RAM followed by the RTC state ; the emulation copies the changed banks in
+    uint8_t *buffer; // copy of staging the writer thread writes without holding the lock
+    size_t length;
+    bool pending; // staging holds a save not written yet
+    bool quit;
+    const char *path; // save file of the cartridge
+    char *temp_path; // the save is written there, then renamed over path
+};
+
+bool start_battery_writer(struct emulator *gameboy);
+void stop_battery_writer(struct emulator *gameboy);
+void stage_battery_save(struct emulator *gameboy);
+
+#endif
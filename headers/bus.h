@@ -7,6 +7,17 @@
 #ifndef BUS_H
 #define BUS_H
 
+#define GB_BUS_PAGE_SHIFT 12 // the address space is split into 16 pages of 4KiB
+#define GB_BUS_PAGE_SIZE (1U << GB_BUS_PAGE_SHIFT)
+#define GB_BUS_PAGE_MASK (GB_BUS_PAGE_SIZE - 1)
+#define GB_BUS_PAGES (0x10000U >> GB_BUS_PAGE_SHIFT)
+
+struct gameboy_bus {
+    const uint8_t *read_pages[GB_BUS_PAGES]; // host memory backing each page for reads ; NULL if reads must go through read_bus
+    uint8_t *write_pages[GB_BUS_PAGES]; // host memory backing each page for writes ; NULL if writes have side effects and must go through write_bus
+};
+
+void update_bus_pages(struct emulator *gameboy);
 uint8_t read_bus(struct emulator *gameboy, uint16_t address);
 void write_bus(struct emulator *gameboy, uint16_t address, uint8_t value);
 
@@ -9,6 +9,12 @@
 #ifndef CPU_H
 #define CPU_H
 
+#define GB_CPU_BLOCK_CACHE_SIZE 2048 // number of cached blocks ; must be a power of two
+#define GB_CPU_BLOCK_MAX_OPS 16 // maximum number of instructions decoded in a single block
+#define GB_CPU_BLOCK_MAX_INVALIDATIONS 64 // internal RAM pages invalidated more often than this are no longer cached
+
+typedef void (*gameboy_instruction)(struct emulator *);
+
 struct gameboy_cpu {
      bool interrupt_master_enable;
      bool interrupt_request_enable_next;
@@ -26,9 +32,41 @@ struct gameboy_cpu {
      bool null_flag;
      bool half_carry_flag;
      bool carry_flag;
-} gameboy_cpu;
+};
+
+// predecoded instruction
+struct cpu_block_op {
+    gameboy_instruction handler; // 0xCB prefixed instructions point directly at their handler in the second opcode map
+    uint8_t opcode; // second opcode for 0xCB prefixed instructions
+    uint8_t prefix_length; // 2 for 0xCB prefixed instructions ; 1 otherwise
+    uint8_t operands[2]; // immediate operands following the opcode
+};
+
+// straight-line sequence of instructions ending at the first instruction which can change the control flow
+struct cpu_block {
+    const uint8_t *code; // host address of the first instruction ; NULL if the entry is unused
+    uint8_t ops_count;
+    bool idle_loop; // block is a single relative jump to itself ; the CPU only leaves it through an interrupt
+    uint16_t heat; // number of times the block was entered ; saturates at GB_JIT_THRESHOLD once the JIT has seen it
+    uint8_t native_ops; // number of leading instructions translated by the JIT
+    uint8_t native_length; // length in bytes of the translated instructions
+    uint8_t native_cycles; // cycles taken by the translated instructions
+    void (*native)(struct gameboy_cpu *cpu); // native code of the leading instructions ; NULL if the block isn't compiled
+    struct cpu_block_op ops[GB_CPU_BLOCK_MAX_OPS];
+};
+
+// blocks are keyed by their host address, which identifies both the bank and the program counter
+struct gameboy_block_cache {
+    const uint8_t *operands; // remaining immediate operands of the instruction being run from a block ; NULL when interpreting from the bus
+    bool stale; // set when the memory backing the running block may have changed
+    bool internal_ram_code[8]; // true if a cached block was decoded from this 4KiB page of internal RAM ; direct writes to it are disabled
+    uint8_t internal_ram_invalidations[8]; // number of times cached blocks of each internal RAM page were invalidated by a write
+    struct cpu_block blocks[GB_CPU_BLOCK_CACHE_SIZE];
+};
 
 void reset_cpu(struct emulator *gameboy);
-int32_t run_cpu_cycles(struct emulator *gameboy, int32_t cycles);
+uint64_t run_cpu_cycles(struct emulator *gameboy, uint64_t cycles);
+void invalidate_cpu_blocks(struct emulator *gameboy, unsigned internal_ram_page);
+void flush_cpu_ram_blocks(struct emulator *gameboy);
 
 #endif
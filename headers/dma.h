@@ -13,7 +13,7 @@ struct gameboy_dma {
     bool running;
     uint16_t source_address;
     uint8_t position; // number of bytes copied so far
-} gameboy_dma;
+};
 
 void reset_dma(struct emulator *gameboy);
 void sync_dma(struct emulator *gameboy);
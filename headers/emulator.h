@@ -11,27 +11,45 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <semaphore.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 struct emulator;
 
 #include "sync.h"
 #include "interrupts.h"
 #include "cpu.h"
+#include "jit.h"
 #include "bus.h"
 #include "rtc.h"
+#include "rom.h"
+#include "battery.h"
 #include "cart.h"
 #include "ppu.h"
 #include "gamepad.h"
 #include "dma.h"
 #include "hdma.h"
 #include "timer.h"
+#include "resampler.h"
 #include "spu.h"
+#include "serial.h"
+#include "link.h"
 #include "ui.h"
 #include "ui.h"
+#include "state.h"
+#include "rewind.h"
 
-#define EMULATION_SPEED 1U // NOTE: change this to increase / decrease game speed
-#define CPU_FREQUENCY_HZ 4194304U * EMULATION_SPEED // CPU frequency ; Super GameBoy runs slightly faster at 4.295454MHz
+#define CPU_FREQUENCY_HZ 4194304U // CPU frequency ; Super GameBoy runs slightly faster at 4.295454MHz
+#define GB_SPEED_UNBOUNDED 0 // run as fast as the host allows
+#define GB_SPEED_MIN 0.25
+#define GB_SPEED_MAX 4.0
+
+// how fast the emulation runs against the wall clock ; the emulated clock always stays at CPU_FREQUENCY_HZ
+struct gameboy_speed {
+    double speed; // multiple of real time the UI paces the emulation to ; GB_SPEED_UNBOUNDED to run flat out
+    double turbo_speed; // used instead of speed while turbo is on
+    bool turbo; // toggled by the UI
+};
 
 struct emulator {
     bool gbc; // true if emulating a GBC ; false if emulating a DMG
@@ -39,7 +57,10 @@ struct emulator {
     struct gameboy_interrupt_request interrupt_request;
     struct gameboy_ui ui;
     struct gameboy_sync sync;
+    struct gameboy_bus bus;
     struct gameboy_cpu cpu;
+    struct gameboy_block_cache block_cache;
+    struct gameboy_jit jit;
     struct gameboy_cart cart;
     struct gameboy_ppu ppu;
     struct gameboy_gamepad gamepad;
@@ -47,12 +68,21 @@ struct emulator {
     struct gameboy_hdma hdma;
     struct gameboy_timer timer;
     struct gameboy_spu spu;
-    uint32_t timestamp; // counter of how many CPU cycles have elapsed ; used to synchronize other devices
+    struct gameboy_serial serial;
+    struct gameboy_link link;
+    struct gameboy_rewind rewind;
+    struct gameboy_speed speed;
+    uint64_t timestamp; // counter of how many CPU cycles have elapsed since reset ; never wraps and is the time base of every device
     uint8_t internal_ram[0x8000]; // 8KiB on DMG ; 32 KiB on GBC
     uint8_t internal_ram_high_bank; // always 1 on DMG ; in range [1, 7] on GBC
     uint8_t zero_page_ram[0x7F];
     uint8_t video_ram[0x4000]; // 8KiB on DMG ; 16KiB on GBC
     bool video_ram_high_bank; // always false on DMG
-} emulator;
+};
+
+void reset_emulator(struct emulator *gameboy);
+double get_emulator_speed(struct emulator *gameboy);
+void set_emulator_speed(struct emulator *gameboy, double speed);
+void set_emulator_turbo(struct emulator *gameboy, bool turbo);
 
 #endif
@@ -21,7 +21,7 @@ struct gameboy_gamepad {
      bool dpad_selected;
      uint8_t buttons_state; // state of the buttons (A, B, select, start), active low
      bool buttons_selected;
-} gameboy_gamepad;
+};
 
 void reset_gamepad(struct emulator *gameboy);
 void set_gamepad(struct emulator *gameboy, unsigned button, bool pressed);
@@ -0,0 +1,14 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// UI backend without a window or audio device ; used for batch runs on machines without a display
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+void init_headless_ui(struct emulator *gameboy);
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Dynamic recompiler ; translates hot register-only instructions of cached blocks to native x86-64 code
+
+#ifndef JIT_H
+#define JIT_H
+
+#if defined(__x86_64__)
+#define GB_JIT_SUPPORTED
+#endif
+
+#define GB_JIT_THRESHOLD 64 // number of times a block must be entered before it is compiled
+#define GB_JIT_BUFFER_SIZE (1U << 20) // executable memory shared by all compiled blocks ; flushed when full
+
+struct gameboy_jit {
+    bool enabled;
+    uint8_t *buffer; // executable memory holding the native code ; NULL if the JIT is disabled
+    size_t buffer_used;
+    uint64_t compiled_blocks; // number of blocks translated since the JIT was enabled
+};
+
+bool init_jit(struct emulator *gameboy);
+void destroy_jit(struct emulator *gameboy);
+void compile_jit_block(struct emulator *gameboy, struct cpu_block *block);
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Link cable ; carries the serial transfers between two emulators, on two threads of a process or over a Unix domain socket
+
+#ifndef LINK_H
+#define LINK_H
+
+#define GB_LINK_POLL_CYCLES 1024 // the cable is checked for the other side's messages this often
+#define GB_LINK_LOOKAHEAD_CYCLES 4096 // a side waiting for a transfer doesn't run further ahead of the other side
+#define GB_LINK_RING_LENGTH 64 // messages in flight each way on an in-process channel ; power of 2
+#define GB_LINK_MESSAGE_LENGTH 10 // bytes of a message on a socket
+#define GB_LINK_TIMEOUT_SECONDS 5 // the cable is unplugged if the other side doesn't answer for that long
+
+// messages are stamped with the timestamp of their sender ; both sides count from their reset, so the dates line up
+enum link_message_type {
+    GB_LINK_TRANSFER, // the sender started a transfer on its internal clock which completes at stamp ; value is the byte it sends
+    GB_LINK_REPLY, // the sender completed the transfer of the other side ; value is the byte it sent back
+    GB_LINK_LISTEN, // value is true while the sender waits for a transfer on the external clock
+    GB_LINK_TIME, // the sender reached stamp ; lets a listening side run ahead
+};
+
+struct link_message {
+    uint8_t type;
+    uint8_t value;
+    uint64_t stamp;
+};
+
+// single producer, single consumer ; each side only moves its own end
+struct link_ring {
+    struct link_message messages[GB_LINK_RING_LENGTH];
+    atomic_uint head; // next message read ; moved by the reader
+    atomic_uint tail; // next message written ; moved by the writer
+};
+
+// in-process cable ; freed once both sides were disconnected
+struct link_channel {
+    struct link_ring rings[2]; // rings[i] carries the messages to side i
+    atomic_bool closed; // one side was disconnected
+    atomic_uint ends; // sides not disconnected yet
+};
+
+struct gameboy_link {
+    bool connected;
+    int socket; // -1 on an in-process channel
+    struct link_channel *channel; // NULL on a socket
+    unsigned side; // which end of the channel this is
+    uint8_t received[GB_LINK_MESSAGE_LENGTH]; // message partially read from the socket
+    unsigned received_length;
+    uint64_t next_poll; // date at which the cable is checked again
+    bool listening; // the other side was told this side waits for a transfer on the external clock
+    bool peer_listening; // the other side waits for a transfer ; it is told the time at each poll
+    uint64_t peer_timestamp; // last date the other side told
+    unsigned outstanding; // transfers sent which weren't replied to
+    uint8_t reply; // byte of the last reply
+    bool has_transfer; // the other side started a transfer which completes at transfer_stamp
+    uint64_t transfer_stamp;
+    uint8_t transfer_value;
+};
+
+struct link_channel *create_link_channel(void);
+void connect_link_channel(struct emulator *gameboy, struct link_channel *channel, unsigned side);
+bool listen_link_socket(struct emulator *gameboy, const char *path);
+bool connect_link_socket(struct emulator *gameboy, const char *path);
+void disconnect_link(struct emulator *gameboy);
+void start_link_transfer(struct emulator *gameboy, uint8_t value, uint64_t stamp);
+uint8_t finish_link_transfer(struct emulator *gameboy);
+void update_link_listening(struct emulator *gameboy, bool listening);
+int32_t poll_link(struct emulator *gameboy); // returns the number of cycles until the cable must be checked again
+
+#endif
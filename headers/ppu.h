@@ -12,25 +12,50 @@
 #define GB_PPU_MAX_SPRITES 40 // PPU supports a maximum of 40 sprites at once
 #define GB_LCD_WIDTH 160
 #define GB_LCD_HEIGHT 144
+#define GB_PPU_TILES 384 // tiles in the tile data of a VRAM bank
+#define GB_PPU_TILE_BANKS 2 // the GBC has a second VRAM bank
+#define GB_PPU_MAX_FRAMEBUFFERS 3 // up to triple buffering
 
 enum dmg_colour {
     WHITE,
     LIGHT_GREY,
     DARK_GREY,
     BLACK
-} dmg_colour;
+};
 
 union lcd_colour {
     enum dmg_colour dmg; // DMG only has 4 colour options
     uint16_t gbc; // GBC colours: xRGB 1555
-} lcd_colour;
+};
 
 // GBC only
 struct colour_palette {
     uint16_t colours[8][4]; // 8 palettes of 4 colours each
     uint8_t write_index; // index of next write in palette
     bool auto_increment; // if true write_index will automatically increment after each write
-} colour_palette;
+};
+
+// pixel formats the PPU can draw frames in
+enum gameboy_pixel_format {
+    GB_PIXEL_INDEX, // uint8_t ; DMG shade, or GBC colour palette entry (background palettes 0-31, sprite palettes 32-63)
+    GB_PIXEL_RGB555, // uint16_t ; xBGR 1555 like the GBC colour palettes, red in the low bits
+    GB_PIXEL_XRGB8888 // uint32_t
+};
+
+// frames are drawn in turn into each buffer ; a completed frame stays untouched until the PPU comes back to its buffer
+struct gameboy_framebuffer {
+    enum gameboy_pixel_format format;
+    unsigned count; // 2 for double buffering, 3 for triple buffering
+    unsigned drawing; // buffer of the frame being drawn
+    uint32_t buffers[GB_PPU_MAX_FRAMEBUFFERS][GB_LCD_WIDTH * GB_LCD_HEIGHT]; // large enough for any format ; smaller pixels are packed at the start
+};
+
+// completed frame handed to the UI at VBLANK ; points straight into the framebuffer
+struct gameboy_frame {
+    const void *pixels; // GB_LCD_HEIGHT lines of GB_LCD_WIDTH pixels
+    unsigned pitch; // bytes from one line to the next
+    enum gameboy_pixel_format format;
+};
 
 struct gameboy_ppu {
     uint8_t scroll_x;
@@ -56,10 +81,17 @@ struct gameboy_ppu {
     uint8_t window_y;
     uint8_t window_line; // NEW
     uint16_t line_position; // current position within line
+    uint64_t frames; // number of frames completed since reset
+    unsigned frame_skip; // frames neither drawn nor handed to the UI after each one which is ; set by the UI, the timing and the interrupts stay exact
+    unsigned skip_counter; // frames left to skip ; the current frame is drawn if 0
+    uint64_t skipped_frames; // instrumentation ; frames completed without being drawn
     uint8_t oam[GB_PPU_MAX_SPRITES * 4]; // Object Attribute Memory (sprite configuration) ; each sprite uses 4 bytes
     struct colour_palette background_palettes; // GBC only
     struct colour_palette sprite_palettes; // GBC only
-} gameboy_ppu;
+    uint8_t tile_cache[GB_PPU_TILE_BANKS * GB_PPU_TILES][8][8]; // colour index of every pixel of every tile ; decoded from VRAM when first used
+    bool tile_dirty[GB_PPU_TILE_BANKS * GB_PPU_TILES]; // true if the tile changed in VRAM since it was decoded
+    struct gameboy_framebuffer framebuffer;
+};
 
 void reset_ppu(struct emulator *gameboy);
 void sync_ppu(struct emulator *gameboy);
@@ -68,5 +100,7 @@ void set_lcd_stat(struct emulator *gameboy, uint8_t value);
 uint8_t get_lcdc(struct emulator *gameboy);
 void set_lcdc(struct emulator *gameboy, uint8_t value);
 uint8_t get_ly(struct emulator *gameboy);
+void invalidate_ppu_tile(struct emulator *gameboy, uint16_t offset);
+void set_ppu_framebuffer(struct emulator *gameboy, enum gameboy_pixel_format format, unsigned count);
 
 #endif
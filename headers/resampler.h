@@ -0,0 +1,33 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Band-limited resampler from the SPU sample rate to the rate of the audio device
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#define GB_RESAMPLER_TAPS 32 // length of the windowed sinc filter in input frames
+#define GB_RESAMPLER_PHASE_BITS 9
+#define GB_RESAMPLER_PHASES (1U << GB_RESAMPLER_PHASE_BITS) // positions of an output frame between two input frames the filter is computed for
+#define GB_RESAMPLER_MAX_ADJUST 0.005 // rate control nudges the ratio by at most 0.5%
+
+struct spu_resampler {
+    unsigned output_rate; // rate of the frames written to the sample ring ; 0 if the SPU frames are written untouched
+    float kernel[GB_RESAMPLER_PHASES][GB_RESAMPLER_TAPS]; // filter coefficients of each phase, applied from the oldest to the newest input frame
+    float history[GB_RESAMPLER_TAPS * 2][2]; // input frames are stored twice so the last GB_RESAMPLER_TAPS of them are always contiguous
+    unsigned history_index; // oldest input frame of the filter window
+    uint64_t nominal_step; // input frames per output frame in 32.32 fixed point
+    uint64_t step; // nominal_step adjusted by the rate control
+    uint64_t position; // 32.32 fixed point position of the next output frame after the newest input frame
+    double speed; // emulated seconds per wall second ; the pitch follows it so the ring drains as fast as it fills, GB_SPEED_UNBOUNDED mutes the output
+};
+
+void set_spu_output_rate(struct emulator *gameboy, unsigned rate);
+void set_spu_speed(struct emulator *gameboy, double speed);
+void update_spu_rate_control(struct emulator *gameboy);
+void resample_spu_frame(struct emulator *gameboy, int16_t sample_left, int16_t sample_right);
+
+#endif
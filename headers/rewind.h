@@ -0,0 +1,42 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Rewind history ; save states captured every few frames, kept as deltas against each other in a bounded ring
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#define GB_REWIND_INTERVAL 4 // frames between two snapshots
+#define GB_REWIND_MAX_INTERVAL 64 // the interval is doubled up to this many frames while the average capture goes over budget
+#define GB_REWIND_RING_LENGTH (32U << 20) // bytes of deltas kept ; a few minutes of most games
+#define GB_REWIND_BUDGET_NS 100000 // capture time allowed per emulated frame, amortized over the interval
+
+struct gameboy_rewind {
+    bool enabled;
+    bool rewinding; // set by the UI while the user holds the rewind key ; nothing is captured meanwhile
+    unsigned interval; // frames between two snapshots
+    uint64_t next_frame; // frame at which the next snapshot is captured
+    size_t state_length; // length of a save state of the loaded game, rounded up to whole words
+    uint8_t *state; // newest snapshot in full ; the point step_rewind goes back to
+    uint8_t *capture; // snapshot being captured ; swapped with state once its delta is stored
+    uint8_t *delta; // delta being stored or restored
+    bool has_state; // false until the first capture or once the whole history was rewound
+    uint8_t *ring; // deltas from each snapshot back to the one before it, oldest first ; each is framed by its length on both sides
+    size_t ring_head; // oldest delta
+    size_t ring_used; // bytes of deltas stored
+    unsigned deltas; // number of deltas stored
+    uint64_t captures; // instrumentation ; number of snapshots captured
+    uint64_t capture_ns; // instrumentation ; total time spent capturing snapshots
+    uint64_t max_capture_ns; // instrumentation ; longest capture
+    uint64_t over_budget; // instrumentation ; captures which took longer than their share of GB_REWIND_BUDGET_NS
+};
+
+bool init_rewind(struct emulator *gameboy);
+void destroy_rewind(struct emulator *gameboy);
+void capture_rewind(struct emulator *gameboy);
+bool step_rewind(struct emulator *gameboy);
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// ROM images mapped read-only and shared by every emulator of the process which runs the same game
+
+#ifndef ROM_H
+#define ROM_H
+
+#include <time.h>
+#include <sys/types.h>
+
+#define GB_ROM_CACHE_IDLE 16 // images kept mapped once no emulator uses them ; the oldest is dropped first
+#define GB_ROM_MAP_MIN_LENGTH (1024 * 1024) // smaller files are read rather than mapped ; copying them costs little
+
+struct rom_image {
+    const uint8_t *data;
+    size_t length;
+    uint64_t hash; // content hash ; images of files with the same contents are shared
+    bool mapped; // false if the file was read into an allocation instead
+    dev_t device; // identity of the file the image was last opened from ; lets a file opened again skip the hash
+    ino_t inode;
+    struct timespec modified; // to the nanosecond ; a file rewritten with the same length within a second still differs
+    struct timespec changed;
+    unsigned references; // emulators using the image
+    struct rom_image *next;
+};
+
+struct rom_image *open_rom_image(const char *path, size_t max_length);
+void close_rom_image(struct rom_image *image);
+
+#endif
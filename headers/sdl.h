@@ -7,7 +7,13 @@
 #ifndef SDL_H
 #define SDL_H
 
-void init_sdl_ui(struct emulator *gameboy);
+// optional filter applied to the frames before the renderer scales them to the window
+enum sdl_filter {
+    GB_SDL_FILTER_NONE,
+    GB_SDL_FILTER_SCALE2X
+};
+
+void init_sdl_ui(struct emulator *gameboy, enum sdl_filter filter);
 void destroy_sdl_ui(struct emulator *gameboy);
 
 #endif
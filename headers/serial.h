@@ -0,0 +1,52 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Serial port ; bytes the console sends are handed to a sink, which returns the byte received in exchange
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#define GB_SERIAL_BIT_CYCLES 512 // internal clock of 8192Hz
+#define GB_SERIAL_FAST_BIT_CYCLES 16 // GBC fast internal clock of 262144Hz
+#define GB_SERIAL_CAPTURE_LENGTH 4096 // bytes of output kept by capture_serial
+
+// called when a transfer completes with the byte the console sent ; returns the byte it receives, 0xFF if nothing is plugged in
+typedef uint8_t (*serial_sink)(struct emulator *gameboy, uint8_t value, void *data);
+
+struct gameboy_serial {
+    uint8_t data; // SB ; byte being sent, replaced by the byte received when the transfer completes
+    bool running; // SC bit 7
+    bool fast_clock; // SC bit 1 ; GBC only
+    bool internal_clock; // SC bit 0 ; transfers on the external clock wait for the other side forever when nothing is plugged in
+    uint32_t remaining; // cycles until the transfer on the internal clock completes
+    serial_sink sink; // NULL if nothing is plugged in ; still sees the bytes sent while a link cable is connected, but its answers are ignored
+    void *sink_data;
+};
+
+enum serial_verdict {
+    GB_SERIAL_VERDICT_NONE,
+    GB_SERIAL_VERDICT_PASSED,
+    GB_SERIAL_VERDICT_FAILED,
+};
+
+// sink for test ROMs which print their results over the link port, like blargg's
+struct serial_capture {
+    char text[GB_SERIAL_CAPTURE_LENGTH + 1]; // bytes received so far, NUL terminated ; the oldest half is dropped when it's full
+    unsigned length;
+    enum serial_verdict verdict; // set once the text ends with "Passed" or "Failed"
+    bool echo; // write the bytes to stdout as they arrive
+    bool stop; // set quit once there is a verdict
+};
+
+void reset_serial(struct emulator *gameboy);
+void sync_serial(struct emulator *gameboy);
+void set_serial_sink(struct emulator *gameboy, serial_sink sink, void *data);
+void set_serial_control(struct emulator *gameboy, uint8_t control);
+uint8_t get_serial_control(struct emulator *gameboy);
+uint8_t clock_serial_transfer(struct emulator *gameboy, uint8_t value);
+uint8_t capture_serial(struct emulator *gameboy, uint8_t value, void *data);
+
+#endif
@@ -11,29 +11,57 @@
 
 #define GB_SPU_SAMPLE_RATE_DIVISOR 64 // sample SPU once every 64 CPU cycles
 #define GB_SPU_SAMPLE_RATE_HZ (CPU_FREQUENCY_HZ / GB_SPU_SAMPLE_RATE_DIVISOR) // SPU sample rate
-#define GB_SPU_SAMPLE_BUFFER_LENGTH 2048 // each sample contains 2048 frames ; each with two samples for left and right stereo channels
-#define GB_SPU_SAMPLE_BUFFER_COUNT 2 // number of entries in sample buffer
+#define GB_SPU_SAMPLE_RING_LENGTH 2048 // default number of frames in the sample ring ; each with two samples for left and right stereo channels
+#define GB_SPU_SAMPLE_RING_MIN_LENGTH 64
+#define GB_SPU_SAMPLE_RING_MAX_LENGTH 16384
+#define GB_SPU_BLEP_TAPS 16 // length of a band-limited step in samples
+#define GB_SPU_BLEP_PHASES GB_SPU_SAMPLE_RATE_DIVISOR // one step shape for each CPU cycle between two samples
+#define GB_SPU_CHUNK 1024 // samples rendered between two flushes of the step buffer or the point samples
 #define GB_NR3_RAM_SIZE 16 // Sound 3 RAM size in bytes
 #define GB_SPU_NR1_T1_MAX 0x3F // max duration of Sound 1
 #define GB_SPU_NR2_T1_MAX 0x3F // max duration of Sound 2
 #define GB_SPU_NR3_T1_MAX 0xFF // max duration of Sound 3
 #define GB_SPU_NR4_T1_MAX 0x3F // max duration of Sound 4
 
-struct spu_sample_buffer {
-    int16_t samples[GB_SPU_SAMPLE_BUFFER_LENGTH][2]; // buffer of pairs of stereo samples
-    sem_t free; // set to 1 when UI is done sending audio buffer ; set to 0 when the SPU starts adding new samples
-    sem_t ready; // set to 1 when the SPU is adding a buffer and it can be sent by the UI ; set to 0 when UI starts sending samples
-} spu_sample_buffer;
+// single producer / single consumer ring of stereo frames between the SPU and the UI's audio thread ; neither side ever takes a lock
+struct spu_sample_ring {
+    int16_t frames[GB_SPU_SAMPLE_RING_MAX_LENGTH][2]; // pairs of stereo samples ; only the first length frames are used
+    uint32_t mask; // length - 1 ; the length is a power of two so the free running indices wrap with a mask
+    _Atomic uint32_t head; // number of frames written so far ; only stored by the SPU
+    _Atomic uint32_t tail; // number of frames read so far ; only stored by the UI
+};
+
+// how the sounds are turned into samples
+enum spu_synthesis {
+    GB_SPU_SYNTHESIS_BLEP, // band-limited steps added at the exact cycle each sound changes level
+    GB_SPU_SYNTHESIS_POINT, // every sound sampled once every GB_SPU_SAMPLE_RATE_DIVISOR cycles ; aliases above 32kHz
+    GB_SPU_SYNTHESIS_NONE // registers only ; the counters are brought up to date when the CPU accesses the SPU and no samples are produced
+};
+
+// blip buffer ; level changes are added as band-limited impulses and integrated into samples when the buffer is flushed
+struct spu_blep {
+    int32_t kernel[GB_SPU_BLEP_PHASES][GB_SPU_BLEP_TAPS]; // impulse of each phase in Q15 ; every phase sums to exactly 1 so the integral never drifts
+    int32_t deltas[2][GB_SPU_CHUNK + GB_SPU_BLEP_TAPS]; // level changes of both stereo channels spread over the following samples
+    int32_t sums[2]; // integral of the deltas flushed so far ; output level of both stereo channels in Q15
+    int32_t levels[4][2]; // last level of each sound on both stereo channels
+};
+
+// level of each sound at the sampling points of the current chunk ; filled in as the sounds change level and mixed when the chunk is flushed
+struct spu_point {
+    uint8_t samples[4][GB_SPU_CHUNK];
+    unsigned filled[4]; // number of samples of each sound which can't change anymore
+    uint8_t levels[4]; // last level of each sound
+};
 
 struct spu_duration {
     bool enable; // true if duration counter is enabled
     uint32_t counter; // keeps track of how much time has passed
-} spu_duration;
+};
 
 struct spu_divider {
     uint16_t offset; // advance to next step every 0x800 - offset
     uint16_t counter; // counter to check for next step
-} spu_divider;
+};
 
 struct spu_sweep {
     struct spu_divider divider; // frequency divider
@@ -41,19 +69,19 @@ struct spu_sweep {
     bool subtract; // true if we subtract the offset ; false if we add the offset
     uint8_t time; // delay between sweep steps in 1/128th of a second ; value is set to 0 if this is disabled
     uint32_t counter; // counter to check for next sweep step
-} spu_sweep;
+};
 
 struct spu_rectangle_wave {
     uint8_t phase; // current pahse within duty cycle
     uint8_t duty_cycle; // duty cycle : 1/8, 1/4, 1/2, 3/4
-} spu_rectangle_wave;
+};
 
 struct spu_envelope {
     uint8_t step_duration; // duration of each addition / subtraction step in multiples of 65535 (1/64 seconds) ; value is 0 if envelope is stopped
     uint8_t value;
     bool increment; // true if we increment at each step ; false if we decrement at each step
     uint32_t counter; // counter to check for next step
-} spu_envelope;
+};
 
 // Sound 1 : rectangluar wave with envelope and frequency sweep
 struct spu_nr1 {
@@ -63,7 +91,7 @@ struct spu_nr1 {
     struct spu_rectangle_wave wave;
     uint8_t envelope_configuration;
     struct spu_envelope envelope;
-} spu_nr1;
+};
 
 // Sound 2 : rectangular wave with envelope
 struct spu_nr2 {
@@ -73,7 +101,7 @@ struct spu_nr2 {
     struct spu_rectangle_wave wave;
     uint8_t envelope_configuration;
     struct spu_envelope envelope;
-} spu_nr2;
+};
 
 // Sound 3 : user-defined waveform
 struct spu_nr3 {
@@ -85,7 +113,7 @@ struct spu_nr3 {
     uint8_t volume_shift; // 1 -> full volume ; 2 -> half volume ; 3 -> quarter volume ; 0 -> muted
     uint8_t ram[GB_NR3_RAM_SIZE]; // RAM of 32 4bit sound samples ; two samples per byte
     uint8_t index;    
-} spu_nr3;
+};
 
 // Sound 4 : Linear Feedback Shift Register noise generation with envelope
 struct spu_nr4 {
@@ -96,7 +124,7 @@ struct spu_nr4 {
     uint16_t lfsr;
     uint8_t lfsr_configuration; // LSFR configuration register (NR43)
     uint32_t counter; // counter to check for next LSFR shift
-} spu_nr4;
+};
 
 struct gameboy_spu {
     bool enable; // master enable ; if false all SPU circuits are disabled
@@ -108,12 +136,17 @@ struct gameboy_spu {
     struct spu_nr2 nr2; // Sound 2 state
     struct spu_nr3 nr3; // Sound 3 state
     struct spu_nr4 nr4; // Sound 4 state
-    struct spu_sample_buffer buffers[GB_SPU_SAMPLE_BUFFER_COUNT];
-    unsigned buffer_index; // buffer currently being filled
-    unsigned sample_index; // position within current buffer
-} gameboy_spu;
+    enum spu_synthesis synthesis;
+    struct spu_blep blep;
+    struct spu_point point;
+    struct spu_sample_ring ring;
+    struct spu_resampler resampler; // converts the frames to the rate of the audio device before they go to the ring
+};
 
 void reset_spu(struct emulator *gameboy);
+void set_spu_sample_ring(struct emulator *gameboy, unsigned length);
+void write_spu_sample_ring(struct emulator *gameboy, int16_t sample_left, int16_t sample_right);
+unsigned read_spu_samples(struct emulator *gameboy, int16_t (*frames)[2], unsigned count);
 void sync_spu(struct emulator *gameboy);
 void update_spu_sound_amp(struct emulator *gameboy);
 void start_spu_nr1(struct emulator *gameboy);
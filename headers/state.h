@@ -0,0 +1,19 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Versioned snapshots of the whole emulated machine, in memory or in a file
+
+#ifndef STATE_H
+#define STATE_H
+
+#define GB_STATE_VERSION 2 // bumped whenever the layout changes ; states of any other version are rejected
+
+size_t save_state(struct emulator *gameboy, uint8_t *buffer, size_t length); // returns the size of the state ; only written if it fits in length
+bool load_state(struct emulator *gameboy, const uint8_t *buffer, size_t length);
+bool save_state_file(struct emulator *gameboy, const char *path);
+bool load_state_file(struct emulator *gameboy, const char *path);
+
+#endif
@@ -9,25 +9,35 @@
 
 #define GB_SYNC_NEVER 10000000 // sync at low frequency if there is no event planned
 
+// devices with scheduled events ; when several events land on the same cycle the lowest token runs first
 enum sync_token {
      GB_SYNC_PPU,
      GB_SYNC_DMA,
      GB_SYNC_TIMER,
-     GB_SYNC_CART,
      GB_SYNC_SPU,
+     GB_SYNC_CART,
+     GB_SYNC_SERIAL,
      GB_SYNC_NUM
-} sync_token;
+};
+
+typedef void (*sync_handler)(struct emulator *);
 
 struct gameboy_sync {
-    int32_t first_event; // smallest value in next_event
-    int32_t last_sync[GB_SYNC_NUM]; // timestamp of last time this token was synchronized
-    int32_t next_event[GB_SYNC_NUM]; // timestamp of next time this token must be synchronized
-} gameboy_sync;
+    uint64_t first_event; // date of the earliest scheduled event ; UINT64_MAX if nothing is scheduled
+    uint64_t last_sync[GB_SYNC_NUM]; // timestamp of last time this token was synchronized
+    sync_handler handlers[GB_SYNC_NUM]; // called when the event of a token is due
+    uint64_t heap[GB_SYNC_NUM]; // scheduled events as (date << 8 | token) in a binary min-heap ; events on the same cycle run in token order
+    int8_t heap_index[GB_SYNC_NUM]; // position of each token in heap ; -1 if the token isn't scheduled
+    uint8_t heap_size;
+    int8_t running_token; // token whose handler is running ; -1 outside of check_sync_events
+    bool running_rescheduled; // true if the running token scheduled its next event
+};
 
 void reset_sync(struct emulator *gameboy);
 int32_t resync_sync(struct emulator *gameboy, enum sync_token token); // resync the token and return the number of cycles since last sync
 void sync_next(struct emulator *gameboy, enum sync_token token, int32_t cycles);
+void sync_cancel(struct emulator *gameboy, enum sync_token token);
+uint64_t get_sync_next_event(struct emulator *gameboy, enum sync_token token);
 void check_sync_events(struct emulator *gameboy);
-void rebase_sync(struct emulator *gameboy);
 
 #endif
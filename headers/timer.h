@@ -12,7 +12,7 @@ enum timer_divider {
      GB_TIMER_DIV_16, // timer frequency: 262144Hz
      GB_TIMER_DIV_64, // timer frequency: 65535Hz
      GB_TIMER_DIV_256, // timer frequency: 16384Hz
-} timer_divider;
+};
 
 struct gameboy_timer {
      uint16_t divider_counter;
@@ -20,7 +20,7 @@ struct gameboy_timer {
      uint8_t modulo;
      enum timer_divider divider;
      bool started;
-} gameboy_timer;
+};
 
 void reset_timer(struct emulator *gameboy);
 void sync_timer(struct emulator *gameboy);
@@ -8,12 +8,10 @@
 #define UI_H
 
 struct gameboy_ui {
-    void (*draw_line_dmg)(struct emulator *gameboy, unsigned ly, union lcd_colour colour[GB_LCD_WIDTH]); // draw a single line in DMG mode
-    void (*draw_line_gbc)(struct emulator *gameboy, unsigned ly, union lcd_colour colour[GB_LCD_WIDTH]); // draw a single line in GBC mode
-    void (*flip)(struct emulator *gameboy); // called when a frame is drawn and ready to be displayed
+    void (*flip)(struct emulator *gameboy, const struct gameboy_frame *frame); // called at VBLANK with the completed frame ; its pixels stay valid until the next call
     void (*refresh_gamepad)(struct emulator *gameboy); // handle user input
     void (*destroy)(struct emulator *gameboy); // called when the emulator is told to quit and the UI should be free'd
     void *data;
-} gameboy_ui;
+};
 
 #endif
@@ -0,0 +1,628 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Runs many ROMs headless on every core of the machine and reports a line of results for each
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "emulator.h"
+#include "headless.h"
+
+#define BATCH_DEFAULT_FRAMES 600
+#define BATCH_MAX_LINE 4096
+#define BATCH_SERIAL_TAIL 40 // characters of the serial output shown with the results of a run
+
+// button change applied once the emulator reaches frame
+struct batch_input {
+    uint64_t frame;
+    unsigned button;
+    bool pressed;
+};
+
+struct batch_run {
+    const char *rom_file;
+    uint64_t frames; // frames to run
+    const char *script_file; // inputs played during the run ; NULL for none
+    bool listed; // the file names were allocated by load_batch_list
+    bool done; // false if the ROM or the script couldn't be loaded
+    bool locked; // the CPU locked up before the last frame
+    enum serial_verdict verdict; // what the ROM reported over the link port ; the run stops as soon as there is one
+    uint64_t frames_run; // less than frames if the run stopped early
+    char serial[BATCH_SERIAL_TAIL + 1]; // end of what the ROM sent over the link port, on one line
+    uint64_t hash; // FNV-1a of the last frame, as XRGB8888 ; 0 if the LCD never completed a frame
+    uint64_t cycles;
+    double wall_time;
+};
+
+struct batch_pool {
+    struct batch_run *runs;
+    unsigned count;
+    atomic_uint next; // next run, or pair of linked runs, to take ; each worker takes one as soon as it is done with the previous
+    const char *dump_directory; // last frame of each run is written there as a PPM ; NULL for none
+    bool jit;
+    bool allow_lock; // runs of ROMs which aren't tests may lock up without failing
+    bool link; // runs are taken two by two, the first of each pair linked by cable to the second
+};
+
+// run on the second end of a link cable
+struct batch_side {
+    struct batch_pool *pool;
+    struct batch_run *run;
+    struct emulator *gameboy;
+};
+
+static const char *batch_buttons[8] = {
+    [GB_INPUT_RIGHT] = "right",
+    [GB_INPUT_LEFT] = "left",
+    [GB_INPUT_UP] = "up",
+    [GB_INPUT_DOWN] = "down",
+    [GB_INPUT_A] = "a",
+    [GB_INPUT_B] = "b",
+    [GB_INPUT_SELECT] = "select",
+    [GB_INPUT_START] = "start",
+};
+
+static double get_wall_time(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// the pixels stay valid until the next flip ; the last frame is read once the run is over
+static void flip(struct emulator *gameboy, const struct gameboy_frame *frame) {
+    struct gameboy_frame *last_frame = gameboy->ui.data;
+
+    *last_frame = *frame;
+}
+
+// lines of "<frame> <button> press|release" ; '#' starts a comment
+static bool load_batch_script(const char *path, struct batch_input **inputs, unsigned *count) {
+    FILE *file = fopen(path, "r");
+    char line[BATCH_MAX_LINE];
+    unsigned line_number = 0;
+
+    *inputs = NULL;
+    *count = 0;
+
+    if (file == NULL) {
+        perror("Can't open input script");
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        struct batch_input input;
+        unsigned long long frame;
+        char button[16];
+        char state[16];
+        struct batch_input *grown;
+
+        line_number++;
+        line[strcspn(line, "#\n")] = '\0';
+
+        if (strspn(line, " \t") == strlen(line)) {
+            continue;
+        }
+
+        if (sscanf(line, "%llu %15s %15s", &frame, button, state) != 3) {
+            fprintf(stderr, "%s:%u: expected '<frame> <button> press|release'\n", path, line_number);
+            goto error;
+        }
+
+        for (input.button = 0; input.button < 8 && strcmp(button, batch_buttons[input.button]) != 0; input.button++) {
+            // find the button
+        }
+
+        if (input.button == 8 || (strcmp(state, "press") != 0 && strcmp(state, "release") != 0)) {
+            fprintf(stderr, "%s:%u: unknown button or state\n", path, line_number);
+            goto error;
+        }
+
+        input.frame = frame;
+        input.pressed = strcmp(state, "press") == 0;
+
+        grown = realloc(*inputs, (*count + 1) * sizeof(**inputs));
+        if (grown == NULL) {
+            perror("Input script allocation failed");
+            goto error;
+        }
+
+        *inputs = grown;
+        (*inputs)[(*count)++] = input;
+    }
+
+    fclose(file);
+
+    return true;
+
+error:
+    fclose(file);
+    free(*inputs);
+    *inputs = NULL;
+
+    return false;
+}
+
+static uint64_t hash_batch_frame(const struct gameboy_frame *frame) {
+    uint64_t hash = 1469598103934665603ULL;
+
+    if (frame->pixels == NULL) {
+        return 0;
+    }
+
+    for (unsigned y = 0; y < GB_LCD_HEIGHT; y++) {
+        const uint32_t *line = (const uint32_t *)((const uint8_t *)frame->pixels + y * frame->pitch);
+
+        for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+            hash = (hash ^ (line[x] & 0xFFFFFF)) * 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+static void dump_batch_frame(const char *directory, const char *rom_file, const struct gameboy_frame *frame) {
+    const char *name = strrchr(rom_file, '/');
+    char path[BATCH_MAX_LINE];
+    FILE *file;
+
+    if (frame->pixels == NULL) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s.ppm", directory, name != NULL ? name + 1 : rom_file);
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("Can't create frame dump");
+        return;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", GB_LCD_WIDTH, GB_LCD_HEIGHT);
+
+    for (unsigned y = 0; y < GB_LCD_HEIGHT; y++) {
+        const uint32_t *line = (const uint32_t *)((const uint8_t *)frame->pixels + y * frame->pitch);
+
+        for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+            uint8_t rgb[3] = { line[x] >> 16, line[x] >> 8, line[x] };
+
+            fwrite(rgb, 1, sizeof(rgb), file);
+        }
+    }
+
+    fclose(file);
+}
+
+static void dump_batch_serial(const char *directory, const char *rom_file, const struct serial_capture *capture) {
+    const char *name = strrchr(rom_file, '/');
+    char path[BATCH_MAX_LINE];
+    FILE *file;
+
+    if (capture->length == 0) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s.txt", directory, name != NULL ? name + 1 : rom_file);
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("Can't create serial dump");
+        return;
+    }
+
+    fwrite(capture->text, 1, capture->length, file);
+    fclose(file);
+}
+
+// the last characters sent, on one line ; test ROMs print their verdict last
+static void get_batch_serial_tail(const struct serial_capture *capture, char tail[BATCH_SERIAL_TAIL + 1]) {
+    unsigned end = capture->length;
+    unsigned start;
+    unsigned length = 0;
+
+    while (end > 0 && isspace((unsigned char)capture->text[end - 1])) {
+        end--;
+    }
+
+    start = (end > BATCH_SERIAL_TAIL) ? end - BATCH_SERIAL_TAIL : 0;
+
+    while (start < end && isspace((unsigned char)capture->text[start])) {
+        start++;
+    }
+
+    for (unsigned i = start; i < end; i++) {
+        char c = capture->text[i];
+
+        if (isspace((unsigned char)c)) {
+            if (tail[length - 1] != ' ') {
+                tail[length++] = ' '; // runs of spaces and line breaks become one space
+            }
+        } else {
+            tail[length++] = isprint((unsigned char)c) ? c : '?';
+        }
+    }
+
+    tail[length] = '\0';
+}
+
+// same sequence as main.c ; about a frame at a time so the inputs land on the frame they were scripted for
+// the cable of gameboy is already plugged in for linked runs ; it is unplugged whatever happens, so the other side doesn't wait
+static void run_batch(struct batch_pool *pool, struct batch_run *run, struct emulator *gameboy) {
+    struct gameboy_frame last_frame = { NULL, 0, GB_PIXEL_XRGB8888 };
+    struct serial_capture *capture = calloc(1, sizeof(*capture));
+    struct batch_input *inputs = NULL;
+    unsigned input_count = 0;
+    unsigned next_input = 0;
+    double start_time;
+
+    if (capture == NULL) {
+        perror("Serial capture allocation failed");
+        disconnect_link(gameboy);
+        return;
+    }
+
+    if (run->script_file != NULL && !load_batch_script(run->script_file, &inputs, &input_count)) {
+        disconnect_link(gameboy);
+        free(capture);
+        return;
+    }
+
+    init_headless_ui(gameboy);
+    gameboy->ui.flip = flip;
+    gameboy->ui.data = &last_frame;
+    set_ppu_framebuffer(gameboy, GB_PIXEL_XRGB8888, 2);
+
+    if (!load_cart(gameboy, run->rom_file)) {
+        disconnect_link(gameboy);
+        free(inputs);
+        free(capture);
+        return;
+    }
+
+    reset_emulator(gameboy);
+
+    capture->stop = true;
+    set_serial_sink(gameboy, capture_serial, capture);
+
+    if (pool->jit) {
+        init_jit(gameboy);
+    }
+
+    start_time = get_wall_time();
+
+    while (gameboy->ppu.frames < run->frames && !gameboy->quit) {
+        while (next_input < input_count && inputs[next_input].frame <= gameboy->ppu.frames) {
+            set_gamepad(gameboy, inputs[next_input].button, inputs[next_input].pressed);
+            next_input++;
+        }
+
+        run->cycles += run_cpu_cycles(gameboy, CPU_FREQUENCY_HZ / 60);
+    }
+
+    run->wall_time = get_wall_time() - start_time;
+    run->hash = hash_batch_frame(&last_frame);
+    run->verdict = capture->verdict;
+    run->locked = gameboy->quit && capture->verdict == GB_SERIAL_VERDICT_NONE;
+    run->frames_run = gameboy->ppu.frames;
+    get_batch_serial_tail(capture, run->serial);
+    run->done = true;
+
+    if (pool->dump_directory != NULL) {
+        dump_batch_frame(pool->dump_directory, run->rom_file, &last_frame);
+        dump_batch_serial(pool->dump_directory, run->rom_file, capture);
+    }
+
+    disconnect_link(gameboy);
+    gameboy->ui.destroy(gameboy);
+    destroy_jit(gameboy);
+    unload_cart(gameboy);
+
+    free(inputs);
+    free(capture);
+}
+
+static void run_batch_alone(struct batch_pool *pool, struct batch_run *run) {
+    struct emulator *gameboy = calloc(1, sizeof(*gameboy));
+
+    if (gameboy == NULL) {
+        perror("GameBoy memory allocation failed!\n");
+        return;
+    }
+
+    run_batch(pool, run, gameboy);
+    free(gameboy);
+}
+
+static void *run_batch_side(void *data) {
+    struct batch_side *side = data;
+
+    run_batch(side->pool, side->run, side->gameboy);
+
+    return NULL;
+}
+
+// both sides of the cable run at the same time ; the second one on a thread of its own
+static void run_batch_pair(struct batch_pool *pool, struct batch_run *runs) {
+    struct emulator *gameboys[2] = { calloc(1, sizeof(struct emulator)), calloc(1, sizeof(struct emulator)) };
+    struct link_channel *channel = create_link_channel();
+    struct batch_side partner = { pool, &runs[1], gameboys[1] };
+    pthread_t thread;
+
+    if (gameboys[0] == NULL || gameboys[1] == NULL || channel == NULL) {
+        perror("GameBoy memory allocation failed!\n");
+        free(channel);
+        free(gameboys[0]);
+        free(gameboys[1]);
+        return;
+    }
+
+    connect_link_channel(gameboys[0], channel, 0);
+    connect_link_channel(gameboys[1], channel, 1);
+
+    if (pthread_create(&thread, NULL, run_batch_side, &partner) != 0) {
+        fprintf(stderr, "Can't start thread of the other side of the link cable\n");
+        disconnect_link(gameboys[0]);
+        disconnect_link(gameboys[1]); // frees the channel
+        free(gameboys[0]);
+        free(gameboys[1]);
+        return;
+    }
+
+    run_batch(pool, &runs[0], gameboys[0]);
+    pthread_join(thread, NULL);
+
+    free(gameboys[0]);
+    free(gameboys[1]);
+}
+
+static void *run_batch_worker(void *data) {
+    struct batch_pool *pool = data;
+    unsigned step = pool->link ? 2 : 1;
+    unsigned index;
+
+    // runs take very different times ; idle workers keep taking the next one rather than owning a fixed share
+    while ((index = atomic_fetch_add(&pool->next, 1) * step) < pool->count) {
+        if (pool->link && index + 1 < pool->count) {
+            run_batch_pair(pool, &pool->runs[index]);
+        } else {
+            run_batch_alone(pool, &pool->runs[index]);
+        }
+    }
+
+    return NULL;
+}
+
+// lines of "<frames> <script|-> <ROM file>" ; the ROM file runs to the end of the line so it may contain spaces
+static bool load_batch_list(const char *path, struct batch_run **runs, unsigned *count) {
+    FILE *file = fopen(path, "r");
+    char line[BATCH_MAX_LINE];
+    unsigned line_number = 0;
+
+    if (file == NULL) {
+        perror("Can't open run list");
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        struct batch_run run = { 0 };
+        unsigned long long frames;
+        char script[BATCH_MAX_LINE];
+        int rom_offset;
+        struct batch_run *grown;
+
+        line_number++;
+        line[strcspn(line, "#\n")] = '\0';
+
+        if (strspn(line, " \t") == strlen(line)) {
+            continue;
+        }
+
+        if (sscanf(line, "%llu %s %n", &frames, script, &rom_offset) != 2 || line[rom_offset] == '\0') {
+            fprintf(stderr, "%s:%u: expected '<frames> <script|-> <ROM file>'\n", path, line_number);
+            fclose(file);
+            return false;
+        }
+
+        run.frames = frames;
+        run.listed = true;
+        run.script_file = strcmp(script, "-") != 0 ? strdup(script) : NULL;
+        run.rom_file = strdup(line + rom_offset);
+
+        grown = realloc(*runs, (*count + 1) * sizeof(**runs));
+        if (grown == NULL || run.rom_file == NULL) {
+            perror("Run list allocation failed");
+            fclose(file);
+            return false;
+        }
+
+        *runs = grown;
+        (*runs)[(*count)++] = run;
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <ROM_FILE>...\n", program);
+    fprintf(stderr, "  --frames N     frames to run each ROM given on the command line (default %u)\n", BATCH_DEFAULT_FRAMES);
+    fprintf(stderr, "  --input FILE   play the inputs of FILE in each ROM given on the command line ; lines of '<frame> <button> press|release'\n");
+    fprintf(stderr, "  --list FILE    add the runs of FILE ; lines of '<frames> <input file|-> <ROM file>'\n");
+    fprintf(stderr, "  --dump DIR     write the last frame of each run to DIR as a PPM, and what it sent over the link port as text\n");
+    fprintf(stderr, "  --threads N    number of runs at a time (default: one per core)\n");
+    fprintf(stderr, "  --jit          translate hot code to native code (x86-64 only)\n");
+    fprintf(stderr, "  --link         link the runs two by two by cable, the first with the second and so on ; the serial column shows what each side sent\n");
+    fprintf(stderr, "  --allow-lock   don't count runs which locked up as failed ; for ROMs which aren't tests\n");
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        { "frames", required_argument, NULL, 'f' },
+        { "input", required_argument, NULL, 'i' },
+        { "list", required_argument, NULL, 'l' },
+        { "dump", required_argument, NULL, 'd' },
+        { "threads", required_argument, NULL, 't' },
+        { "jit", no_argument, NULL, 'j' },
+        { "allow-lock", no_argument, NULL, 'a' },
+        { "link", no_argument, NULL, 'k' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct batch_pool pool = { 0 };
+    struct batch_run *runs = NULL;
+    unsigned count = 0;
+    uint64_t frames = BATCH_DEFAULT_FRAMES;
+    const char *script_file = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *workers;
+    unsigned failed = 0;
+    double start_time;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'i':
+                script_file = optarg;
+                break;
+            case 'l':
+                if (!load_batch_list(optarg, &runs, &count)) {
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'd':
+                pool.dump_directory = optarg;
+                break;
+            case 't':
+                threads = strtol(optarg, NULL, 0);
+                break;
+            case 'j':
+                pool.jit = true;
+                break;
+            case 'a':
+                pool.allow_lock = true;
+                break;
+            case 'k':
+                pool.link = true;
+                break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    for (int i = optind; i < argc; i++) {
+        struct batch_run *grown = realloc(runs, (count + 1) * sizeof(*runs));
+
+        if (grown == NULL) {
+            perror("Run list allocation failed");
+            return EXIT_FAILURE;
+        }
+
+        runs = grown;
+        runs[count++] = (struct batch_run){ .rom_file = argv[i], .frames = frames, .script_file = script_file };
+    }
+
+    if (count == 0) {
+        fprintf(stderr, "No ROM to run!\n");
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    // a worker runs both sides of a pair
+    if (threads > (pool.link ? (count + 1) / 2 : count)) {
+        threads = pool.link ? (count + 1) / 2 : count;
+    }
+
+    workers = malloc(threads * sizeof(*workers));
+    if (workers == NULL) {
+        perror("Worker allocation failed");
+        return EXIT_FAILURE;
+    }
+
+    pool.runs = runs;
+    pool.count = count;
+    atomic_init(&pool.next, 0);
+
+    start_time = get_wall_time();
+
+    // the workers already started take every run ; they must be joined before the runs are freed
+    for (long i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, run_batch_worker, &pool) != 0) {
+            fprintf(stderr, "Can't start worker thread\n");
+            threads = i;
+            break;
+        }
+    }
+
+    if (threads == 0) {
+        free(workers);
+        return EXIT_FAILURE;
+    }
+
+    for (long i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    printf("%-32s %-7s %10s %16s %10s %9s  %s\n", "ROM", "STATUS", "FRAMES", "HASH", "MHZ", "WALL", "SERIAL");
+
+    for (unsigned i = 0; i < count; i++) {
+        struct batch_run *run = &runs[i];
+
+        const char *status = "ok";
+
+        if (!run->done) {
+            printf("%-32s %-7s\n", run->rom_file, "error");
+            failed++;
+            continue;
+        }
+
+        if (run->verdict == GB_SERIAL_VERDICT_PASSED) {
+            status = "passed";
+        } else if (run->verdict == GB_SERIAL_VERDICT_FAILED) {
+            status = "failed";
+            failed++;
+        } else if (run->locked) {
+            status = "locked";
+
+            if (!pool.allow_lock) {
+                failed++; // a test ROM locked up before its verdict ; gameboy_c --serial fails it as well
+            }
+        }
+
+        printf("%-32s %-7s %10llu %016llx %10.2f %8.3fs  %s\n", run->rom_file, status, (unsigned long long)run->frames_run,
+                (unsigned long long)run->hash, run->cycles / run->wall_time / 1e6, run->wall_time, run->serial);
+    }
+
+    printf("%u runs on %ld threads in %.3fs ; %u failed\n", count, threads, get_wall_time() - start_time, failed);
+
+    for (unsigned i = 0; i < count; i++) {
+        if (runs[i].listed) {
+            free((char *)runs[i].rom_file);
+            free((char *)runs[i].script_file);
+        }
+    }
+
+    free(workers);
+    free(runs);
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,206 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "emulator.h"
+
+// the rename is only durable once the directory holding the save is on disk as well
+static void sync_battery_directory(struct gameboy_battery *battery) {
+    char *slash;
+    int descriptor;
+
+    strcpy(battery->temp_path, battery->path); // the temporary file is gone ; its name is reused for the directory
+    slash = strrchr(battery->temp_path, '/');
+
+    if (slash == NULL) {
+        strcpy(battery->temp_path, ".");
+    } else {
+        slash[slash == battery->temp_path] = '\0'; // keeps the root directory as "/"
+    }
+
+    descriptor = open(battery->temp_path, O_RDONLY | O_DIRECTORY);
+    if (descriptor < 0 || fsync(descriptor) != 0) {
+        fprintf(stderr, "Can't sync the directory of save file '%s': %s\n", battery->path, strerror(errno));
+    }
+
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+}
+
+// the previous save stays in place until the new one is fully on disk ; a crash while writing loses only the new one
+static bool write_battery_file(struct gameboy_battery *battery) {
+    size_t position = 0;
+    int descriptor;
+
+    // unique name ; several emulators may run the same game
+    strcpy(battery->temp_path, battery->path);
+    strcat(battery->temp_path, ".XXXXXX");
+
+    descriptor = mkstemp(battery->temp_path);
+    if (descriptor < 0) {
+        fprintf(stderr, "Can't create save file '%s': %s\n", battery->temp_path, strerror(errno));
+        return false;
+    }
+
+    fchmod(descriptor, 0644); // mkstemp only lets the owner read the file
+
+    while (position < battery->length) {
+        ssize_t written = write(descriptor, battery->buffer + position, battery->length - position);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        position += written;
+    }
+
+    if (position < battery->length || fsync(descriptor) != 0) {
+        fprintf(stderr, "Can't write save file '%s': %s\n", battery->temp_path, strerror(errno));
+        close(descriptor);
+        unlink(battery->temp_path);
+        return false;
+    }
+
+    close(descriptor);
+
+    if (rename(battery->temp_path, battery->path) != 0) {
+        fprintf(stderr, "Can't replace save file '%s': %s\n", battery->path, strerror(errno));
+        unlink(battery->temp_path);
+        return false;
+    }
+
+    sync_battery_directory(battery);
+
+    return true;
+}
+
+// writes the staged saves until the cartridge is unloaded ; a save staged meanwhile is written once the current one is done
+static void *run_battery_writer(void *data) {
+    struct gameboy_battery *battery = data;
+
+    pthread_mutex_lock(&battery->lock);
+
+    for (;;) {
+        while (!battery->pending && !battery->quit) {
+            pthread_cond_wait(&battery->wake, &battery->lock);
+        }
+
+        if (!battery->pending) {
+            break; // unloaded with nothing left to write
+        }
+
+        memcpy(battery->buffer, battery->staging, battery->length);
+        battery->pending = false;
+
+        pthread_mutex_unlock(&battery->lock);
+        write_battery_file(battery); // an error is printed ; the next save tries again
+        pthread_mutex_lock(&battery->lock);
+    }
+
+    pthread_mutex_unlock(&battery->lock);
+
+    return NULL;
+}
+
+// called once the save file was loaded ; staging starts from the loaded RAM so only the banks written later need copying
+bool start_battery_writer(struct emulator *gameboy) {
+    struct gameboy_cart *cart = &gameboy->cart;
+    struct gameboy_battery *battery = &cart->battery;
+
+    battery->length = cart->ram_length + (cart->has_rtc ? GB_RTC_DUMP_LENGTH : 0);
+    battery->staging = malloc(battery->length);
+    battery->buffer = malloc(battery->length);
+    battery->temp_path = malloc(strlen(cart->save_file) + strlen(".XXXXXX") + 1);
+    battery->path = cart->save_file;
+    battery->pending = false;
+    battery->quit = false;
+
+    if (battery->staging == NULL || battery->buffer == NULL || battery->temp_path == NULL) {
+        perror("Can't allocate battery save buffers");
+        free(battery->staging);
+        free(battery->buffer);
+        free(battery->temp_path);
+        return false;
+    }
+
+    if (cart->ram_length > 0) {
+        memcpy(battery->staging, cart->ram, cart->ram_length);
+    }
+
+    pthread_mutex_init(&battery->lock, NULL);
+    pthread_cond_init(&battery->wake, NULL);
+
+    if (pthread_create(&battery->thread, NULL, run_battery_writer, battery) != 0) {
+        fprintf(stderr, "Can't start battery save writer\n");
+        pthread_cond_destroy(&battery->wake);
+        pthread_mutex_destroy(&battery->lock);
+        free(battery->staging);
+        free(battery->buffer);
+        free(battery->temp_path);
+        return false;
+    }
+
+    return true;
+}
+
+// waits for the staged save to be written
+void stop_battery_writer(struct emulator *gameboy) {
+    struct gameboy_battery *battery = &gameboy->cart.battery;
+
+    pthread_mutex_lock(&battery->lock);
+    battery->quit = true;
+    pthread_cond_signal(&battery->wake);
+    pthread_mutex_unlock(&battery->lock);
+
+    pthread_join(battery->thread, NULL);
+
+    pthread_cond_destroy(&battery->wake);
+    pthread_mutex_destroy(&battery->lock);
+    free(battery->staging);
+    free(battery->buffer);
+    free(battery->temp_path);
+}
+
+// copies the RAM banks written since the last save and the RTC state for the writer thread ; nothing touches the disk here
+void stage_battery_save(struct emulator *gameboy) {
+    struct gameboy_cart *cart = &gameboy->cart;
+    struct gameboy_battery *battery = &cart->battery;
+
+    pthread_mutex_lock(&battery->lock);
+
+    for (unsigned offset = 0; offset < cart->ram_length; offset += GB_RAM_BANK_SIZE) {
+        if (cart->dirty_ram_banks & (1U << (offset / GB_RAM_BANK_SIZE))) {
+            unsigned length = cart->ram_length - offset;
+
+            if (length > GB_RAM_BANK_SIZE) {
+                length = GB_RAM_BANK_SIZE; // the RAM of some carts is smaller than a bank
+            }
+
+            memcpy(battery->staging + offset, cart->ram + offset, length);
+        }
+    }
+
+    cart->dirty_ram_banks = 0;
+
+    if (cart->has_rtc) {
+        dump_rtc(gameboy, battery->staging + cart->ram_length);
+    }
+
+    battery->pending = true;
+    pthread_cond_signal(&battery->wake);
+
+    pthread_mutex_unlock(&battery->lock);
+}
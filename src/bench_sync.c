@@ -0,0 +1,186 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Microbenchmark of the event scheduler ; compares the heap in sync.c with the linear scan it replaced
+
+#include <string.h>
+#include <time.h>
+
+#include "emulator.h"
+
+#define BENCH_EVENTS 20000000U // number of events fired by each scheduler
+#define BENCH_SLICE_CYCLES (CPU_FREQUENCY_HZ / 120) // the linear scan rebased its 32 bits timestamps once per slice of run_cpu_cycles
+#define BENCH_MAX_TOKENS 8U
+
+// previous scheduler ; one date per token and a scan of every token to find the earliest one
+struct linear_sync {
+    int32_t first_event;
+    int32_t next_event[GB_SYNC_NUM];
+};
+
+struct bench_state {
+    uint32_t random; // xorshift state ; reset before each run so both schedulers see the same workload
+    uint32_t events;
+};
+
+static struct bench_state bench;
+
+static uint32_t get_bench_random(void) {
+    bench.random ^= bench.random << 13;
+    bench.random ^= bench.random >> 17;
+    bench.random ^= bench.random << 5;
+
+    return bench.random;
+}
+
+// delay until the next event of a token ; in the range of what the devices use, from DMA bytes to SPU samples
+static int32_t get_bench_delay(void) {
+    static const int32_t delays[8] = { 4, 80, 172, 204, 456, 1024, 4096, 70224 };
+
+    return delays[get_bench_random() & 7];
+}
+
+static double get_bench_time(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+__attribute__((noinline)) static void linear_sync_next(struct linear_sync *sync, int32_t timestamp, unsigned token, int32_t cycles) {
+    sync->next_event[token] = timestamp + cycles;
+    sync->first_event = sync->next_event[0];
+
+    for (unsigned i = 1; i < GB_SYNC_NUM; i++) {
+        if (sync->next_event[i] < sync->first_event) {
+            sync->first_event = sync->next_event[i];
+        }
+    }
+}
+
+// every event reschedules its own token ; one in four also moves another token, as a register write would
+static void fire_linear_event(struct linear_sync *sync, int32_t timestamp, unsigned token) {
+    linear_sync_next(sync, timestamp, token, get_bench_delay());
+
+    if ((get_bench_random() & 3) == 0) {
+        linear_sync_next(sync, timestamp, get_bench_random() % GB_SYNC_NUM, get_bench_delay());
+    }
+
+    bench.events++;
+}
+
+static double run_linear_bench(void) {
+    struct linear_sync sync;
+    int32_t timestamp = 0;
+    double start;
+
+    memset(&sync, 0, sizeof(sync));
+    bench.random = 1;
+    bench.events = 0;
+
+    start = get_bench_time();
+
+    while (bench.events < BENCH_EVENTS) {
+        // skip straight to the next event so only the scheduler is measured
+        timestamp = sync.first_event;
+
+        while (timestamp >= sync.first_event) {
+            for (unsigned i = 0; i < GB_SYNC_NUM; i++) {
+                if (timestamp >= sync.next_event[i]) {
+                    fire_linear_event(&sync, timestamp, i);
+                }
+            }
+        }
+
+        if (timestamp >= (int32_t)BENCH_SLICE_CYCLES) {
+            for (unsigned i = 0; i < GB_SYNC_NUM; i++) {
+                sync.next_event[i] -= timestamp;
+            }
+
+            sync.first_event -= timestamp;
+            timestamp = 0;
+        }
+    }
+
+    return get_bench_time() - start;
+}
+
+static void fire_heap_event(struct emulator *gameboy, unsigned token) {
+    sync_next(gameboy, token, get_bench_delay());
+
+    if ((get_bench_random() & 3) == 0) {
+        sync_next(gameboy, get_bench_random() % GB_SYNC_NUM, get_bench_delay());
+    }
+
+    bench.events++;
+}
+
+#define BENCH_HANDLER(token) static void bench_handler_##token(struct emulator *gameboy) { fire_heap_event(gameboy, token); }
+
+BENCH_HANDLER(0)
+BENCH_HANDLER(1)
+BENCH_HANDLER(2)
+BENCH_HANDLER(3)
+BENCH_HANDLER(4)
+BENCH_HANDLER(5)
+BENCH_HANDLER(6)
+BENCH_HANDLER(7)
+
+static const sync_handler bench_handlers[BENCH_MAX_TOKENS] = {
+    bench_handler_0, bench_handler_1, bench_handler_2, bench_handler_3, bench_handler_4, bench_handler_5, bench_handler_6, bench_handler_7
+};
+
+static double run_heap_bench(struct emulator *gameboy) {
+    double start;
+
+    reset_sync(gameboy);
+
+    for (unsigned i = 0; i < GB_SYNC_NUM; i++) {
+        gameboy->sync.handlers[i] = bench_handlers[i];
+    }
+
+    bench.random = 1;
+    bench.events = 0;
+
+    start = get_bench_time();
+
+    while (bench.events < BENCH_EVENTS) {
+        gameboy->timestamp = gameboy->sync.first_event;
+
+        check_sync_events(gameboy); // the 64 bits timestamp never needs to be rebased
+    }
+
+    return get_bench_time() - start;
+}
+
+int main(void) {
+    struct emulator *gameboy;
+    double linear_time;
+    double heap_time;
+
+    if (GB_SYNC_NUM > BENCH_MAX_TOKENS) {
+        fprintf(stderr, "Too many sync tokens for the benchmark handlers!\n");
+        return EXIT_FAILURE;
+    }
+
+    gameboy = calloc(1, sizeof(*gameboy));
+    if (gameboy == NULL) {
+        perror("GameBoy memory allocation failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    linear_time = run_linear_bench();
+    heap_time = run_heap_bench(gameboy);
+
+    printf("%u tokens, %u events\n", (unsigned)GB_SYNC_NUM, BENCH_EVENTS);
+    printf("linear scan : %.2fns per event\n", linear_time * 1e9 / BENCH_EVENTS);
+    printf("binary heap : %.2fns per event\n", heap_time * 1e9 / BENCH_EVENTS);
+
+    free(gameboy);
+
+    return 0;
+}
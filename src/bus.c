@@ -24,6 +24,9 @@
 // Object Attribute Memory (sprite configuration) 
 #define OAM_BASE 0xFE00U
 #define OAM_END (OAM_BASE + 0xA0U)
+// I/O registers
+#define IO_BASE 0xFF00U
+#define IO_END (IO_BASE + 0x80U)
 // Zero page RAM 
 #define ZERO_PAGE_RAM_BASE 0xFF80U
 #define ZERO_PAGE_RAM_END (ZERO_PAGE_RAM_BASE + 0x7FU)
@@ -105,824 +108,1044 @@ static uint16_t get_internal_ram_offset(struct emulator *gameboy, uint16_t offse
     return offset;
 }
 
-// read one byte from memory at address
-uint8_t read_bus(struct emulator *gameboy, uint16_t address) {
-    if (address >= ROM_BASE && address < ROM_END) {
-        return read_cart_rom(gameboy, address - ROM_BASE);
-    }
+// point each page of the address space at the host memory currently mapped there ; must be called whenever a bank switch changes the mapping
+void update_bus_pages(struct emulator *gameboy) {
+    struct gameboy_bus *bus = &gameboy->bus;
+    const uint8_t *rom_bank = get_cart_rom_bank(gameboy);
+    uint8_t *video_ram = gameboy->video_ram + 0x2000 * gameboy->video_ram_high_bank;
+    uint8_t *internal_ram_high = gameboy->internal_ram + get_internal_ram_offset(gameboy, 0x1000);
 
-    if (address >= ZERO_PAGE_RAM_BASE && address < ZERO_PAGE_RAM_END) {
-        return gameboy->zero_page_ram[address - ZERO_PAGE_RAM_BASE];
+    for (unsigned page = 0; page < GB_BUS_PAGES; page++) {
+        bus->read_pages[page] = NULL;
+        bus->write_pages[page] = NULL; // writes to ROM, Video RAM and cartridge RAM always have side effects
     }
 
-    if (address >= INTERNAL_RAM_BASE && address < INTERNAL_RAM_END) {
-        uint16_t offset = get_internal_ram_offset(gameboy, address - INTERNAL_RAM_BASE);
+    // ROM bank 0
+    for (unsigned page = 0; page < 4; page++) {
+        bus->read_pages[page] = gameboy->cart.rom + page * GB_BUS_PAGE_SIZE;
+    }
 
-        return gameboy->internal_ram[offset];
+    // switchable ROM bank
+    for (unsigned page = 4; page < 8; page++) {
+        bus->read_pages[page] = rom_bank + (page - 4) * GB_BUS_PAGE_SIZE;
     }
 
-    if (address >= INTERNAL_RAM_ECHO_BASE && address < INTERNAL_RAM_ECHO_END) {
-        uint16_t offset = get_internal_ram_offset(gameboy, address - INTERNAL_RAM_ECHO_BASE);
+    // Video RAM reads don't need the PPU to be synchronized
+    bus->read_pages[0x8] = video_ram;
+    bus->read_pages[0x9] = video_ram + GB_BUS_PAGE_SIZE;
 
-        return gameboy->internal_ram[offset];
+    // Internal RAM and the first page of its mirror ; the second page of the mirror shares its page with OAM and I/O
+    bus->read_pages[0xC] = gameboy->internal_ram;
+    bus->write_pages[0xC] = gameboy->internal_ram;
+    bus->read_pages[0xD] = internal_ram_high;
+    bus->write_pages[0xD] = internal_ram_high;
+    bus->read_pages[0xE] = gameboy->internal_ram;
+    bus->write_pages[0xE] = gameboy->internal_ram;
+
+    // writes to internal RAM pages holding cached code must go through write_bus so the blocks are invalidated
+    for (unsigned page = 0xC; page <= 0xE; page++) {
+        unsigned internal_ram_page = (bus->read_pages[page] - gameboy->internal_ram) >> GB_BUS_PAGE_SHIFT;
+
+        if (gameboy->block_cache.internal_ram_code[internal_ram_page]) {
+            bus->write_pages[page] = NULL;
+        }
     }
 
-    if (address >= VIDEO_RAM_BASE && address < VIDEO_RAM_END) {
-        uint16_t offset = address - VIDEO_RAM_BASE;
+    gameboy->block_cache.stale = true; // the running block may have been decoded from memory which is no longer mapped
+}
 
-        offset += 0x2000 * gameboy->video_ram_high_bank;
+static uint8_t read_input(struct emulator *gameboy, uint16_t address) {
+    return get_gamepad_state(gameboy);
+}
 
-        return gameboy->video_ram[offset];
-    }
+static uint8_t read_sb(struct emulator *gameboy, uint16_t address) {
+    sync_serial(gameboy);
+    return gameboy->serial.data;
+}
 
-    if (address >= CARTRIDGE_RAM_BASE && address < CARTRIDGE_RAM_END) {
-        return read_cart_ram(gameboy, address - CARTRIDGE_RAM_BASE);
-    }
+static uint8_t read_sc(struct emulator *gameboy, uint16_t address) {
+    return get_serial_control(gameboy);
+}
 
-    if (address >= OAM_BASE && address < OAM_END) {
-        return gameboy->ppu.oam[address - OAM_BASE];
-    }
+static uint8_t read_div(struct emulator *gameboy, uint16_t address) {
+    sync_timer(gameboy);
 
-    if (address == REGISTER_INPUT) {
-        return get_gamepad_state(gameboy);
-    }
+    return gameboy->timer.divider_counter >> 8; // return the high 8 bits of the divider counter
+}
 
-    if (address == REGISTER_SB) {
-        return 0xFF;
-    }
+static uint8_t read_tima(struct emulator *gameboy, uint16_t address) {
+    sync_timer(gameboy);
 
-    if (address == REGISTER_SC) {
-        return 0;
-    }
+    return gameboy->timer.counter;
+}
 
-    if (address == REGISTER_DIV) {
-        sync_timer(gameboy);
+static uint8_t read_tma(struct emulator *gameboy, uint16_t address) {
+    return gameboy->timer.modulo;
+}
 
-        return gameboy->timer.divider_counter >> 8; // return the high 8 bits of the divider counter
-    }
+static uint8_t read_tac(struct emulator *gameboy, uint16_t address) {
+    return get_timer_configuration(gameboy);
+}
 
-    if (address == REGISTER_TIMA) {
-        sync_timer(gameboy);
+static uint8_t read_if(struct emulator *gameboy, uint16_t address) {
+    return gameboy->interrupt_request.interrupt_request_flags;
+}
 
-        return gameboy->timer.counter;
-    }
+static uint8_t read_nr10(struct emulator *gameboy, uint16_t address) {
+    uint8_t r = 0x80;
 
-    if (address == REGISTER_TMA) {
-        return gameboy->timer.modulo;
-    }
+    r |= gameboy->spu.nr1.sweep.shift;
+    r |= gameboy->spu.nr1.sweep.subtract << 3;
+    r |= gameboy->spu.nr1.sweep.time << 4;
 
-    if (address == REGISTER_TAC) {
-        return get_timer_configuration(gameboy);
-    }
+    return r;
+}
 
-    if (address == REGISTER_IF) {
-        return gameboy->interrupt_request.interrupt_request_flags;
-    }
+static uint8_t read_nr11(struct emulator *gameboy, uint16_t address) {
+    return (gameboy->spu.nr1.wave.duty_cycle << 6) | 0x3F;
+}
 
-    if (address == REGISTER_NR10) {
-        uint8_t r = 0x80;
+static uint8_t read_nr12(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.nr1.envelope_configuration;
+}
 
-        r |= gameboy->spu.nr1.sweep.shift;
-        r |= gameboy->spu.nr1.sweep.subtract << 3;
-        r |= gameboy->spu.nr1.sweep.time << 4;
+static uint8_t read_nr13(struct emulator *gameboy, uint16_t address) {
+    return 0xFF; // write-only register
+}
 
-        return r;
-    }
+static uint8_t read_nr14(struct emulator *gameboy, uint16_t address) {
+    return (gameboy->spu.nr1.duration.enable << 6) | 0xBF;
+}
 
-    if (address == REGISTER_NR11) {
-        return (gameboy->spu.nr1.wave.duty_cycle << 6) | 0x3F;
-    }
+static uint8_t read_nr21(struct emulator *gameboy, uint16_t address) {
+    return (gameboy->spu.nr2.wave.duty_cycle << 6) | 0x3F;
+}
 
-    if (address == REGISTER_NR12) {
-        return gameboy->spu.nr1.envelope_configuration;
-    }
+static uint8_t read_nr22(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.nr2.envelope_configuration;
+}
 
-    if (address == REGISTER_NR13) {
-        return 0xFF; // write-only register
-    }
+static uint8_t read_nr23(struct emulator *gameboy, uint16_t address) {
+    return 0xFF; // write-only register
+}
 
-    if (address == REGISTER_NR14) {
-        return (gameboy->spu.nr1.duration.enable << 6) | 0xBF;
-    }
+static uint8_t read_nr24(struct emulator *gameboy, uint16_t address) {
+    return (gameboy->spu.nr2.duration.enable << 6) | 0xbF;
+}
 
-    if (address == REGISTER_NR21) {
-        return (gameboy->spu.nr2.wave.duty_cycle << 6) | 0x3F;
-    }
+static uint8_t read_nr30(struct emulator *gameboy, uint16_t address) {
+    sync_spu(gameboy);
+    return (gameboy->spu.nr3.enable << 7) | 0x7F;
+}
 
-    if (address == REGISTER_NR22) {
-        return gameboy->spu.nr2.envelope_configuration;
-    }
+static uint8_t read_nr31(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.nr3.t1;
+}
 
-    if (address == REGISTER_NR23) {
-        return 0xFF; // write-only register
-    }
+static uint8_t read_nr32(struct emulator *gameboy, uint16_t address) {
+    return (gameboy->spu.nr3.volume_shift << 5) | 0x9F;
+}
 
-    if (address == REGISTER_NR24) {
-        return (gameboy->spu.nr2.duration.enable << 6) | 0xbF;
-    }
+static uint8_t read_nr33(struct emulator *gameboy, uint16_t address) {
+    return 0xFF; // write-only register
+}
 
-    if (address == REGISTER_NR30) {
-        sync_spu(gameboy);
-        return (gameboy->spu.nr3.enable << 7) | 0x7F;
-    }
+static uint8_t read_nr34(struct emulator *gameboy, uint16_t address) {
+    return (gameboy->spu.nr3.duration.enable << 6) | 0xBF;
+}
 
-    if (address == REGISTER_NR31) {
-        return gameboy->spu.nr3.t1;
-    }
+static uint8_t read_nr41(struct emulator *gameboy, uint16_t address) {
+    return 0xFF; // write-only register
+}
 
-    if (address == REGISTER_NR32) {
-        return (gameboy->spu.nr3.volume_shift << 5) | 0x9F;
-    }
+static uint8_t read_nr42(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.nr4.envelope_configuration;
+}
 
-    if (address == REGISTER_NR33) {
-        return 0xFF; // write-only register
-    }
+static uint8_t read_nr43(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.nr4.lfsr_configuration;
+}
 
-    if (address == REGISTER_NR34) {
-        return (gameboy->spu.nr3.duration.enable << 6) | 0xBF;
-    }
+static uint8_t read_nr44(struct emulator *gameboy, uint16_t address) {
+    return (gameboy->spu.nr4.duration.enable << 6) | 0xBF;
+}
 
-    if (address == REGISTER_NR41) {
-        return 0xFF; // write-only register
-    }
+static uint8_t read_nr50(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.output_level;
+}
 
-    if (address == REGISTER_NR42) {
-        return gameboy->spu.nr4.envelope_configuration;
-    }
+static uint8_t read_nr51(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.sound_mux;
+}
 
-    if (address == REGISTER_NR43) {
-        return gameboy->spu.nr4.lfsr_configuration;
-    }
+static uint8_t read_nr52(struct emulator *gameboy, uint16_t address) {
+    uint8_t r = 0;
 
-    if (address == REGISTER_NR44) {
-        return (gameboy->spu.nr4.duration.enable << 6) | 0xBF;
-    }
+    sync_spu(gameboy); // the running flags change as the sounds run
 
-    if (address == REGISTER_NR50) {
-        return gameboy->spu.output_level;
-    }
+    r |= gameboy->spu.nr1.running;
+    r |= gameboy->spu.nr2.running << 1;
+    r |= gameboy->spu.nr3.running << 2;
+    r |= gameboy->spu.nr4.running << 3;
+    r |= gameboy->spu.enable << 7;
 
-    if (address == REGISTER_NR51) {
-        return gameboy->spu.sound_mux;
-    }
+    return r;
+}
 
-    if (address == REGISTER_NR52) {
-        uint8_t r = 0;
+static uint8_t read_nr3_ram(struct emulator *gameboy, uint16_t address) {
+    return gameboy->spu.nr3.ram[address - NR3_RAM_BASE];
+}
 
-        r |= gameboy->spu.nr2.running << 1;
-        r |= gameboy->spu.nr3.running << 2;
-        r |= gameboy->spu.enable << 7;
+static uint8_t read_lcdc(struct emulator *gameboy, uint16_t address) {
+    return get_lcdc(gameboy);
+}
 
-        return r;
-    }
+static uint8_t read_lcd_stat(struct emulator *gameboy, uint16_t address) {
+    return get_lcd_stat(gameboy);
+}
 
-    if (address >= NR3_RAM_BASE && address < NR3_RAM_END) {
-        return gameboy->spu.nr3.ram[address - NR3_RAM_BASE];
-    }
+static uint8_t read_scroll_y(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.scroll_y;
+}
 
-    if (address == REGISTER_LCDC) {
-        return get_lcdc(gameboy);
-    }
+static uint8_t read_scroll_x(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.scroll_x;
+}
 
-    if (address == REGISTER_LCD_STAT) {
-        return get_lcd_stat(gameboy);
-    }
+static uint8_t read_ly(struct emulator *gameboy, uint16_t address) {
+    return get_ly(gameboy);
+}
 
-    if (address == REGISTER_SCROLL_Y) {
-        return gameboy->ppu.scroll_y;
-    }
+static uint8_t read_lyc(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.lyc;
+}
 
-    if (address == REGISTER_SCROLL_X) {
-        return gameboy->ppu.scroll_x;
-    }
+static uint8_t read_dma(struct emulator *gameboy, uint16_t address) {
+    return gameboy->dma.source_address >> 8;
+}
 
-    if (address == REGISTER_LY) {
-        return get_ly(gameboy);
-    }
+static uint8_t read_background_palette(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.background_palette;
+}
 
-    if (address == REGISTER_LYC) {
-        return gameboy->ppu.lyc;
-    }
+static uint8_t read_obp0(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.sprite_palette0;
+}
 
-    if (address == REGISTER_DMA) {
-        return gameboy->dma.source_address >> 8;
-    }
+static uint8_t read_obp1(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.sprite_palette1;
+}
 
-    if (address == REGISTER_BACKGROUND_PALETTE) {
-        return gameboy->ppu.background_palette;
-    }
+static uint8_t read_window_y(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.window_y;
+}
 
-    if (address == REGISTER_OBP0) {
-        return gameboy->ppu.sprite_palette0;
-    }
+static uint8_t read_window_x(struct emulator *gameboy, uint16_t address) {
+    return gameboy->ppu.window_x;
+}
 
-    if (address == REGISTER_OBP1) {
-        return gameboy->ppu.sprite_palette1;
+static uint8_t read_vbk(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (address == REGISTER_WINDOW_Y) {
-        return gameboy->ppu.window_y;
-    }
+    return gameboy->video_ram_high_bank | 0xFE;
+}
 
-    if (address == REGISTER_WINDOW_X) {
-        return gameboy->ppu.window_x;
+static uint8_t read_hdma1(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (address == REGISTER_IE) {
-        return gameboy->interrupt_request.interrupt_request_enable;
-    }
+    return gameboy->hdma.source_address >> 8;
+}
 
-    if (gameboy->gbc && address == REGISTER_VBK) {
-        return gameboy->video_ram_high_bank | 0xFE;
+static uint8_t read_hdma2(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA1) {
-        return gameboy->hdma.source_address >> 8;
-    }
+    return gameboy->hdma.source_address & 0xFF;
+}
 
-    if (gameboy->gbc && address == REGISTER_HDMA2) {
-        return gameboy->hdma.source_address & 0xFF;
+static uint8_t read_hdma3(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA3) {
-        return gameboy->hdma.destination_offset >> 8;
+    return gameboy->hdma.destination_offset >> 8;
+}
+
+static uint8_t read_hdma4(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA4) {
-        return gameboy->hdma.destination_offset & 0xFF;
+    return gameboy->hdma.destination_offset & 0xFF;
+}
+
+static uint8_t read_hdma5(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA5) {
-        bool active = gameboy->hdma.run_on_hblank; // if HDMA is configured to run without hblank then everything is copied at once
-        uint8_t r = 0;
+    bool active = gameboy->hdma.run_on_hblank; // if HDMA is configured to run without hblank then everything is copied at once
+    uint8_t r = 0;
+
+    r |= (!active) << 7;
+    r |= gameboy->hdma.length & 0x7f;
 
-        r |= (!active) << 7;
-        r |= gameboy->hdma.length & 0x7f;
+    return r;
+}
 
-        return r;
+static uint8_t read_bcps(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_BCPS) {
-        uint8_t r = 0;
+    uint8_t r = 0;
 
-        r |= gameboy->ppu.background_palettes.auto_increment << 7;
-        r |= gameboy->ppu.background_palettes.write_index;
+    r |= gameboy->ppu.background_palettes.auto_increment << 7;
+    r |= gameboy->ppu.background_palettes.write_index;
 
-        return r;
+    return r;
+}
+
+static uint8_t read_bcpd(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_BCPD) {
-        struct colour_palette *p = &gameboy->ppu.background_palettes;
-        uint16_t index = p->write_index;
-        unsigned palette = index >> 3;
-        unsigned colour_index = (index >> 1) & 3;
-        bool high = index & 1;
-        uint16_t colour = p->colours[palette][colour_index];
+    struct colour_palette *p = &gameboy->ppu.background_palettes;
+    uint16_t index = p->write_index;
+    unsigned palette = index >> 3;
+    unsigned colour_index = (index >> 1) & 3;
+    bool high = index & 1;
+    uint16_t colour = p->colours[palette][colour_index];
 
-        if (high) {
-            return colour >> 8;
-        } else {
-            return colour & 0xFF;
-        }
+    if (high) {
+        return colour >> 8;
+    } else {
+        return colour & 0xFF;
+    }
+}
+
+static uint8_t read_ocps(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_OCPS) {
-        uint8_t r = 0;
+    uint8_t r = 0;
 
-        r |= gameboy->ppu.sprite_palettes.auto_increment << 7;
-        r |= gameboy->ppu.sprite_palettes.write_index;
+    r |= gameboy->ppu.sprite_palettes.auto_increment << 7;
+    r |= gameboy->ppu.sprite_palettes.write_index;
 
-        return r;
+    return r;
+}
+
+static uint8_t read_ocpd(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    if (gameboy->gbc && address == REGISTER_OCPD) {
-        struct colour_palette *p = &gameboy->ppu.sprite_palettes;
-        uint16_t index = p->write_index;
-        unsigned palette = index >> 3;
-        unsigned colour_index = (index >> 1) & 3;
-        bool high = index & 1;
-        uint16_t colour = p->colours[palette][colour_index];
+    struct colour_palette *p = &gameboy->ppu.sprite_palettes;
+    uint16_t index = p->write_index;
+    unsigned palette = index >> 3;
+    unsigned colour_index = (index >> 1) & 3;
+    bool high = index & 1;
+    uint16_t colour = p->colours[palette][colour_index];
 
-        if (high) {
-            return colour >> 8;
-        } else {
-            return colour & 0xff;
-        }
+    if (high) {
+        return colour >> 8;
+    } else {
+        return colour & 0xff;
     }
+}
 
-    if (gameboy->gbc && address == REGISTER_SVBK) {
-        return gameboy->internal_ram_high_bank | 0xF8;
+static uint8_t read_svbk(struct emulator *gameboy, uint16_t address) {
+    if (!gameboy->gbc) {
+        return 0xFF; // GBC-only register
     }
 
-    // printf("Unsupported bus read at address 0x%04x\n", address);
+    return gameboy->internal_ram_high_bank | 0xF8;
+}
 
-    return 0xFF;
+static void write_input(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    select_gamepad(gameboy, value);
 }
 
-// write one byte (value) to memory at address
-void write_bus(struct emulator *gameboy, uint16_t address, uint8_t value) {
-    if (address >= ROM_BASE && address < ROM_END) {
-        write_cart_rom(gameboy, address - ROM_BASE, value);
-        return;
-    }
+static void write_sb(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_serial(gameboy);
+    gameboy->serial.data = value;
+}
 
-    if (address >= ZERO_PAGE_RAM_BASE && address < ZERO_PAGE_RAM_END) {
-        gameboy->zero_page_ram[address - ZERO_PAGE_RAM_BASE] = value;
-        return;
-    }
+static void write_sc(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    set_serial_control(gameboy, value);
+}
 
-    if (address >= INTERNAL_RAM_BASE && address < INTERNAL_RAM_END) {
-        uint16_t offset = get_internal_ram_offset(gameboy, address - INTERNAL_RAM_BASE);
+static void write_div(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_timer(gameboy);
 
-        gameboy->internal_ram[offset] = value;
-        return;
-    }
+    gameboy->timer.divider_counter = 0;
+}
 
-    if (address >= INTERNAL_RAM_ECHO_BASE && address < INTERNAL_RAM_ECHO_END) {
-        uint16_t offset = get_internal_ram_offset(gameboy, address - INTERNAL_RAM_ECHO_BASE);
+static void write_tima(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_timer(gameboy);
+    gameboy->timer.counter = value;
+    sync_timer(gameboy);
+}
 
-        gameboy->internal_ram[offset] = value;
-        return;
-    }
+static void write_tma(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_timer(gameboy);
+    gameboy->timer.modulo = value;
+    sync_timer(gameboy);
+}
 
-    if (address >= VIDEO_RAM_BASE && address < VIDEO_RAM_END) {
-        uint16_t offset = address - VIDEO_RAM_BASE;
+static void write_tac(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    set_timer_configuration(gameboy, value);
+}
 
-        offset += 0x2000 * gameboy->video_ram_high_bank;
+static void write_if(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    gameboy->interrupt_request.interrupt_request_flags = value | 0xE0;
+}
 
-        sync_ppu(gameboy);
-        gameboy->video_ram[offset] = value;
-        return;
+static void write_nr10(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
+        reload_spu_sweep(&gameboy->spu.nr1.sweep, value);
     }
+}
 
-    if (address >= CARTRIDGE_RAM_BASE && address < CARTRIDGE_RAM_END) {
-        write_cart_ram(gameboy, address - CARTRIDGE_RAM_BASE, value);
-        return;
-    }
+static void write_nr11(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-    if (address >= OAM_BASE && address < OAM_END) {
-        sync_ppu(gameboy);
-        gameboy->ppu.oam[address - OAM_BASE] = value;
-        return;
-    }
+        gameboy->spu.nr1.wave.duty_cycle = value >> 6;
 
-    if (address == REGISTER_INPUT) {
-        select_gamepad(gameboy, value);
-        return;
+        reload_spu_duration(&gameboy->spu.nr1.duration, GB_SPU_NR1_T1_MAX, value & 0x3F);
     }
+}
 
-    if (address == REGISTER_SB) {
-        return;
+static void write_nr12(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        gameboy->spu.nr1.envelope_configuration = value; // envelope configuration takes effect on sound start
     }
+}
 
-    if (address == REGISTER_SC) {
-        return;
+static void write_nr13(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
+
+        gameboy->spu.nr1.sweep.divider.offset &= 0x700;
+        gameboy->spu.nr1.sweep.divider.offset |= value;
     }
+}
 
-    if (address == REGISTER_DIV) {
-        sync_timer(gameboy);
+static void write_nr14(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-        gameboy->timer.divider_counter = 0;
-        return;
-    }
+        gameboy->spu.nr1.sweep.divider.offset &= 0xFF;
+        gameboy->spu.nr1.sweep.divider.offset |= ((uint16_t)value & 7) << 8;
 
-    if (address == REGISTER_TIMA) {
-        sync_timer(gameboy);
-        gameboy->timer.counter = value;
-        sync_timer(gameboy);
-        return;
-    }
+        gameboy->spu.nr1.duration.enable = value & 0x40;
 
-    if (address == REGISTER_TMA) {
-        sync_timer(gameboy);
-        gameboy->timer.modulo = value;
-        sync_timer(gameboy);
-        return;
+        if (value & 0x80) {
+            start_spu_nr1(gameboy);
+        }
     }
+}
 
-    if (address == REGISTER_TAC) {
-        set_timer_configuration(gameboy, value);
-        return;
-    }
+static void write_nr21(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-    if (address == REGISTER_IF) {
-        gameboy->interrupt_request.interrupt_request_flags = value | 0xE0;
-        return;
+        gameboy->spu.nr2.wave.duty_cycle = value >> 6;
+
+        reload_spu_duration(&gameboy->spu.nr2.duration, GB_SPU_NR2_T1_MAX, value & 0x3F);
     }
+}
 
-    if (address == REGISTER_IE) {
-        gameboy->interrupt_request.interrupt_request_enable = value;
-        return;
+static void write_nr22(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        gameboy->spu.nr2.envelope_configuration = value; // envelope configuration takes effect on sound start
     }
+}
 
-    if (address == REGISTER_NR10) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
-            reload_spu_sweep(&gameboy->spu.nr1.sweep, value);
-        }
-        return;
+static void write_nr23(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
+
+        gameboy->spu.nr2.divider.offset &= 0x700;
+        gameboy->spu.nr2.divider.offset |= value;
     }
+}
 
-    if (address == REGISTER_NR11) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+static void write_nr24(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            gameboy->spu.nr1.wave.duty_cycle = value >> 6;
+        gameboy->spu.nr2.divider.offset &= 0xFF;
+        gameboy->spu.nr2.divider.offset |= ((uint16_t)value & 7) << 8;
+        gameboy->spu.nr2.duration.enable = value & 0x40;
 
-            reload_spu_duration(&gameboy->spu.nr1.duration, GB_SPU_NR1_T1_MAX, value & 0x3F);
+        if (value & 0x80) {
+            start_spu_nr2(gameboy);
         }
-        return;
     }
+}
+
+static void write_nr30(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        bool enable = (value & 0x80); // enabling doesn't start Sound 3 until 0x80 is written to NR34
+
+        sync_spu(gameboy);
 
-    if (address == REGISTER_NR12) {
-        if (gameboy->spu.enable) {
-            gameboy->spu.nr1.envelope_configuration = value; // envelope configuration takes effect on sound start
+        gameboy->spu.nr3.enable = enable;
+
+        if (!enable) {
+            gameboy->spu.nr3.running = false;
         }
-        return;
     }
+}
 
-    if (address == REGISTER_NR13) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+static void write_nr31(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            gameboy->spu.nr1.sweep.divider.offset &= 0x700;
-            gameboy->spu.nr1.sweep.divider.offset |= value;
-        }
-        return;
+        gameboy->spu.nr3.t1 = value;
+
+        reload_spu_duration(&gameboy->spu.nr3.duration, GB_SPU_NR3_T1_MAX, value);
     }
+}
 
-    if (address == REGISTER_NR14) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+static void write_nr32(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            gameboy->spu.nr1.sweep.divider.offset &= 0xFF;
-            gameboy->spu.nr1.sweep.divider.offset |= ((uint16_t)value & 7) << 8;
+        gameboy->spu.nr3.volume_shift = (value >> 5) & 3;
+    }
+}
 
-            gameboy->spu.nr1.duration.enable = value & 0x40;
+static void write_nr33(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            if (value & 0x80) {
-                start_spu_nr1(gameboy);
-            }
-        }
-        return;
+        gameboy->spu.nr3.divider.offset &= 0x700;
+        gameboy->spu.nr3.divider.offset |= value;
     }
+}
 
-    if (address == REGISTER_NR21) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+static void write_nr34(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            gameboy->spu.nr2.wave.duty_cycle = value >> 6;
+        gameboy->spu.nr3.divider.offset &= 0xFF;
+        gameboy->spu.nr3.divider.offset |= ((uint16_t)value & 7) << 8;
+        gameboy->spu.nr3.duration.enable = value & 0x40;
 
-            reload_spu_duration(&gameboy->spu.nr2.duration, GB_SPU_NR2_T1_MAX, value & 0x3F);
+        if (value & 0x80) {
+            start_spu_nr3(gameboy);
         }
-        return;
     }
+}
 
-    if (address == REGISTER_NR22) {
-        if (gameboy->spu.enable) {
-            gameboy->spu.nr2.envelope_configuration = value; // envelope configuration takes effect on sound start
-        }
-        return;
+static void write_nr41(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
+        reload_spu_duration(&gameboy->spu.nr4.duration, GB_SPU_NR4_T1_MAX, value & 0x3F);
     }
+}
 
-    if (address == REGISTER_NR23) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+static void write_nr42(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        gameboy->spu.nr4.envelope_configuration = value; // envelope configuration takes effect on sound start
+    }
+}
 
-            gameboy->spu.nr2.divider.offset &= 0x700;
-            gameboy->spu.nr2.divider.offset |= value;
-        }
-        return;
+static void write_nr43(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
+        gameboy->spu.nr4.lfsr_configuration = value;
     }
+}
 
-    if (address == REGISTER_NR24) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+static void write_nr44(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            gameboy->spu.nr2.divider.offset &= 0xFF;
-            gameboy->spu.nr2.divider.offset |= ((uint16_t)value & 7) << 8;
-            gameboy->spu.nr2.duration.enable = value & 0x40;
+        gameboy->spu.nr4.duration.enable = value & 0x40;
 
-            if (value & 0x80) {
-                start_spu_nr2(gameboy);
-            }
+        if (value & 0x80) {
+            start_spu_nr4(gameboy);
         }
-        return;
     }
+}
 
-    if (address == REGISTER_NR30) {
-        if (gameboy->spu.enable) {
-            bool enable = (value & 0x80); // enabling doesn't start Sound 3 until 0x80 is written to NR34
-
-            sync_spu(gameboy);
+static void write_nr50(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            gameboy->spu.nr3.enable = enable;
+        gameboy->spu.output_level = value;
 
-            if (!enable) {
-                gameboy->spu.nr3.running = false;
-            }
-        }
-        return;
+        update_spu_sound_amp(gameboy);
     }
+}
 
-    if (address == REGISTER_NR31) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
-
-            gameboy->spu.nr3.t1 = value;
+static void write_nr51(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (gameboy->spu.enable) {
+        sync_spu(gameboy);
 
-            reload_spu_duration(&gameboy->spu.nr3.duration, GB_SPU_NR3_T1_MAX, value);
-        }
-        return;
+        gameboy->spu.sound_mux = value;
+        
+        update_spu_sound_amp(gameboy);
     }
+}
 
-    if (address == REGISTER_NR32) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+static void write_nr52(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    bool enable = value & 0x80;
 
-            gameboy->spu.nr3.volume_shift = (value >> 5) & 3;
-        }
+    if (gameboy->spu.enable == enable) {
         return;
     }
 
-    if (address == REGISTER_NR33) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+    sync_spu(gameboy);
 
-            gameboy->spu.nr3.divider.offset &= 0x700;
-            gameboy->spu.nr3.divider.offset |= value;
-        }
-        return;
+    if (!enable) {
+        reset_spu(gameboy);
     }
 
-    if (address == REGISTER_NR34) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+    gameboy->spu.enable = enable;
+}
 
-            gameboy->spu.nr3.divider.offset &= 0xFF;
-            gameboy->spu.nr3.divider.offset |= ((uint16_t)value & 7) << 8;
-            gameboy->spu.nr3.duration.enable = value & 0x40;
+static void write_nr3_ram(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    gameboy->spu.nr3.ram[address - NR3_RAM_BASE] = value;
+}
 
-            if (value & 0x80) {
-                start_spu_nr3(gameboy);
-            }
-        }
-        return;
-    }
+static void write_lcdc(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    set_lcdc(gameboy, value);
+}
 
-    if (address == REGISTER_NR41) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
-            reload_spu_duration(&gameboy->spu.nr4.duration, GB_SPU_NR4_T1_MAX, value & 0x3F);
-        }
-        return;
-    }
+static void write_lcd_stat(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    set_lcd_stat(gameboy, value);
+}
 
-    if (address == REGISTER_NR42) {
-        if (gameboy->spu.enable) {
-            gameboy->spu.nr4.envelope_configuration = value; // envelope configuration takes effect on sound start
-        }
-        return;
-    }
+static void write_scroll_y(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_ppu(gameboy);
+    gameboy->ppu.scroll_y = value;
+}
 
-    if (address == REGISTER_NR43) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
-            gameboy->spu.nr4.lfsr_configuration = value;
-        }
-        return;
+static void write_scroll_x(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_ppu(gameboy);
+    gameboy->ppu.scroll_x = value;
+}
+
+static void write_lyc(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    gameboy->ppu.lyc = value;
+}
+
+static void write_dma(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    start_dma(gameboy, value);
+}
+
+static void write_background_palette(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_ppu(gameboy);
+    gameboy->ppu.background_palette = value;
+}
+
+static void write_obp0(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_ppu(gameboy);
+    gameboy->ppu.sprite_palette0 = value;
+}
+
+static void write_obp1(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_ppu(gameboy);
+    gameboy->ppu.sprite_palette1 = value;
+}
+
+static void write_window_y(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_ppu(gameboy);
+    gameboy->ppu.window_y = value;
+}
+
+static void write_window_x(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    sync_ppu(gameboy);
+    gameboy->ppu.window_x = value;
+}
+
+static void write_vbk(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_NR44) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+    gameboy->video_ram_high_bank = value & 1;
 
-            gameboy->spu.nr4.duration.enable = value & 0x40;
+    update_bus_pages(gameboy);
+}
 
-            if (value & 0x80) {
-                start_spu_nr4(gameboy);
-            }
-        }
-        return;
+static void write_hdma1(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_NR50) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+    gameboy->hdma.source_address &= 0xFF;
+    gameboy->hdma.source_address |= (value << 8);
+}
 
-            gameboy->spu.output_level = value;
+static void write_hdma2(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
+    }
 
-            update_spu_sound_amp(gameboy);
-        }
-        return;
+    gameboy->hdma.source_address &= 0xFF00;
+    gameboy->hdma.source_address |= value & 0xF0; // lower 4 bits are ignored
+}
+
+static void write_hdma3(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_NR51) {
-        if (gameboy->spu.enable) {
-            sync_spu(gameboy);
+    gameboy->hdma.destination_offset &= 0xFF;
+    gameboy->hdma.destination_offset |= (value << 8);
+}
 
-            gameboy->spu.sound_mux = value;
-            
-            update_spu_sound_amp(gameboy);
-        }
-        return;
+static void write_hdma4(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_NR52) {
-        bool enable = value & 0x80;
+    gameboy->hdma.destination_offset &= 0xFF00;
+    gameboy->hdma.destination_offset |= value & 0xF0; // lower 4 bits are ignored
+}
 
-        if (gameboy->spu.enable == enable) {
-            return;
-        }
+static void write_hdma5(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
+    }
 
-        sync_spu(gameboy);
+    bool run_on_hblank = value & 0x80;
 
-        if (!enable) {
-            reset_spu(gameboy);
-        }
+    gameboy->hdma.length = value & 0x7F;
 
-        gameboy->spu.enable = enable;
-        return;
+    if (!run_on_hblank && gameboy->hdma.run_on_hblank) {
+        // stop the current transfer
+        sync_ppu(gameboy);
+        gameboy->hdma.run_on_hblank = false;
+    } else {
+        start_hdma(gameboy, run_on_hblank);
     }
+}
 
-    if (address >= NR3_RAM_BASE && address < NR3_RAM_END) {
-        gameboy->spu.nr3.ram[address - NR3_RAM_BASE] = value;
-        return;
+static void write_bcps(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_LCDC) {
-        set_lcdc(gameboy, value);
-        return;
+    gameboy->ppu.background_palettes.auto_increment = value & 0x80;
+    gameboy->ppu.background_palettes.write_index = value & 0x3f;
+}
+
+static void write_bcpd(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_LCD_STAT) {
-        set_lcd_stat(gameboy, value);
-        return;
+    struct colour_palette *p = &gameboy->ppu.background_palettes;
+    uint16_t index = p->write_index;
+    unsigned palette = index >> 3;
+    unsigned colour_index = (index >> 1) & 3;
+    bool high = index & 1;
+    uint16_t colour = p->colours[palette][colour_index];
+
+    if (high) {
+        colour &= 0xFF;
+        colour |= value << 8;
+    } else {
+        colour &= 0xFF00;
+        colour |= value;
     }
 
-    if (address == REGISTER_SCROLL_Y) {
-        sync_ppu(gameboy);
-        gameboy->ppu.scroll_y = value;
-        return;
+    p->colours[palette][colour_index] = colour;
+
+    if (p->auto_increment) {
+        p->write_index = (p->write_index + 1) & 0x3F;
     }
+}
 
-    if (address == REGISTER_SCROLL_X) {
-        sync_ppu(gameboy);
-        gameboy->ppu.scroll_x = value;
-        return;
+static void write_ocps(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_LYC) {
-        gameboy->ppu.lyc = value;
-        return;
+    gameboy->ppu.sprite_palettes.auto_increment = value & 0x80;
+    gameboy->ppu.sprite_palettes.write_index = value & 0x3F;
+}
+
+static void write_ocpd(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_DMA) {
-        start_dma(gameboy, value);
-        return;
+    struct colour_palette *p = &gameboy->ppu.sprite_palettes;
+    uint16_t index = p->write_index;
+    unsigned palette = index >> 3;
+    unsigned colour_index = (index >> 1) & 3;
+    bool high = index & 1;
+    uint16_t colour = p->colours[palette][colour_index];
+
+    if (high) {
+        colour &= 0xFF;
+        colour |= value << 8;
+    } else {
+        colour &= 0xFF00;
+        colour |= value;
     }
 
-    if (address == REGISTER_BACKGROUND_PALETTE) {
-        sync_ppu(gameboy);
-        gameboy->ppu.background_palette = value;
-        return;
+    p->colours[palette][colour_index] = colour;
+
+    if (p->auto_increment) {
+        p->write_index = (p->write_index + 1) & 0x3F;
     }
+}
 
-    if (address == REGISTER_OBP0) {
-        sync_ppu(gameboy);
-        gameboy->ppu.sprite_palette0 = value;
-        return;
+static void write_svbk(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    if (!gameboy->gbc) {
+        return; // GBC-only register
     }
 
-    if (address == REGISTER_OBP1) {
-        sync_ppu(gameboy);
-        gameboy->ppu.sprite_palette1 = value;
-        return;
+    gameboy->internal_ram_high_bank = value & 7;
+
+    update_bus_pages(gameboy);
+}
+
+// I/O register handlers ; indexed by address - IO_BASE, unmapped registers are NULL
+static uint8_t (*const io_read_handlers[IO_END - IO_BASE])(struct emulator *gameboy, uint16_t address) = {
+    [REGISTER_INPUT - IO_BASE] = read_input,
+    [REGISTER_SB - IO_BASE] = read_sb,
+    [REGISTER_SC - IO_BASE] = read_sc,
+    [REGISTER_DIV - IO_BASE] = read_div,
+    [REGISTER_TIMA - IO_BASE] = read_tima,
+    [REGISTER_TMA - IO_BASE] = read_tma,
+    [REGISTER_TAC - IO_BASE] = read_tac,
+    [REGISTER_IF - IO_BASE] = read_if,
+    [REGISTER_NR10 - IO_BASE] = read_nr10,
+    [REGISTER_NR11 - IO_BASE] = read_nr11,
+    [REGISTER_NR12 - IO_BASE] = read_nr12,
+    [REGISTER_NR13 - IO_BASE] = read_nr13,
+    [REGISTER_NR14 - IO_BASE] = read_nr14,
+    [REGISTER_NR21 - IO_BASE] = read_nr21,
+    [REGISTER_NR22 - IO_BASE] = read_nr22,
+    [REGISTER_NR23 - IO_BASE] = read_nr23,
+    [REGISTER_NR24 - IO_BASE] = read_nr24,
+    [REGISTER_NR30 - IO_BASE] = read_nr30,
+    [REGISTER_NR31 - IO_BASE] = read_nr31,
+    [REGISTER_NR32 - IO_BASE] = read_nr32,
+    [REGISTER_NR33 - IO_BASE] = read_nr33,
+    [REGISTER_NR34 - IO_BASE] = read_nr34,
+    [REGISTER_NR41 - IO_BASE] = read_nr41,
+    [REGISTER_NR42 - IO_BASE] = read_nr42,
+    [REGISTER_NR43 - IO_BASE] = read_nr43,
+    [REGISTER_NR44 - IO_BASE] = read_nr44,
+    [REGISTER_NR50 - IO_BASE] = read_nr50,
+    [REGISTER_NR51 - IO_BASE] = read_nr51,
+    [REGISTER_NR52 - IO_BASE] = read_nr52,
+    [NR3_RAM_BASE - IO_BASE ... NR3_RAM_END - IO_BASE - 1] = read_nr3_ram,
+    [REGISTER_LCDC - IO_BASE] = read_lcdc,
+    [REGISTER_LCD_STAT - IO_BASE] = read_lcd_stat,
+    [REGISTER_SCROLL_Y - IO_BASE] = read_scroll_y,
+    [REGISTER_SCROLL_X - IO_BASE] = read_scroll_x,
+    [REGISTER_LY - IO_BASE] = read_ly,
+    [REGISTER_LYC - IO_BASE] = read_lyc,
+    [REGISTER_DMA - IO_BASE] = read_dma,
+    [REGISTER_BACKGROUND_PALETTE - IO_BASE] = read_background_palette,
+    [REGISTER_OBP0 - IO_BASE] = read_obp0,
+    [REGISTER_OBP1 - IO_BASE] = read_obp1,
+    [REGISTER_WINDOW_Y - IO_BASE] = read_window_y,
+    [REGISTER_WINDOW_X - IO_BASE] = read_window_x,
+    [REGISTER_VBK - IO_BASE] = read_vbk,
+    [REGISTER_HDMA1 - IO_BASE] = read_hdma1,
+    [REGISTER_HDMA2 - IO_BASE] = read_hdma2,
+    [REGISTER_HDMA3 - IO_BASE] = read_hdma3,
+    [REGISTER_HDMA4 - IO_BASE] = read_hdma4,
+    [REGISTER_HDMA5 - IO_BASE] = read_hdma5,
+    [REGISTER_BCPS - IO_BASE] = read_bcps,
+    [REGISTER_BCPD - IO_BASE] = read_bcpd,
+    [REGISTER_OCPS - IO_BASE] = read_ocps,
+    [REGISTER_OCPD - IO_BASE] = read_ocpd,
+    [REGISTER_SVBK - IO_BASE] = read_svbk,
+};
+
+static void (*const io_write_handlers[IO_END - IO_BASE])(struct emulator *gameboy, uint16_t address, uint8_t value) = {
+    [REGISTER_INPUT - IO_BASE] = write_input,
+    [REGISTER_SB - IO_BASE] = write_sb,
+    [REGISTER_SC - IO_BASE] = write_sc,
+    [REGISTER_DIV - IO_BASE] = write_div,
+    [REGISTER_TIMA - IO_BASE] = write_tima,
+    [REGISTER_TMA - IO_BASE] = write_tma,
+    [REGISTER_TAC - IO_BASE] = write_tac,
+    [REGISTER_IF - IO_BASE] = write_if,
+    [REGISTER_NR10 - IO_BASE] = write_nr10,
+    [REGISTER_NR11 - IO_BASE] = write_nr11,
+    [REGISTER_NR12 - IO_BASE] = write_nr12,
+    [REGISTER_NR13 - IO_BASE] = write_nr13,
+    [REGISTER_NR14 - IO_BASE] = write_nr14,
+    [REGISTER_NR21 - IO_BASE] = write_nr21,
+    [REGISTER_NR22 - IO_BASE] = write_nr22,
+    [REGISTER_NR23 - IO_BASE] = write_nr23,
+    [REGISTER_NR24 - IO_BASE] = write_nr24,
+    [REGISTER_NR30 - IO_BASE] = write_nr30,
+    [REGISTER_NR31 - IO_BASE] = write_nr31,
+    [REGISTER_NR32 - IO_BASE] = write_nr32,
+    [REGISTER_NR33 - IO_BASE] = write_nr33,
+    [REGISTER_NR34 - IO_BASE] = write_nr34,
+    [REGISTER_NR41 - IO_BASE] = write_nr41,
+    [REGISTER_NR42 - IO_BASE] = write_nr42,
+    [REGISTER_NR43 - IO_BASE] = write_nr43,
+    [REGISTER_NR44 - IO_BASE] = write_nr44,
+    [REGISTER_NR50 - IO_BASE] = write_nr50,
+    [REGISTER_NR51 - IO_BASE] = write_nr51,
+    [REGISTER_NR52 - IO_BASE] = write_nr52,
+    [NR3_RAM_BASE - IO_BASE ... NR3_RAM_END - IO_BASE - 1] = write_nr3_ram,
+    [REGISTER_LCDC - IO_BASE] = write_lcdc,
+    [REGISTER_LCD_STAT - IO_BASE] = write_lcd_stat,
+    [REGISTER_SCROLL_Y - IO_BASE] = write_scroll_y,
+    [REGISTER_SCROLL_X - IO_BASE] = write_scroll_x,
+    [REGISTER_LYC - IO_BASE] = write_lyc,
+    [REGISTER_DMA - IO_BASE] = write_dma,
+    [REGISTER_BACKGROUND_PALETTE - IO_BASE] = write_background_palette,
+    [REGISTER_OBP0 - IO_BASE] = write_obp0,
+    [REGISTER_OBP1 - IO_BASE] = write_obp1,
+    [REGISTER_WINDOW_Y - IO_BASE] = write_window_y,
+    [REGISTER_WINDOW_X - IO_BASE] = write_window_x,
+    [REGISTER_VBK - IO_BASE] = write_vbk,
+    [REGISTER_HDMA1 - IO_BASE] = write_hdma1,
+    [REGISTER_HDMA2 - IO_BASE] = write_hdma2,
+    [REGISTER_HDMA3 - IO_BASE] = write_hdma3,
+    [REGISTER_HDMA4 - IO_BASE] = write_hdma4,
+    [REGISTER_HDMA5 - IO_BASE] = write_hdma5,
+    [REGISTER_BCPS - IO_BASE] = write_bcps,
+    [REGISTER_BCPD - IO_BASE] = write_bcpd,
+    [REGISTER_OCPS - IO_BASE] = write_ocps,
+    [REGISTER_OCPD - IO_BASE] = write_ocpd,
+    [REGISTER_SVBK - IO_BASE] = write_svbk,
+};
+
+// read one byte from memory at address
+uint8_t read_bus(struct emulator *gameboy, uint16_t address) {
+    const uint8_t *page = gameboy->bus.read_pages[address >> GB_BUS_PAGE_SHIFT];
+
+    if (page != NULL) {
+        return page[address & GB_BUS_PAGE_MASK]; // ROM, Video RAM or internal RAM
     }
 
-    if (address == REGISTER_WINDOW_Y) {
-        sync_ppu(gameboy);
-        gameboy->ppu.window_y = value;
-        return;
+    if (address >= CARTRIDGE_RAM_BASE && address < CARTRIDGE_RAM_END) {
+        return read_cart_ram(gameboy, address - CARTRIDGE_RAM_BASE);
     }
 
-    if (address == REGISTER_WINDOW_X) {
-        sync_ppu(gameboy);
-        gameboy->ppu.window_x = value;
-        return;
+    if (address >= INTERNAL_RAM_BASE && address < INTERNAL_RAM_ECHO_END) {
+        uint16_t offset = get_internal_ram_offset(gameboy, (address - INTERNAL_RAM_BASE) % 0x2000);
+
+        return gameboy->internal_ram[offset];
     }
 
-    if (gameboy->gbc && address == REGISTER_VBK) {
-        gameboy->video_ram_high_bank = value & 1;
-        return;
+    if (address >= OAM_BASE && address < OAM_END) {
+        return gameboy->ppu.oam[address - OAM_BASE];
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA1) {
-        gameboy->hdma.source_address &= 0xFF;
-        gameboy->hdma.source_address |= (value << 8);
-        return;
+    if (address >= IO_BASE && address < IO_END) {
+        uint8_t (*handler)(struct emulator *, uint16_t) = io_read_handlers[address - IO_BASE];
+
+        if (handler != NULL) {
+            return handler(gameboy, address);
+        }
+
+        // printf("Unsupported bus read at address 0x%04x\n", address);
+
+        return 0xFF;
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA2) {
-        gameboy->hdma.source_address &= 0xFF00;
-        gameboy->hdma.source_address |= value & 0xF0; // lower 4 bits are ignored
-        return;
+    if (address >= ZERO_PAGE_RAM_BASE && address < ZERO_PAGE_RAM_END) {
+        return gameboy->zero_page_ram[address - ZERO_PAGE_RAM_BASE];
+    }
+
+    if (address == REGISTER_IE) {
+        return gameboy->interrupt_request.interrupt_request_enable;
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA3) {
-        gameboy->hdma.destination_offset &= 0xFF;
-        gameboy->hdma.destination_offset |= (value << 8);
+    return 0xFF; // unusable area between OAM and I/O
+}
+
+// write one byte (value) to memory at address
+void write_bus(struct emulator *gameboy, uint16_t address, uint8_t value) {
+    uint8_t *page = gameboy->bus.write_pages[address >> GB_BUS_PAGE_SHIFT];
+
+    if (page != NULL) {
+        page[address & GB_BUS_PAGE_MASK] = value; // internal RAM
         return;
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA4) {
-        gameboy->hdma.destination_offset &= 0xFF00;
-        gameboy->hdma.destination_offset |= value & 0xF0; // lower 4 bits are ignored
+    if (address >= ROM_BASE && address < ROM_END) {
+        write_cart_rom(gameboy, address - ROM_BASE, value);
         return;
     }
 
-    if (gameboy->gbc && address == REGISTER_HDMA5) {
-        bool run_on_hblank = value & 0x80;
+    if (address >= VIDEO_RAM_BASE && address < VIDEO_RAM_END) {
+        uint16_t offset = address - VIDEO_RAM_BASE;
 
-        gameboy->hdma.length = value & 0x7F;
+        offset += 0x2000 * gameboy->video_ram_high_bank;
 
-        if (!run_on_hblank && gameboy->hdma.run_on_hblank) {
-            // stop the current transfer
-            sync_ppu(gameboy);
-            gameboy->hdma.run_on_hblank = false;
-        } else {
-            start_hdma(gameboy, run_on_hblank);
+        if (gameboy->video_ram[offset] == value) {
+            return; // nothing changes ; the PPU doesn't need to catch up
         }
 
+        sync_ppu(gameboy);
+        gameboy->video_ram[offset] = value;
+        invalidate_ppu_tile(gameboy, offset); // copy_hdma also writes through here
         return;
     }
 
-    if (gameboy->gbc && address == REGISTER_BCPS) {
-        gameboy->ppu.background_palettes.auto_increment = value & 0x80;
-        gameboy->ppu.background_palettes.write_index = value & 0x3f;
+    if (address >= CARTRIDGE_RAM_BASE && address < CARTRIDGE_RAM_END) {
+        write_cart_ram(gameboy, address - CARTRIDGE_RAM_BASE, value);
         return;
     }
 
-    if (gameboy->gbc && address == REGISTER_BCPD) {
-        struct colour_palette *p = &gameboy->ppu.background_palettes;
-        uint16_t index = p->write_index;
-        unsigned palette = index >> 3;
-        unsigned colour_index = (index >> 1) & 3;
-        bool high = index & 1;
-        uint16_t colour = p->colours[palette][colour_index];
-
-        if (high) {
-            colour &= 0xFF;
-            colour |= value << 8;
-        } else {
-            colour &= 0xFF00;
-            colour |= value;
-        }
+    if (address >= INTERNAL_RAM_BASE && address < INTERNAL_RAM_ECHO_END) {
+        uint16_t offset = get_internal_ram_offset(gameboy, (address - INTERNAL_RAM_BASE) % 0x2000);
 
-        p->colours[palette][colour_index] = colour;
+        gameboy->internal_ram[offset] = value;
 
-        if (p->auto_increment) {
-            p->write_index = (p->write_index + 1) & 0x3F;
+        if (gameboy->block_cache.internal_ram_code[offset >> GB_BUS_PAGE_SHIFT]) {
+            invalidate_cpu_blocks(gameboy, offset >> GB_BUS_PAGE_SHIFT); // code was decoded from this page
         }
-
         return;
     }
 
-    if (gameboy->gbc && address == REGISTER_OCPS) {
-        gameboy->ppu.sprite_palettes.auto_increment = value & 0x80;
-        gameboy->ppu.sprite_palettes.write_index = value & 0x3F;
+    if (address >= OAM_BASE && address < OAM_END) {
+        sync_ppu(gameboy);
+        gameboy->ppu.oam[address - OAM_BASE] = value;
         return;
     }
 
-    if (gameboy->gbc && address == REGISTER_OCPD) {
-        struct colour_palette *p = &gameboy->ppu.sprite_palettes;
-        uint16_t index = p->write_index;
-        unsigned palette = index >> 3;
-        unsigned colour_index = (index >> 1) & 3;
-        bool high = index & 1;
-        uint16_t colour = p->colours[palette][colour_index];
-
-        if (high) {
-            colour &= 0xFF;
-            colour |= value << 8;
-        } else {
-            colour &= 0xFF00;
-            colour |= value;
-        }
-
-        p->colours[palette][colour_index] = colour;
+    if (address >= IO_BASE && address < IO_END) {
+        void (*handler)(struct emulator *, uint16_t, uint8_t) = io_write_handlers[address - IO_BASE];
 
-        if (p->auto_increment) {
-            p->write_index = (p->write_index + 1) & 0x3F;
+        if (handler != NULL) {
+            handler(gameboy, address, value);
         }
 
+        // printf("Unsupported bus write at address 0x%04x [value=0x%02x]\n", address, value);
+
         return;
     }
 
-    if (gameboy->gbc && address == REGISTER_SVBK) {
-        gameboy->internal_ram_high_bank = value & 7;
+    if (address >= ZERO_PAGE_RAM_BASE && address < ZERO_PAGE_RAM_END) {
+        gameboy->zero_page_ram[address - ZERO_PAGE_RAM_BASE] = value;
         return;
     }
 
-    // printf("Unsupported bus write at address 0x%04x [value=0x%02x]\n", address, value);
+    if (address == REGISTER_IE) {
+        gameboy->interrupt_request.interrupt_request_enable = value;
+        return;
+    }
 }
@@ -5,13 +5,11 @@
  */
 
 #include <ctype.h>
-#include <errno.h>
 #include <string.h>
 
 #include "emulator.h"
 
 #define GB_ROM_BANK_SIZE (16 * 1024) // 16KB ROM banks
-#define GB_RAM_BANK_SIZE (8 * 1024) // 8KB RAM banks
 #define GB_CART_MIN_SIZE (GB_ROM_BANK_SIZE * 2) // GB ROMs are at least 32KB (2 banks)
 #define GB_CART_MAX_SIZE (32U * 1024 * 1024) // largest licensed GB cartridge is 8MB ; but allocate extra space for homebrew GB ROMs
 #define GB_CART_OFF_TITLE 0x134
@@ -41,9 +39,11 @@ static void get_cart_rom_title(struct emulator *gameboy, char title[17]) {
     title[i] = '\0'; // null-terminating value to end string
 }
 
-void load_cart_error(struct gameboy_cart *cart, FILE *file) {
-    if (cart->rom) {
-        free(cart->rom);
+// release whatever load_cart allocated before it failed
+void load_cart_error(struct gameboy_cart *cart) {
+    if (cart->rom_image) {
+        close_rom_image(cart->rom_image);
+        cart->rom_image = NULL;
         cart->rom = NULL;
     }
 
@@ -54,23 +54,18 @@ void load_cart_error(struct gameboy_cart *cart, FILE *file) {
 
     if (cart->save_file) {
         free(cart->save_file);
+        cart->save_file = NULL;
     }
-
-    if (file) {
-        fclose(file);
-    }
-
-    exit(EXIT_FAILURE);
 }
 
-void load_cart(struct emulator *gameboy, const char *rom_path) {
+// returns false if the ROM can't be used ; the reason is printed and nothing is left allocated
+bool load_cart(struct emulator *gameboy, const char *rom_path) {
     struct gameboy_cart *cart = &gameboy->cart;
-    FILE *file = fopen(rom_path, "rb");
-    long length;
     size_t nread;
     char rom_title[17];
     bool has_battery_backup = false;
 
+    cart->rom_image = NULL;
     cart->rom = NULL;
     cart->current_rom_bank = 1;
     cart->ram = NULL;
@@ -79,45 +74,22 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
     cart->mbc1_bank_ram = false;
     cart->save_file = NULL;
     cart->write_ram_flag = false;
+    cart->dirty_ram_banks = 0;
     cart->has_rtc = false;
 
-    if (file == NULL) {
-        perror("Can't open ROM file");
-        load_cart_error(cart, file);
-    }
-
-    if (fseek(file, 0, SEEK_END) == -1 || (length = ftell(file)) == -1 || fseek(file, 0, SEEK_SET) == -1) {
-        fclose(file);
-        perror("Can't get ROM file length");
-        load_cart_error(cart, file);
-    }
-
-    if (length == 0) {
-        fprintf(stderr, "ROM file is empty!\n");
-        load_cart_error(cart, file);
+    // games loaded by several emulators of the process are mapped once
+    cart->rom_image = open_rom_image(rom_path, GB_CART_MAX_SIZE);
+    if (cart->rom_image == NULL) {
+        return false;
     }
 
-    if (length > GB_CART_MAX_SIZE) {
-        fprintf(stderr, "ROM file is too big!\n");
-        load_cart_error(cart, file);
-    }
+    cart->rom = cart->rom_image->data;
+    cart->rom_length = cart->rom_image->length;
 
-    if (length < GB_CART_MIN_SIZE) {
+    if (cart->rom_length < GB_CART_MIN_SIZE) {
         fprintf(stderr, "ROM file is too small!\n");
-        load_cart_error(cart, file);
-    }
-
-    cart->rom_length = length;
-    cart->rom = calloc(1, cart->rom_length);
-    if (cart->rom == NULL) {
-        perror("Can't allocate ROM buffer");
-        load_cart_error(cart, file);
-    }
-
-    nread = fread(cart->rom, 1, cart->rom_length, file);
-    if (nread < cart->rom_length) {
-        fprintf(stderr, "Failed to load ROM file (read %u bytes, expected %u)\n", (unsigned)nread, cart->rom_length);
-        load_cart_error(cart, file);
+        load_cart_error(cart);
+        return false;
     }
 
     // determine the number of ROM banks for this cartridge
@@ -160,13 +132,15 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
             break;
         default:
             fprintf(stderr, "Unknown ROM size configuration: %x\n", cart->rom[GB_CART_OFF_ROM_BANKS]);
-            load_cart_error(cart, file);
+            load_cart_error(cart);
+            return false;
     }
 
     // ensure the ROM file size works with the declared number of ROM banks
     if (cart->rom_length < cart->rom_banks * GB_ROM_BANK_SIZE) {
         fprintf(stderr, "ROM file is too small to hold the declared %d ROM banks\n", cart->rom_banks);
-        load_cart_error(cart, file);
+        load_cart_error(cart);
+        return false;
     }
 
     // determine the number of RAM banks for this cartridge
@@ -195,7 +169,8 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
             break;
         default:
             fprintf(stderr, "Unknown RAM size configuration: %x\n", cart->rom[GB_CART_OFF_RAM_BANKS]);
-            load_cart_error(cart, file);
+            load_cart_error(cart);
+            return false;
     }
 
     switch (cart->rom[GB_CART_OFF_TYPE]) {
@@ -227,7 +202,8 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
             break;
         default:
             fprintf(stderr, "Unsupported cartridge type %x!\n", cart->rom[GB_CART_OFF_TYPE]);
-            load_cart_error(cart, file);
+            load_cart_error(cart);
+            return false;
     }
 
     // check if cart has a battery for memory backup
@@ -257,7 +233,8 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
         cart->ram = calloc(1, cart->ram_length);
         if (cart->ram == NULL) {
             perror("Can't allocate RAM buffer!\n");
-            load_cart_error(cart, file);
+            load_cart_error(cart);
+            return false;
         }
     } else if (!cart->has_rtc) {
         has_battery_backup = false; // memory backup isn't possible without RAM or RTC
@@ -265,13 +242,14 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
 
     if (has_battery_backup) {
         const size_t path_len = strlen(rom_path);
-        FILE *file = NULL;
+        FILE *save;
         size_t pos;
 
-        cart->save_file = malloc(path_len + strlen(".sav"));
+        cart->save_file = malloc(path_len + strlen(".sav") + 1);
         if (cart->save_file == NULL) {
             perror("malloc failed");
-            load_cart_error(cart, file);
+            load_cart_error(cart);
+            return false;
         }
 
         strcpy(cart->save_file, rom_path);
@@ -286,26 +264,27 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
 
         strcat(cart->save_file, ".sav");
 
-        file = fopen(cart->save_file, "rb"); // attempt to open save file if it already exists
-        if (file != NULL) {
+        save = fopen(cart->save_file, "rb"); // attempt to open save file if it already exists
+        if (save != NULL) {
             // the file exists ; load RAM contents
             if (cart->ram_length > 0) {
-                nread = fread(cart->ram, 1, cart->ram_length, file);
+                nread = fread(cart->ram, 1, cart->ram_length, save);
             } else {
                 nread = 0;
             }
 
             if (nread != cart->ram_length) {
                 fprintf(stderr, "RAM save file is too small!\n");
-                fclose(file);
-                load_cart_error(cart, file);
+                fclose(save);
+                load_cart_error(cart);
+                return false;
             }
 
             if (cart->has_rtc) {
-                load_rtc(gameboy, file);
+                load_rtc(gameboy, save);
             }
 
-            fclose(file);
+            fclose(save);
             printf("Loaded RAM save from '%s'\n", cart->save_file);
         } else {
             // no active save file
@@ -314,23 +293,27 @@ void load_cart(struct emulator *gameboy, const char *rom_path) {
             }
         }
 
+        if (!start_battery_writer(gameboy)) {
+            load_cart_error(cart);
+            return false;
+        }
     }
 
-    fclose(file);
-    
     gameboy->gbc = (cart->rom[GB_CART_OFF_GBC] & 0x80); // check if we have a DMG or GBC game
 
     get_cart_rom_title(gameboy, rom_title);
 
+    update_bus_pages(gameboy);
+
     printf("Succesfully Loaded %s\n", rom_path);
     printf("Title: '%s'\n", rom_title);
 
-    return;
+    return true;
 }
 
+// the writer thread does the disk access ; this only copies what changed
 static void save_cart_ram(struct emulator *gameboy) {
     struct gameboy_cart *cart = &gameboy->cart;
-    FILE *file;
 
     if (cart->save_file == NULL) {
         return; // no battery backup
@@ -340,29 +323,26 @@ static void save_cart_ram(struct emulator *gameboy) {
         return; // no changes to RAM since last save
     }
 
-    file = fopen(cart->save_file, "wb");
-    if (file == NULL) {
-        fprintf(stderr, "Can't create or open save file '%s': %s\n", cart->save_file, strerror(errno));
-        exit(EXIT_FAILURE);
-    }
+    stage_battery_save(gameboy);
 
-    if (cart->ram_length > 0) {
-        // dump RAM to file
-        if (fwrite(cart->ram, 1, cart->ram_length, file) < 0) {
-            perror("fwrite failed!\n");
-            fclose(file);
-            exit(EXIT_FAILURE);
-        }
-    }
+    cart->write_ram_flag = false;
+}
+
+// banks has bit i set if RAM bank i changed ; the RTC state is saved in any case
+// schedule a save in 3 emulated seconds after the first change ; games writing all the time are still saved
+void mark_cart_ram_dirty(struct emulator *gameboy, unsigned banks) {
+    struct gameboy_cart *cart = &gameboy->cart;
 
-    if (cart->has_rtc) {
-        dump_rtc(gameboy, file);
+    if (cart->save_file == NULL) {
+        return; // no battery backup
     }
 
-    fflush(file);
-    fclose(file);
-    
-    cart->write_ram_flag = false;
+    cart->dirty_ram_banks |= banks;
+
+    if (!cart->write_ram_flag) {
+        cart->write_ram_flag = true;
+        sync_next(gameboy, GB_SYNC_CART, CPU_FREQUENCY_HZ * 3);
+    }
 }
 
 void unload_cart(struct emulator *gameboy) {
@@ -371,11 +351,13 @@ void unload_cart(struct emulator *gameboy) {
     save_cart_ram(gameboy);
 
     if (cart->save_file) {
+        stop_battery_writer(gameboy); // the last save is on disk once this returns
         free(cart->save_file);
     }
 
-    if (cart->rom) {
-        free(cart->rom);
+    if (cart->rom_image) {
+        close_rom_image(cart->rom_image);
+        cart->rom_image = NULL;
         cart->rom = NULL;
     }
 
@@ -390,50 +372,58 @@ void sync_cart(struct emulator *gameboy) {
     sync_next(gameboy, GB_SYNC_CART, GB_SYNC_NEVER);
 }
 
-uint8_t read_cart_rom(struct emulator *gameboy, uint16_t address) {
-    struct gameboy_cart *cart = &gameboy->cart;
-    unsigned rom_offset = address;
+// offset in the ROM of the bank currently mapped at 0x4000-0x7FFF
+static unsigned get_cart_rom_bank_offset(struct gameboy_cart *cart) {
+    unsigned bank;
 
     switch (cart->model) {
         case GB_CART_SIMPLE:
-            break; // no mapper
+            bank = 1; // no mapper
+            break;
         case GB_CART_MBC1:
-            if (address >= GB_ROM_BANK_SIZE) {
-                unsigned bank = cart->current_rom_bank; // bank 1 can be remapped through this controller
-
-                if (cart->mbc1_bank_ram) {
-                    bank %= 32; // when MBC1 is configured to bank RAM it can only address 16 ROM banks
-                } else {
-                    bank %= 128;
-                }
+            bank = cart->current_rom_bank; // bank 1 can be remapped through this controller
 
-                if (bank == 0) {
-                    bank = 1; // bank 0 can't be mirrored that way ; using a bank of 0 is the same thing as using 1
-                }
+            if (cart->mbc1_bank_ram) {
+                bank %= 32; // when MBC1 is configured to bank RAM it can only address 16 ROM banks
+            } else {
+                bank %= 128;
+            }
 
-                bank %= cart->rom_banks;
-                rom_offset += (bank - 1) * GB_ROM_BANK_SIZE;
+            if (bank == 0) {
+                bank = 1; // bank 0 can't be mirrored that way ; using a bank of 0 is the same thing as using 1
             }
+
+            bank %= cart->rom_banks;
             break;
         case GB_CART_MBC2:
         case GB_CART_MBC3:
-            if (address >= GB_ROM_BANK_SIZE) {
-                rom_offset += (cart->current_rom_bank - 1) * GB_ROM_BANK_SIZE;
-            }
+            bank = cart->current_rom_bank % cart->rom_banks;
             break;
         case GB_CART_MBC5:
-            if (address >= GB_ROM_BANK_SIZE) {
-                unsigned bank = cart->current_rom_bank % cart->rom_banks; // handle this carefully, because bank 0 can be remapped as bank 1 with this controller
-
-                rom_offset -= GB_ROM_BANK_SIZE;
-                rom_offset += bank * GB_ROM_BANK_SIZE;
-            }
+            bank = cart->current_rom_bank % cart->rom_banks; // handle this carefully, because bank 0 can be remapped as bank 1 with this controller
             break;
         default:
             exit(EXIT_FAILURE); // should not be reached
     }
 
-    return cart->rom[rom_offset];
+    return bank * GB_ROM_BANK_SIZE;
+}
+
+// host memory of the ROM bank currently mapped at 0x4000-0x7FFF
+const uint8_t *get_cart_rom_bank(struct emulator *gameboy) {
+    struct gameboy_cart *cart = &gameboy->cart;
+
+    return cart->rom + get_cart_rom_bank_offset(cart);
+}
+
+uint8_t read_cart_rom(struct emulator *gameboy, uint16_t address) {
+    struct gameboy_cart *cart = &gameboy->cart;
+
+    if (address < GB_ROM_BANK_SIZE) {
+        return cart->rom[address]; // bank 0 is never remapped
+    }
+
+    return cart->rom[get_cart_rom_bank_offset(cart) + address - GB_ROM_BANK_SIZE];
 }
 
 void write_cart_rom(struct emulator *gameboy, uint16_t address, uint8_t value) {
@@ -514,6 +504,8 @@ void write_cart_rom(struct emulator *gameboy, uint16_t address, uint8_t value) {
         default:
             exit(EXIT_FAILURE); // should not be reached
     }
+
+    update_bus_pages(gameboy); // the switchable ROM bank may have changed
 }
 
 
@@ -628,10 +620,8 @@ void write_cart_ram(struct emulator *gameboy, uint16_t address, uint8_t value) {
                     write_rtc(gameboy, cart->current_ram_bank, value);
                 }
 
-                if (cart->save_file) {
-                    cart->write_ram_flag = true;
-                    sync_next(gameboy, GB_SYNC_CART, CPU_FREQUENCY_HZ * 3); // schedule a save in a while, even if there are no changes
-                }
+                mark_cart_ram_dirty(gameboy, 0);
+                return;
             }
 
             break;
@@ -647,4 +637,5 @@ void write_cart_ram(struct emulator *gameboy, uint16_t address, uint8_t value) {
     }
 
     cart->ram[ram_offset] = value;
+    mark_cart_ram_dirty(gameboy, 1U << (ram_offset / GB_RAM_BANK_SIZE));
 }
@@ -0,0 +1,240 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+// Round trip of the save states ; runs each ROM to T frames, saves, runs to 2T, then reloads the state and runs to 2T again
+// both states at 2T must be the same byte for byte ; a field left out of the state shows up here instead of as a rewind desync
+
+#include <string.h>
+#include <getopt.h>
+
+#include "emulator.h"
+#include "headless.h"
+
+#define CHECK_DEFAULT_FRAMES 300
+#define CHECK_AUDIO_RATE 48000
+#define CHECK_AUDIO_RING_FRAMES 2048
+
+// the SPU and the CPU keep different state depending on how they run
+struct check_mode {
+    const char *name;
+    enum spu_synthesis synthesis;
+    bool jit;
+};
+
+static const struct check_mode check_modes[] = {
+    { "headless", GB_SPU_SYNTHESIS_NONE, false },
+    { "blep", GB_SPU_SYNTHESIS_BLEP, false },
+    { "point", GB_SPU_SYNTHESIS_POINT, false },
+    { "jit", GB_SPU_SYNTHESIS_NONE, true },
+};
+
+// the samples are thrown away as the audio thread of the UI would play them, so the ring never fills up
+static void run_check_frames(struct emulator *gameboy, uint64_t frames) {
+    static int16_t samples[CHECK_AUDIO_RING_FRAMES][2];
+
+    while (gameboy->ppu.frames < frames && !gameboy->quit) {
+        run_cpu_cycles(gameboy, CPU_FREQUENCY_HZ / 60);
+
+        while (read_spu_samples(gameboy, samples, CHECK_AUDIO_RING_FRAMES) != 0) {
+            // drain the ring
+        }
+    }
+}
+
+// returns NULL if the state can't be allocated ; *length is set to its size
+static uint8_t *save_check_state(struct emulator *gameboy, size_t *length) {
+    uint8_t *state;
+
+    *length = save_state(gameboy, NULL, 0);
+
+    state = malloc(*length);
+    if (state == NULL) {
+        perror("State allocation failed");
+        return NULL;
+    }
+
+    save_state(gameboy, state, *length);
+
+    return state;
+}
+
+// frames drawn since the save point ; the first one is torn, since the framebuffer isn't part of the state
+struct check_frames {
+    uint64_t hash;
+    unsigned skip;
+};
+
+static void start_check_frames(struct check_frames *frames) {
+    frames->hash = 1469598103934665603ULL;
+    frames->skip = 1;
+}
+
+static void flip(struct emulator *gameboy, const struct gameboy_frame *frame) {
+    struct check_frames *frames = gameboy->ui.data;
+
+    if (frames->skip > 0) {
+        frames->skip--;
+        return;
+    }
+
+    for (unsigned y = 0; y < GB_LCD_HEIGHT; y++) {
+        const uint8_t *line = (const uint8_t *)frame->pixels + y * frame->pitch;
+
+        for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+            frames->hash = (frames->hash ^ line[x]) * 1099511628211ULL;
+        }
+    }
+}
+
+// frames is updated with every frame the emulator completes ; NULL if the ROM can't be loaded
+static struct emulator *create_check_emulator(const char *rom_file, const struct check_mode *mode, struct check_frames *frames) {
+    struct emulator *gameboy = calloc(1, sizeof(*gameboy));
+
+    if (gameboy == NULL) {
+        perror("GameBoy memory allocation failed!\n");
+        return NULL;
+    }
+
+    start_check_frames(frames);
+    init_headless_ui(gameboy);
+    gameboy->ui.flip = flip;
+    gameboy->ui.data = frames;
+
+    if (!load_cart(gameboy, rom_file)) {
+        gameboy->ui.destroy(gameboy);
+        free(gameboy);
+        return NULL;
+    }
+
+    reset_emulator(gameboy);
+
+    if (mode->synthesis != GB_SPU_SYNTHESIS_NONE) {
+        gameboy->spu.synthesis = mode->synthesis;
+        set_spu_sample_ring(gameboy, CHECK_AUDIO_RING_FRAMES);
+        set_spu_output_rate(gameboy, CHECK_AUDIO_RATE);
+    }
+
+    if (mode->jit) {
+        init_jit(gameboy);
+    }
+
+    return gameboy;
+}
+
+static void destroy_check_emulator(struct emulator *gameboy) {
+    if (gameboy == NULL) {
+        return;
+    }
+
+    gameboy->ui.destroy(gameboy);
+    destroy_jit(gameboy);
+    unload_cart(gameboy);
+    free(gameboy);
+}
+
+// returns false if the reloaded run ended in a different state than the first one
+// the state is reloaded into a second emulator, so a field it leaves out keeps its reset value rather than the value it had at 2T
+static bool check_state(const char *rom_file, const struct check_mode *mode, uint64_t frames) {
+    struct check_frames drawn[2]; // frames drawn from T to 2T by each emulator
+    struct emulator *first = create_check_emulator(rom_file, mode, &drawn[0]);
+    struct emulator *second = create_check_emulator(rom_file, mode, &drawn[1]);
+    uint8_t *states[3] = { NULL, NULL, NULL }; // at T, at 2T, at 2T again after reloading the first
+    size_t lengths[3] = { 0, 0, 0 };
+    bool same = false;
+
+    if (first == NULL || second == NULL) {
+        destroy_check_emulator(first);
+        destroy_check_emulator(second);
+        return false;
+    }
+
+    run_check_frames(first, frames);
+    states[0] = save_check_state(first, &lengths[0]);
+    start_check_frames(&drawn[0]);
+
+    run_check_frames(first, frames * 2);
+    states[1] = save_check_state(first, &lengths[1]);
+
+    if (states[0] != NULL && states[1] != NULL) {
+        if (!load_state(second, states[0], lengths[0])) {
+            fprintf(stderr, "%s (%s): the state saved at frame %llu doesn't load\n", rom_file, mode->name, (unsigned long long)frames);
+        } else {
+            start_check_frames(&drawn[1]);
+            second->quit = first->quit; // the ROM locked up ; quitting belongs to the UI, not to the state
+            run_check_frames(second, frames * 2);
+            states[2] = save_check_state(second, &lengths[2]);
+        }
+    }
+
+    if (states[2] != NULL) {
+        same = lengths[1] == lengths[2] && memcmp(states[1], states[2], lengths[1]) == 0;
+
+        if (!same) {
+            size_t offset = 0;
+
+            while (offset < lengths[1] && offset < lengths[2] && states[1][offset] == states[2][offset]) {
+                offset++;
+            }
+
+            fprintf(stderr, "%s (%s): the reloaded run differs at byte %zu of %zu\n", rom_file, mode->name, offset, lengths[1]);
+        } else if (drawn[0].hash != drawn[1].hash) {
+            fprintf(stderr, "%s (%s): the reloaded run drew different frames\n", rom_file, mode->name);
+            same = false;
+        }
+    }
+
+    destroy_check_emulator(first);
+    destroy_check_emulator(second);
+
+    for (unsigned i = 0; i < 3; i++) {
+        free(states[i]);
+    }
+
+    return same;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        { "frames", required_argument, NULL, 'f' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    uint64_t frames = CHECK_DEFAULT_FRAMES;
+    unsigned failed = 0;
+    unsigned checks = 0;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'h':
+            default:
+                fprintf(stderr, "Usage: %s [--frames N] <ROM_FILE>...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind == argc) {
+        fprintf(stderr, "No ROM to check!\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        for (unsigned m = 0; m < sizeof(check_modes) / sizeof(check_modes[0]); m++) {
+            if (!check_state(argv[i], &check_modes[m], frames)) {
+                failed++;
+            }
+
+            checks++;
+        }
+    }
+
+    printf("%u state round trips ; %u failed\n", checks, failed);
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
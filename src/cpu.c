@@ -4,6 +4,8 @@
  * February 14, 2023
  */
 
+#include <string.h>
+
 #include "emulator.h"
 
 void reset_cpu(struct emulator *gameboy) {
@@ -26,6 +28,8 @@ void reset_cpu(struct emulator *gameboy) {
     cpu->carry_flag = false;
     cpu->program_counter = 0x100; // push execution past bootrom
 
+    memset(&gameboy->block_cache, 0, sizeof(gameboy->block_cache));
+
     if (gameboy->gbc) {
         cpu->a = 0x11; // GBC sets bootrom register A to 0x11 before game starts ; allows cart to detect if its a DMG orGBC
     }
@@ -40,7 +44,15 @@ static inline void cpu_clock_tick(struct emulator *gameboy, int32_t cycles) {
 }
 
 static uint8_t read_cpu(struct emulator *gameboy, uint16_t address) {
-    uint8_t b = read_bus(gameboy, address);
+    const uint8_t *page = gameboy->bus.read_pages[address >> GB_BUS_PAGE_SHIFT];
+    uint8_t b;
+
+    // directly mapped pages don't need to go through the bus
+    if (page != NULL) {
+        b = page[address & GB_BUS_PAGE_MASK];
+    } else {
+        b = read_bus(gameboy, address);
+    }
 
     cpu_clock_tick(gameboy, 4);
 
@@ -48,7 +60,14 @@ static uint8_t read_cpu(struct emulator *gameboy, uint16_t address) {
 }
 
 static void write_cpu(struct emulator *gameboy, uint16_t address, uint8_t value) {
-    write_bus(gameboy, address, value);
+    uint8_t *page = gameboy->bus.write_pages[address >> GB_BUS_PAGE_SHIFT];
+
+    // directly mapped pages don't need to go through the bus
+    if (page != NULL) {
+        page[address & GB_BUS_PAGE_MASK] = value;
+    } else {
+        write_bus(gameboy, address, value);
+    }
     cpu_clock_tick(gameboy, 4);
 }
 
@@ -138,10 +157,19 @@ static uint16_t cpu_popw(struct emulator *gameboy) {
     return b0 | (b1 << 8);
 }
 
-static uint8_t get_cpu_next_i8(struct emulator *gameboy) {
+static inline uint8_t get_cpu_next_i8(struct emulator *gameboy) {
     struct gameboy_cpu *cpu = &gameboy->cpu;
+    const uint8_t *operands = gameboy->block_cache.operands;
+    uint8_t i8;
 
-    uint8_t i8 = read_cpu(gameboy, cpu->program_counter);
+    if (operands != NULL) {
+        // immediate value was predecoded by the block cache ; the fetch still takes the same time
+        i8 = *operands;
+        gameboy->block_cache.operands = operands + 1;
+        cpu_clock_tick(gameboy, 4);
+    } else {
+        i8 = read_cpu(gameboy, cpu->program_counter);
+    }
 
     cpu->program_counter = (cpu->program_counter + 1) & 0xFFFF;
 
@@ -155,12 +183,16 @@ static uint16_t get_cpu_next_i16(struct emulator *gameboy) {
     return b0 | (b1 << 8);
 }
 
-typedef void (*gameboy_instruction)(struct emulator *);
-
 static void process_nop(struct emulator *gameboy) {
     // NOP
 }
 
+// the CPU locks up ; only this emulator stops, other instances in the process keep running
+static void lock_cpu(struct emulator *gameboy) {
+    gameboy->quit = true;
+    gameboy->block_cache.stale = true; // leave the running block right away
+}
+
 static void process_undefined(struct emulator *gameboy) {
     struct gameboy_cpu *cpu = &gameboy->cpu;
     uint16_t instruction_pc = (cpu->program_counter - 1) & 0xFFFF;
@@ -168,7 +200,7 @@ static void process_undefined(struct emulator *gameboy) {
 
     // Undefined opcode ; freezes the CPU on real hardware
     fprintf(stderr, "Undefined instruction instruction 0x%02x at 0x%04x\n", instruction, instruction_pc);
-    exit(EXIT_FAILURE);
+    lock_cpu(gameboy);
 }
 
 static void process_di(struct emulator *gameboy) {
@@ -182,7 +214,7 @@ static void process_ei(struct emulator *gameboy) {
 
 static void process_stop(struct emulator *gameboy) {
     fprintf(stderr, "PROCESS STOP!\n");
-    exit(EXIT_FAILURE);
+    lock_cpu(gameboy);
 }
 
 static void process_halt(struct emulator *gameboy) {
@@ -1880,8 +1912,9 @@ static void process_rst_38(struct emulator *gameboy) {
 }
 
 static void process_op_cb(struct emulator *gameboy);
+static const gameboy_instruction gameboy_instructions_cb[0x100];
 
-static gameboy_instruction gameboy_instructions[0x100] = {
+static const gameboy_instruction gameboy_instructions[0x100] = {
     // 0x00
     process_nop,
     process_ld_bc_i16,
@@ -2230,33 +2263,285 @@ static void run_cpu_instruction(struct emulator *gameboy) {
     gameboy_instructions[instruction](gameboy);
 }
 
-int32_t run_cpu_cycles(struct emulator *gameboy, int32_t cycles) {
+// total length of each instruction in bytes, including the opcode and its immediate values
+static const uint8_t gameboy_instruction_lengths[0x100] = {
+    // 0x00
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+    // 0x10
+    1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    // 0x20
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    // 0x30
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    // 0x40
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x50
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x60
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x70
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x80
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x90
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0xA0
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0xB0
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0xC0
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+    // 0xD0
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    // 0xE0
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+    // 0xF0
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+};
+
+// true if the instruction may change the program counter, the interrupt state or the halted state ; a block always ends with one of these
+static bool is_cpu_block_terminator(uint8_t opcode) {
+    switch (opcode) {
+        case 0x10: // STOP
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+        case 0x76: // HALT
+        case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET and RETI
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+        case 0xF3: case 0xFB: // DI and EI
+        case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD: // undefined
+            return true;
+        default:
+            return false;
+    }
+}
+
+// decode instructions starting at code until the end of the block ; available is the number of bytes left before the end of the page
+static void decode_cpu_block(struct cpu_block *block, const uint8_t *code, unsigned available) {
+    unsigned offset = 0;
+
+    block->code = code;
+    block->ops_count = 0;
+    block->idle_loop = (available >= 2 && code[0] == 0x18 && code[1] == 0xFE); // JR -2
+    block->heat = 0;
+    block->native_ops = 0;
+    block->native = NULL;
+
+    while (block->ops_count < GB_CPU_BLOCK_MAX_OPS) {
+        uint8_t opcode = code[offset];
+        unsigned length = gameboy_instruction_lengths[opcode];
+        struct cpu_block_op *op;
+
+        if (offset + length > available) {
+            break; // instruction crosses into the next page ; it is left to the interpreter
+        }
+
+        op = &block->ops[block->ops_count++];
+
+        if (opcode == 0xCB) {
+            op->handler = gameboy_instructions_cb[code[offset + 1]];
+            op->opcode = code[offset + 1];
+            op->prefix_length = 2;
+        } else {
+            op->handler = gameboy_instructions[opcode];
+            op->opcode = opcode;
+            op->prefix_length = 1;
+
+            for (unsigned i = 1; i < length; i++) {
+                op->operands[i - 1] = code[offset + i];
+            }
+        }
+
+        offset += length;
+
+        if (is_cpu_block_terminator(opcode)) {
+            break;
+        }
+    }
+}
+
+// find the block starting at the program counter, decoding it if it isn't cached ; returns NULL if the code can't be cached
+static struct cpu_block *get_cpu_block(struct emulator *gameboy) {
+    struct gameboy_block_cache *block_cache = &gameboy->block_cache;
+    uint16_t pc = gameboy->cpu.program_counter;
+    unsigned page = pc >> GB_BUS_PAGE_SHIFT;
+    const uint8_t *host_page = gameboy->bus.read_pages[page];
+    unsigned internal_ram_page = 0;
+    const uint8_t *code;
+    uintptr_t key;
+    struct cpu_block *block;
+
+    // only ROM and internal RAM are cached ; code running from Video RAM, cartridge RAM or the zero page is interpreted
+    if (host_page == NULL || page == 0x8 || page == 0x9) {
+        return NULL;
+    }
+
+    if (page >= 0xC) {
+        internal_ram_page = (host_page - gameboy->internal_ram) >> GB_BUS_PAGE_SHIFT;
+
+        if (block_cache->internal_ram_invalidations[internal_ram_page] >= GB_CPU_BLOCK_MAX_INVALIDATIONS) {
+            return NULL; // page keeps being rewritten ; decoding it again is wasted work
+        }
+    }
+
+    code = host_page + (pc & GB_BUS_PAGE_MASK);
+    key = (uintptr_t)code;
+    block = &block_cache->blocks[(key ^ (key >> 11)) & (GB_CPU_BLOCK_CACHE_SIZE - 1)];
+
+    if (block->code != code) {
+        decode_cpu_block(block, code, GB_BUS_PAGE_SIZE - (pc & GB_BUS_PAGE_MASK));
+
+        if (page >= 0xC && !block_cache->internal_ram_code[internal_ram_page]) {
+            block_cache->internal_ram_code[internal_ram_page] = true;
+            update_bus_pages(gameboy); // writes to this page must now go through the bus to invalidate the block
+        }
+    }
+
+    return block;
+}
+
+// drop every block decoded from a page of internal RAM ; called by the bus when that page is written
+void invalidate_cpu_blocks(struct emulator *gameboy, unsigned internal_ram_page) {
+    struct gameboy_block_cache *block_cache = &gameboy->block_cache;
+    const uint8_t *start = gameboy->internal_ram + internal_ram_page * GB_BUS_PAGE_SIZE;
+
+    for (unsigned i = 0; i < GB_CPU_BLOCK_CACHE_SIZE; i++) {
+        struct cpu_block *block = &block_cache->blocks[i];
+
+        if (block->code >= start && block->code < start + GB_BUS_PAGE_SIZE) {
+            block->code = NULL;
+        }
+    }
+
+    block_cache->internal_ram_code[internal_ram_page] = false;
+
+    if (block_cache->internal_ram_invalidations[internal_ram_page] < GB_CPU_BLOCK_MAX_INVALIDATIONS) {
+        block_cache->internal_ram_invalidations[internal_ram_page]++;
+    }
+
+    update_bus_pages(gameboy); // restore direct writes to the page ; this also ends the running block
+}
+
+// drop every block decoded from internal RAM without counting it as an invalidation ; called when the whole RAM is replaced, e.g. by a save state
+void flush_cpu_ram_blocks(struct emulator *gameboy) {
+    struct gameboy_block_cache *block_cache = &gameboy->block_cache;
+
+    for (unsigned i = 0; i < GB_CPU_BLOCK_CACHE_SIZE; i++) {
+        struct cpu_block *block = &block_cache->blocks[i];
+
+        if (block->code >= gameboy->internal_ram && block->code < gameboy->internal_ram + sizeof(gameboy->internal_ram)) {
+            block->code = NULL;
+        }
+    }
+
+    memset(block_cache->internal_ram_code, 0, sizeof(block_cache->internal_ram_code));
+
+    update_bus_pages(gameboy);
+}
+
+// run cached blocks from the program counter until run_cpu_cycles has something else to do than run the next instruction
+static void run_cpu_blocks(struct emulator *gameboy, uint64_t end) {
     struct gameboy_cpu *cpu = &gameboy->cpu;
+    struct gameboy_block_cache *block_cache = &gameboy->block_cache;
+    struct gameboy_interrupt_request *interrupt_request = &gameboy->interrupt_request;
+
+    for (;;) {
+        struct cpu_block *block = get_cpu_block(gameboy);
+        unsigned i;
+
+        if (block == NULL || block->ops_count == 0) {
+            run_cpu_instruction(gameboy); // code can't be cached ; interpret a single instruction
+            return;
+        }
+
+        if (block->idle_loop) {
+            uint64_t limit = (end < gameboy->sync.first_event) ? end : gameboy->sync.first_event;
+
+            // nothing can happen before the next event ; skip every iteration of the loop which ends before it
+            if (gameboy->timestamp < limit) {
+                gameboy->timestamp += (limit - 1 - gameboy->timestamp) / 12 * 12;
+            }
+        }
+
+        if (gameboy->jit.enabled && block->heat < GB_JIT_THRESHOLD && ++block->heat == GB_JIT_THRESHOLD) {
+            compile_jit_block(gameboy, block); // the block is hot
+        }
+
+        block_cache->stale = false;
+        i = 0;
+
+        if (block->native != NULL) {
+            uint64_t limit = (end < gameboy->sync.first_event) ? end : gameboy->sync.first_event;
+
+            // the translated instructions don't touch memory so they can run in one go if no event or the end of the slice falls in the middle
+            if (gameboy->timestamp + block->native_cycles < limit) {
+                block->native(cpu);
+                cpu->program_counter = (cpu->program_counter + block->native_length) & 0xFFFF;
+                gameboy->timestamp += block->native_cycles;
+                i = block->native_ops;
+            }
+        }
+
+        for (; i < block->ops_count; i++) {
+            const struct cpu_block_op *op = &block->ops[i];
+
+            // opcode fetch ; 0xCB prefixed instructions fetch a second opcode
+            cpu->program_counter = (cpu->program_counter + op->prefix_length) & 0xFFFF;
+            cpu_clock_tick(gameboy, 4);
 
-    rebase_sync(gameboy); 
+            if (op->prefix_length == 2) {
+                cpu_clock_tick(gameboy, 4);
+            }
+
+            block_cache->operands = op->operands;
+            op->handler(gameboy);
+
+            if (gameboy->timestamp >= end || block_cache->stale) {
+                block_cache->operands = NULL;
+                return;
+            }
+
+            if (interrupt_request->interrupt_request_enable & interrupt_request->interrupt_request_flags & 0x1F) {
+                block_cache->operands = NULL;
+                return; // interrupt request pending
+            }
+        }
+
+        block_cache->operands = NULL;
+
+        // the last instruction of a block may have halted the CPU or changed the interrupt master enable
+        if (cpu->halted || cpu->interrupt_master_enable != cpu->interrupt_request_enable_next) {
+            return;
+        }
+    }
+}
+
+// run the CPU for at least cycles and return how many actually ran ; the last instruction or a halted skip may overshoot
+uint64_t run_cpu_cycles(struct emulator *gameboy, uint64_t cycles) {
+    struct gameboy_cpu *cpu = &gameboy->cpu;
+    uint64_t start = gameboy->timestamp;
+    uint64_t end = start + cycles;
 
-    while (gameboy->timestamp < cycles) {
+    while (gameboy->timestamp < end && !gameboy->quit) {
         check_cpu_interrupts(gameboy); // check for interrupt as it may exit system from halted mode
         cpu->interrupt_master_enable = cpu->interrupt_request_enable_next;
 
         if (cpu->halted) {
-            int32_t skip_cycles;
+            uint64_t wake = (end < gameboy->sync.first_event) ? end : gameboy->sync.first_event;
 
-            // the CPU is halted so we skip to the next event or cycles
-            if (cycles < gameboy->sync.first_event) {
-                skip_cycles = cycles - gameboy->timestamp;
-            } else {
-                skip_cycles = gameboy->sync.first_event - gameboy->timestamp;
+            // the CPU is halted so we skip to the next event or the end of the slice
+            if (wake > gameboy->timestamp) {
+                gameboy->timestamp = wake;
             }
 
-            cpu_clock_tick(gameboy, skip_cycles);
             check_sync_events(gameboy); // check if any event needs to run ; this may trigger an interrupt request which will un-halt the CPU in the next iteration
         } else {
-            run_cpu_instruction(gameboy);
+            run_cpu_blocks(gameboy, end);
         }
     }
 
-    return gameboy->timestamp;
+    return gameboy->timestamp - start;
 }
 
 static void cpu_rlc_set_flags(struct emulator *gameboy, uint8_t *value) {
@@ -3964,7 +4249,7 @@ static void process_set_7_mhl(struct emulator *gameboy) {
     write_cpu(gameboy, hl, value);
 }
 
-static gameboy_instruction gameboy_instructions_cb[0x100] = {
+static const gameboy_instruction gameboy_instructions_cb[0x100] = {
     // 0x00
     process_rlc_b,
     process_rlc_c,
@@ -0,0 +1,50 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include "emulator.h"
+
+// power on the console with the cart already loaded ; the UI keeps what it configured, e.g. the SPU synthesis and the framebuffer
+void reset_emulator(struct emulator *gameboy) {
+    reset_sync(gameboy);
+    reset_interrupt_request(gameboy);
+    reset_cpu(gameboy);
+    reset_ppu(gameboy);
+    reset_gamepad(gameboy);
+    reset_dma(gameboy);
+    reset_timer(gameboy);
+    reset_spu(gameboy);
+    reset_serial(gameboy);
+
+    gameboy->internal_ram_high_bank = 1;
+    gameboy->video_ram_high_bank = false;
+    gameboy->quit = false;
+
+    update_bus_pages(gameboy);
+}
+
+// speed the UI paces the emulation to right now
+double get_emulator_speed(struct emulator *gameboy) {
+    return gameboy->speed.turbo ? gameboy->speed.turbo_speed : gameboy->speed.speed;
+}
+
+static void update_emulator_speed(struct emulator *gameboy) {
+    set_spu_speed(gameboy, get_emulator_speed(gameboy));
+}
+
+// only the pacing and the pitch of the audio change ; the games see the same clock at every speed
+void set_emulator_speed(struct emulator *gameboy, double speed) {
+    if (speed != GB_SPEED_UNBOUNDED) {
+        speed = (speed < GB_SPEED_MIN) ? GB_SPEED_MIN : (speed > GB_SPEED_MAX) ? GB_SPEED_MAX : speed;
+    }
+
+    gameboy->speed.speed = speed;
+    update_emulator_speed(gameboy);
+}
+
+void set_emulator_turbo(struct emulator *gameboy, bool turbo) {
+    gameboy->speed.turbo = turbo;
+    update_emulator_speed(gameboy);
+}
@@ -0,0 +1,31 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include "emulator.h"
+#include "headless.h"
+
+static void flip(struct emulator *gameboy, const struct gameboy_frame *frame) {
+    // nothing to display
+}
+
+static void refresh_gamepad(struct emulator *gameboy) {
+    // no user input
+}
+
+static void destroy(struct emulator *gameboy) {
+    gameboy->ui.data = NULL;
+}
+
+void init_headless_ui(struct emulator *gameboy) {
+    gameboy->ui.flip = flip;
+    gameboy->ui.refresh_gamepad = refresh_gamepad;
+    gameboy->ui.destroy = destroy;
+    gameboy->ui.data = NULL;
+
+    set_ppu_framebuffer(gameboy, GB_PIXEL_INDEX, 2); // smallest format ; nobody looks at the frames
+
+    gameboy->spu.synthesis = GB_SPU_SYNTHESIS_NONE; // nobody listens ; only the registers have to behave
+}
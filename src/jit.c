@@ -0,0 +1,591 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <stddef.h>
+
+#include "emulator.h"
+
+#ifdef GB_JIT_SUPPORTED
+
+#include <sys/mman.h>
+
+// LR35902 flags ; used to find which flag values are overwritten before anything reads them
+#define JIT_FLAG_Z 1U
+#define JIT_FLAG_N 2U
+#define JIT_FLAG_H 4U
+#define JIT_FLAG_C 8U
+#define JIT_FLAG_ALL (JIT_FLAG_Z | JIT_FLAG_N | JIT_FLAG_H | JIT_FLAG_C)
+
+#define JIT_MAX_OP_SIZE 48 // upper bound of the native code emitted for a single instruction
+
+// x86 8 bit registers used by the native code ; RDI always points to the CPU registers
+#define X86_AL 0
+#define X86_CL 1
+#define X86_DL 2
+#define X86_AH 4
+#define X86_CH 5
+
+// x86 condition codes for SETcc
+#define X86_SETC 0x92
+#define X86_SETZ 0x94
+#define X86_SETNZ 0x95
+
+#define CPU_OFFSET(field) ((uint8_t)offsetof(struct gameboy_cpu, field))
+
+// offsets of the 8 bit registers in the order used by the opcode encoding ; (HL) is never translated
+static const uint8_t jit_register_offsets[8] = {
+    CPU_OFFSET(b), CPU_OFFSET(c), CPU_OFFSET(d), CPU_OFFSET(e), CPU_OFFSET(h), CPU_OFFSET(l), 0, CPU_OFFSET(a)
+};
+
+// offsets of the high and low registers of BC, DE and HL
+static const uint8_t jit_pair_high_offsets[3] = { CPU_OFFSET(b), CPU_OFFSET(d), CPU_OFFSET(h) };
+static const uint8_t jit_pair_low_offsets[3] = { CPU_OFFSET(c), CPU_OFFSET(e), CPU_OFFSET(l) };
+
+struct jit_op_info {
+    unsigned reads; // flags read by the instruction
+    unsigned writes; // flags written by the instruction
+    unsigned length; // length in bytes of the instruction
+    unsigned cycles;
+};
+
+struct jit_emitter {
+    uint8_t *code;
+    size_t size;
+};
+
+// describe an instruction the JIT can translate ; returns false if it accesses memory or may change the control flow
+static bool get_jit_op_info(const struct cpu_block_op *op, struct jit_op_info *info) {
+    uint8_t opcode = op->opcode;
+    unsigned y = (opcode >> 3) & 7;
+    unsigned z = opcode & 7;
+
+    info->reads = 0;
+    info->writes = 0;
+    info->length = 1;
+    info->cycles = 4;
+
+    if (op->prefix_length == 2) {
+        if (z == 6) {
+            return false; // (HL) operand
+        }
+
+        info->length = 2;
+        info->cycles = 8;
+
+        if (opcode < 0x40) {
+            // rotates, shifts and SWAP ; RL and RR shift the carry in
+            info->writes = JIT_FLAG_ALL;
+            info->reads = (y == 2 || y == 3) ? JIT_FLAG_C : 0;
+        } else if (opcode < 0x80) {
+            info->writes = JIT_FLAG_Z | JIT_FLAG_N | JIT_FLAG_H; // BIT
+        }
+
+        return true;
+    }
+
+    if (opcode >= 0x40 && opcode < 0x80) {
+        return (y != 6 && z != 6); // LD r, r ; 0x76 is HALT
+    }
+
+    if (opcode >= 0x80 && opcode < 0xC0) {
+        if (z == 6) {
+            return false; // (HL) operand
+        }
+
+        info->writes = JIT_FLAG_ALL;
+        info->reads = (y == 1 || y == 3) ? JIT_FLAG_C : 0; // ADC and SBC
+
+        return true;
+    }
+
+    switch (opcode) {
+        case 0x00: // NOP
+            return true;
+        case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // LD r, i8
+            info->length = 2;
+            info->cycles = 8;
+            return true;
+        case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // INC r
+        case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // DEC r
+            info->writes = JIT_FLAG_Z | JIT_FLAG_N | JIT_FLAG_H;
+            return true;
+        case 0xC6: case 0xD6: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU A, i8
+        case 0xCE: case 0xDE: // ADC and SBC A, i8
+            info->writes = JIT_FLAG_ALL;
+            info->reads = (opcode == 0xCE || opcode == 0xDE) ? JIT_FLAG_C : 0;
+            info->length = 2;
+            info->cycles = 8;
+            return true;
+        case 0x01: case 0x11: case 0x21: case 0x31: // LD rr, i16
+            info->length = 3;
+            info->cycles = 12;
+            return true;
+        case 0x03: case 0x13: case 0x23: case 0x33: // INC rr
+        case 0x0B: case 0x1B: case 0x2B: case 0x3B: // DEC rr
+            info->cycles = 8;
+            return true;
+        case 0x09: case 0x19: case 0x29: case 0x39: // ADD HL, rr
+            info->writes = JIT_FLAG_N | JIT_FLAG_H | JIT_FLAG_C;
+            info->cycles = 8;
+            return true;
+        case 0x07: case 0x0F: // RLCA and RRCA
+            info->writes = JIT_FLAG_ALL;
+            return true;
+        case 0x17: case 0x1F: // RLA and RRA
+            info->writes = JIT_FLAG_ALL;
+            info->reads = JIT_FLAG_C;
+            return true;
+        case 0x2F: // CPL
+            info->writes = JIT_FLAG_N | JIT_FLAG_H;
+            return true;
+        case 0x37: // SCF
+            info->writes = JIT_FLAG_N | JIT_FLAG_H | JIT_FLAG_C;
+            return true;
+        case 0x3F: // CCF
+            info->writes = JIT_FLAG_N | JIT_FLAG_H | JIT_FLAG_C;
+            info->reads = JIT_FLAG_C;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void emit_jit_byte(struct jit_emitter *emitter, uint8_t b) {
+    emitter->code[emitter->size++] = b;
+}
+
+// MOV reg8, [RDI + offset]
+static void emit_jit_load(struct jit_emitter *emitter, unsigned reg, uint8_t offset) {
+    emit_jit_byte(emitter, 0x8A);
+    emit_jit_byte(emitter, 0x47 | (reg << 3));
+    emit_jit_byte(emitter, offset);
+}
+
+// MOV [RDI + offset], reg8
+static void emit_jit_store(struct jit_emitter *emitter, unsigned reg, uint8_t offset) {
+    emit_jit_byte(emitter, 0x88);
+    emit_jit_byte(emitter, 0x47 | (reg << 3));
+    emit_jit_byte(emitter, offset);
+}
+
+// MOV BYTE [RDI + offset], value
+static void emit_jit_store_i8(struct jit_emitter *emitter, uint8_t offset, uint8_t value) {
+    emit_jit_byte(emitter, 0xC6);
+    emit_jit_byte(emitter, 0x47);
+    emit_jit_byte(emitter, offset);
+    emit_jit_byte(emitter, value);
+}
+
+// SETcc BYTE [RDI + offset]
+static void emit_jit_setcc(struct jit_emitter *emitter, uint8_t condition, uint8_t offset) {
+    emit_jit_byte(emitter, 0x0F);
+    emit_jit_byte(emitter, condition);
+    emit_jit_byte(emitter, 0x47);
+    emit_jit_byte(emitter, offset);
+}
+
+// MOV DL, [carry_flag] ; SHR DL, 1 ; moves the carry flag into the x86 carry flag
+static void emit_jit_carry_in(struct jit_emitter *emitter) {
+    emit_jit_load(emitter, X86_DL, CPU_OFFSET(carry_flag));
+    emit_jit_byte(emitter, 0xD0);
+    emit_jit_byte(emitter, 0xEA);
+}
+
+// store constant values for the flags in mask ; set holds the flags which are true
+static void emit_jit_constant_flags(struct jit_emitter *emitter, unsigned mask, unsigned set) {
+    if (mask & JIT_FLAG_Z) {
+        emit_jit_store_i8(emitter, CPU_OFFSET(zero_flag), (set & JIT_FLAG_Z) != 0);
+    }
+
+    if (mask & JIT_FLAG_N) {
+        emit_jit_store_i8(emitter, CPU_OFFSET(null_flag), (set & JIT_FLAG_N) != 0);
+    }
+
+    if (mask & JIT_FLAG_H) {
+        emit_jit_store_i8(emitter, CPU_OFFSET(half_carry_flag), (set & JIT_FLAG_H) != 0);
+    }
+
+    if (mask & JIT_FLAG_C) {
+        emit_jit_store_i8(emitter, CPU_OFFSET(carry_flag), (set & JIT_FLAG_C) != 0);
+    }
+}
+
+// store the flags in mask from the x86 flags of the last arithmetic operation ; the x86 auxiliary carry is the half-carry
+static void emit_jit_arithmetic_flags(struct jit_emitter *emitter, unsigned mask, bool null) {
+    if (mask & JIT_FLAG_H) {
+        emit_jit_byte(emitter, 0x9F); // LAHF ; AH = x86 flags
+    }
+
+    if (mask & JIT_FLAG_Z) {
+        emit_jit_setcc(emitter, X86_SETZ, CPU_OFFSET(zero_flag));
+    }
+
+    if (mask & JIT_FLAG_C) {
+        emit_jit_setcc(emitter, X86_SETC, CPU_OFFSET(carry_flag));
+    }
+
+    emit_jit_constant_flags(emitter, mask & JIT_FLAG_N, null ? JIT_FLAG_N : 0);
+
+    if (mask & JIT_FLAG_H) {
+        // TEST AH, 0x10 ; SETNZ [half_carry_flag]
+        emit_jit_byte(emitter, 0xF6);
+        emit_jit_byte(emitter, 0xC4);
+        emit_jit_byte(emitter, 0x10);
+        emit_jit_setcc(emitter, X86_SETNZ, CPU_OFFSET(half_carry_flag));
+    }
+}
+
+// store the carry flag and the zero flag of the value in AL after a rotate or shift
+static void emit_jit_shift_flags(struct jit_emitter *emitter, unsigned mask, bool zero) {
+    if (mask & JIT_FLAG_C) {
+        emit_jit_setcc(emitter, X86_SETC, CPU_OFFSET(carry_flag));
+    }
+
+    if (zero && (mask & JIT_FLAG_Z)) {
+        // TEST AL, AL ; SETZ [zero_flag]
+        emit_jit_byte(emitter, 0x84);
+        emit_jit_byte(emitter, 0xC0);
+        emit_jit_setcc(emitter, X86_SETZ, CPU_OFFSET(zero_flag));
+    }
+
+    emit_jit_constant_flags(emitter, mask & (JIT_FLAG_N | JIT_FLAG_H | (zero ? 0 : JIT_FLAG_Z)), 0);
+}
+
+// ALU operation on A ; the operand is already in CL
+static void emit_jit_alu(struct jit_emitter *emitter, unsigned operation, unsigned mask) {
+    // x86 opcodes of ADD, ADC, SUB, SBB, AND, XOR, OR and CMP AL, CL
+    static const uint8_t alu_opcodes[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38 };
+
+    emit_jit_load(emitter, X86_AL, CPU_OFFSET(a));
+
+    if (operation == 1 || operation == 3) {
+        emit_jit_carry_in(emitter);
+    }
+
+    emit_jit_byte(emitter, alu_opcodes[operation]);
+    emit_jit_byte(emitter, 0xC8);
+
+    if (operation != 7) {
+        emit_jit_store(emitter, X86_AL, CPU_OFFSET(a)); // CP only sets the flags
+    }
+
+    switch (operation) {
+        case 4: // AND
+            emit_jit_shift_flags(emitter, mask & JIT_FLAG_Z, true);
+            emit_jit_constant_flags(emitter, mask & ~JIT_FLAG_Z, JIT_FLAG_H);
+            break;
+        case 5: // XOR
+        case 6: // OR
+            emit_jit_shift_flags(emitter, mask & JIT_FLAG_Z, true);
+            emit_jit_constant_flags(emitter, mask & ~JIT_FLAG_Z, 0);
+            break;
+        default:
+            emit_jit_arithmetic_flags(emitter, mask, operation >= 2);
+            break;
+    }
+}
+
+// CB prefixed instruction on a register
+static void emit_jit_cb_op(struct jit_emitter *emitter, uint8_t opcode, unsigned mask) {
+    // x86 ModRM bytes of ROL, ROR, RCL, RCR, SHL, SAR and SHR AL, 1 ; SWAP uses ROL AL, 4
+    static const uint8_t shift_modrm[8] = { 0xC0, 0xC8, 0xD0, 0xD8, 0xE0, 0xF8, 0xC0, 0xE8 };
+    unsigned y = (opcode >> 3) & 7;
+    uint8_t offset = jit_register_offsets[opcode & 7];
+
+    switch (opcode >> 6) {
+        case 0: // rotates and shifts
+            emit_jit_load(emitter, X86_AL, offset);
+
+            if (y == 2 || y == 3) {
+                emit_jit_carry_in(emitter);
+            }
+
+            if (y == 6) {
+                emit_jit_byte(emitter, 0xC0);
+                emit_jit_byte(emitter, shift_modrm[y]);
+                emit_jit_byte(emitter, 4);
+            } else {
+                emit_jit_byte(emitter, 0xD0);
+                emit_jit_byte(emitter, shift_modrm[y]);
+            }
+
+            emit_jit_store(emitter, X86_AL, offset);
+
+            if (y == 6) {
+                emit_jit_shift_flags(emitter, mask & ~JIT_FLAG_C, true);
+                emit_jit_constant_flags(emitter, mask & JIT_FLAG_C, 0); // SWAP clears the carry
+            } else {
+                emit_jit_shift_flags(emitter, mask, true);
+            }
+            break;
+        case 1: // BIT ; only affects the flags
+            if (mask & JIT_FLAG_Z) {
+                // TEST BYTE [RDI + offset], bit ; SETZ [zero_flag]
+                emit_jit_byte(emitter, 0xF6);
+                emit_jit_byte(emitter, 0x47);
+                emit_jit_byte(emitter, offset);
+                emit_jit_byte(emitter, 1U << y);
+                emit_jit_setcc(emitter, X86_SETZ, CPU_OFFSET(zero_flag));
+            }
+
+            emit_jit_constant_flags(emitter, mask & ~JIT_FLAG_Z, JIT_FLAG_H);
+            break;
+        case 2: // RES ; AND BYTE [RDI + offset], ~bit
+            emit_jit_byte(emitter, 0x80);
+            emit_jit_byte(emitter, 0x67);
+            emit_jit_byte(emitter, offset);
+            emit_jit_byte(emitter, ~(1U << y) & 0xFF);
+            break;
+        default: // SET ; OR BYTE [RDI + offset], bit
+            emit_jit_byte(emitter, 0x80);
+            emit_jit_byte(emitter, 0x4F);
+            emit_jit_byte(emitter, offset);
+            emit_jit_byte(emitter, 1U << y);
+            break;
+    }
+}
+
+// translate one instruction ; only the flags in mask are stored, the others are overwritten before being read
+static void emit_jit_op(struct jit_emitter *emitter, const struct cpu_block_op *op, unsigned mask) {
+    uint8_t opcode = op->opcode;
+    unsigned y = (opcode >> 3) & 7;
+    unsigned z = opcode & 7;
+    unsigned pair = opcode >> 4; // BC, DE, HL or SP
+
+    if (op->prefix_length == 2) {
+        emit_jit_cb_op(emitter, opcode, mask);
+        return;
+    }
+
+    if (opcode >= 0x40 && opcode < 0x80) {
+        emit_jit_load(emitter, X86_AL, jit_register_offsets[z]);
+        emit_jit_store(emitter, X86_AL, jit_register_offsets[y]);
+        return;
+    }
+
+    if (opcode >= 0x80 && opcode < 0xC0) {
+        emit_jit_load(emitter, X86_CL, jit_register_offsets[z]);
+        emit_jit_alu(emitter, y, mask);
+        return;
+    }
+
+    switch (opcode) {
+        case 0x00: // NOP
+            break;
+        case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // LD r, i8
+            emit_jit_store_i8(emitter, jit_register_offsets[y], op->operands[0]);
+            break;
+        case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // INC r
+        case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // DEC r
+            emit_jit_load(emitter, X86_AL, jit_register_offsets[y]);
+            emit_jit_byte(emitter, 0xFE);
+            emit_jit_byte(emitter, (z == 4) ? 0xC0 : 0xC8); // INC AL or DEC AL ; the x86 carry flag is preserved
+            emit_jit_store(emitter, X86_AL, jit_register_offsets[y]);
+            emit_jit_arithmetic_flags(emitter, mask, z == 5);
+            break;
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU A, i8
+            emit_jit_byte(emitter, 0xB1); // MOV CL, i8
+            emit_jit_byte(emitter, op->operands[0]);
+            emit_jit_alu(emitter, y, mask);
+            break;
+        case 0x31: // LD SP, i16 ; MOV WORD [RDI + offset], i16
+            emit_jit_byte(emitter, 0x66);
+            emit_jit_byte(emitter, 0xC7);
+            emit_jit_byte(emitter, 0x47);
+            emit_jit_byte(emitter, CPU_OFFSET(stack_pointer));
+            emit_jit_byte(emitter, op->operands[0]);
+            emit_jit_byte(emitter, op->operands[1]);
+            break;
+        case 0x01: case 0x11: case 0x21: // LD rr, i16
+            emit_jit_store_i8(emitter, jit_pair_low_offsets[pair], op->operands[0]);
+            emit_jit_store_i8(emitter, jit_pair_high_offsets[pair], op->operands[1]);
+            break;
+        case 0x33: case 0x3B: // INC SP and DEC SP ; INC or DEC WORD [RDI + offset]
+            emit_jit_byte(emitter, 0x66);
+            emit_jit_byte(emitter, 0xFF);
+            emit_jit_byte(emitter, (opcode == 0x33) ? 0x47 : 0x4F);
+            emit_jit_byte(emitter, CPU_OFFSET(stack_pointer));
+            break;
+        case 0x03: case 0x13: case 0x23: // INC rr
+        case 0x0B: case 0x1B: case 0x2B: // DEC rr
+            emit_jit_load(emitter, X86_AL, jit_pair_low_offsets[pair]);
+            emit_jit_load(emitter, X86_AH, jit_pair_high_offsets[pair]);
+            emit_jit_byte(emitter, 0x66);
+            emit_jit_byte(emitter, 0xFF);
+            emit_jit_byte(emitter, (opcode & 0x08) ? 0xC8 : 0xC0); // DEC AX or INC AX
+            emit_jit_store(emitter, X86_AL, jit_pair_low_offsets[pair]);
+            emit_jit_store(emitter, X86_AH, jit_pair_high_offsets[pair]);
+            break;
+        case 0x09: case 0x19: case 0x29: case 0x39: // ADD HL, rr
+            emit_jit_load(emitter, X86_AL, CPU_OFFSET(l));
+            emit_jit_load(emitter, X86_AH, CPU_OFFSET(h));
+
+            if (opcode == 0x39) {
+                // MOV CX, [RDI + offset]
+                emit_jit_byte(emitter, 0x66);
+                emit_jit_byte(emitter, 0x8B);
+                emit_jit_byte(emitter, 0x4F);
+                emit_jit_byte(emitter, CPU_OFFSET(stack_pointer));
+            } else {
+                emit_jit_load(emitter, X86_CL, jit_pair_low_offsets[pair]);
+                emit_jit_load(emitter, X86_CH, jit_pair_high_offsets[pair]);
+            }
+
+            // ADD AL, CL ; ADC AH, CH ; the auxiliary carry of the high byte is the carry from bit 11
+            emit_jit_byte(emitter, 0x00);
+            emit_jit_byte(emitter, 0xC8);
+            emit_jit_byte(emitter, 0x10);
+            emit_jit_byte(emitter, 0xEC);
+            emit_jit_store(emitter, X86_AL, CPU_OFFSET(l));
+            emit_jit_store(emitter, X86_AH, CPU_OFFSET(h));
+            emit_jit_arithmetic_flags(emitter, mask, false);
+            break;
+        case 0x07: case 0x0F: case 0x17: case 0x1F: // RLCA, RRCA, RLA and RRA
+            emit_jit_load(emitter, X86_AL, CPU_OFFSET(a));
+
+            if (opcode == 0x17 || opcode == 0x1F) {
+                emit_jit_carry_in(emitter);
+            }
+
+            emit_jit_byte(emitter, 0xD0);
+            emit_jit_byte(emitter, 0xC0 | (y << 3)); // ROL, ROR, RCL or RCR AL, 1
+            emit_jit_store(emitter, X86_AL, CPU_OFFSET(a));
+            emit_jit_shift_flags(emitter, mask, false); // the zero flag is always cleared
+            break;
+        case 0x2F: // CPL ; NOT BYTE [RDI + offset]
+            emit_jit_byte(emitter, 0xF6);
+            emit_jit_byte(emitter, 0x57);
+            emit_jit_byte(emitter, CPU_OFFSET(a));
+            emit_jit_constant_flags(emitter, mask, JIT_FLAG_N | JIT_FLAG_H);
+            break;
+        case 0x37: // SCF
+            emit_jit_constant_flags(emitter, mask, JIT_FLAG_C);
+            break;
+        case 0x3F: // CCF
+            if (mask & JIT_FLAG_C) {
+                // XOR BYTE [RDI + offset], 1
+                emit_jit_byte(emitter, 0x80);
+                emit_jit_byte(emitter, 0x77);
+                emit_jit_byte(emitter, CPU_OFFSET(carry_flag));
+                emit_jit_byte(emitter, 1);
+            }
+
+            emit_jit_constant_flags(emitter, mask & ~JIT_FLAG_C, 0);
+            break;
+    }
+}
+
+// drop every compiled block ; called when the code buffer is full
+static void flush_jit(struct emulator *gameboy) {
+    struct gameboy_block_cache *block_cache = &gameboy->block_cache;
+
+    for (unsigned i = 0; i < GB_CPU_BLOCK_CACHE_SIZE; i++) {
+        struct cpu_block *block = &block_cache->blocks[i];
+
+        block->heat = 0;
+        block->native = NULL;
+        block->native_ops = 0;
+    }
+
+    gameboy->jit.buffer_used = 0;
+}
+
+bool init_jit(struct emulator *gameboy) {
+    struct gameboy_jit *jit = &gameboy->jit;
+
+    jit->buffer = mmap(NULL, GB_JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buffer == MAP_FAILED) {
+        perror("JIT code buffer allocation failed ; using the interpreter");
+        jit->buffer = NULL;
+        jit->enabled = false;
+        return false;
+    }
+
+    jit->buffer_used = 0;
+    jit->compiled_blocks = 0;
+    jit->enabled = true;
+
+    return true;
+}
+
+void destroy_jit(struct emulator *gameboy) {
+    struct gameboy_jit *jit = &gameboy->jit;
+
+    if (jit->buffer != NULL) {
+        munmap(jit->buffer, GB_JIT_BUFFER_SIZE);
+    }
+
+    jit->buffer = NULL;
+    jit->enabled = false;
+}
+
+// translate the longest prefix of the block which only works on registers ; the interpreter runs the rest
+void compile_jit_block(struct emulator *gameboy, struct cpu_block *block) {
+    struct gameboy_jit *jit = &gameboy->jit;
+    struct jit_op_info infos[GB_CPU_BLOCK_MAX_OPS];
+    unsigned masks[GB_CPU_BLOCK_MAX_OPS];
+    unsigned count = 0;
+    unsigned length = 0;
+    unsigned cycles = 0;
+    unsigned live = JIT_FLAG_ALL; // every flag may be read after the translated instructions
+    struct jit_emitter emitter;
+
+    while (count < block->ops_count && get_jit_op_info(&block->ops[count], &infos[count])) {
+        length += infos[count].length;
+        cycles += infos[count].cycles;
+        count++;
+    }
+
+    if (count < 2) {
+        return; // calling native code for a single instruction is no faster than its handler
+    }
+
+    // walk backwards to find which flags are read before being overwritten
+    for (unsigned i = count; i-- > 0;) {
+        masks[i] = infos[i].writes & live;
+        live = (live & ~infos[i].writes) | infos[i].reads;
+    }
+
+    if (jit->buffer_used + count * JIT_MAX_OP_SIZE + 1 > GB_JIT_BUFFER_SIZE) {
+        flush_jit(gameboy);
+    }
+
+    emitter.code = jit->buffer + jit->buffer_used;
+    emitter.size = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        emit_jit_op(&emitter, &block->ops[i], masks[i]);
+    }
+
+    emit_jit_byte(&emitter, 0xC3); // RET
+
+    block->native = (void (*)(struct gameboy_cpu *))(void *)emitter.code;
+    block->native_ops = count;
+    block->native_length = length;
+    block->native_cycles = cycles;
+
+    jit->buffer_used += emitter.size;
+    jit->compiled_blocks++;
+}
+
+#else
+
+bool init_jit(struct emulator *gameboy) {
+    fprintf(stderr, "JIT is not supported on this architecture ; using the interpreter\n");
+    gameboy->jit.enabled = false;
+
+    return false;
+}
+
+void destroy_jit(struct emulator *gameboy) {
+    gameboy->jit.enabled = false;
+}
+
+void compile_jit_block(struct emulator *gameboy, struct cpu_block *block) {
+    // never called ; the JIT can't be enabled
+}
+
+#endif
@@ -0,0 +1,476 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "emulator.h"
+
+#define LINK_SPIN_YIELDS 1000 // a waiting side yields this many times before it starts sleeping between checks
+
+static double get_link_time(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+struct link_channel *create_link_channel(void) {
+    struct link_channel *channel = calloc(1, sizeof(*channel));
+
+    if (channel == NULL) {
+        perror("Link cable memory allocation failed!\n");
+        return NULL;
+    }
+
+    atomic_init(&channel->closed, false);
+    atomic_init(&channel->ends, 2);
+
+    for (unsigned i = 0; i < 2; i++) {
+        atomic_init(&channel->rings[i].head, 0);
+        atomic_init(&channel->rings[i].tail, 0);
+    }
+
+    return channel;
+}
+
+static void reset_link(struct gameboy_link *link) {
+    link->connected = true;
+    link->received_length = 0;
+    link->next_poll = 0;
+    link->listening = false;
+    link->peer_listening = false;
+    link->peer_timestamp = 0;
+    link->outstanding = 0;
+    link->has_transfer = false;
+}
+
+void connect_link_channel(struct emulator *gameboy, struct link_channel *channel, unsigned side) {
+    struct gameboy_link *link = &gameboy->link;
+
+    reset_link(link);
+    link->socket = -1;
+    link->channel = channel;
+    link->side = side;
+}
+
+static bool connect_link_address(struct sockaddr_un *address, const char *path) {
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Link socket path is too long: %s\n", path);
+        return false;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+
+    return true;
+}
+
+// blocks until the other side connects
+bool listen_link_socket(struct emulator *gameboy, const char *path) {
+    struct gameboy_link *link = &gameboy->link;
+    struct sockaddr_un address;
+    int server;
+    int client;
+
+    if (!connect_link_address(&address, path)) {
+        return false;
+    }
+
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("Can't create link socket");
+        return false;
+    }
+
+    unlink(path); // left behind by a previous run
+
+    if (bind(server, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(server, 1) != 0) {
+        perror("Can't listen on link socket");
+        close(server);
+        return false;
+    }
+
+    printf("Waiting for the other side of the link cable on %s\n", path);
+
+    client = accept(server, NULL, NULL);
+    close(server);
+    unlink(path);
+
+    if (client < 0) {
+        perror("Can't accept link connection");
+        return false;
+    }
+
+    reset_link(link);
+    link->socket = client;
+    link->channel = NULL;
+
+    return true;
+}
+
+// the other side may be started a little later ; connecting is retried until it listens
+bool connect_link_socket(struct emulator *gameboy, const char *path) {
+    struct gameboy_link *link = &gameboy->link;
+    struct sockaddr_un address;
+    double deadline = get_link_time() + GB_LINK_TIMEOUT_SECONDS;
+    int client;
+
+    if (!connect_link_address(&address, path)) {
+        return false;
+    }
+
+    client = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client < 0) {
+        perror("Can't create link socket");
+        return false;
+    }
+
+    while (connect(client, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        struct timespec delay = { 0, 50000000 };
+
+        if ((errno != ENOENT && errno != ECONNREFUSED) || get_link_time() > deadline) {
+            perror("Can't connect link socket");
+            close(client);
+            return false;
+        }
+
+        nanosleep(&delay, NULL);
+    }
+
+    reset_link(link);
+    link->socket = client;
+    link->channel = NULL;
+
+    return true;
+}
+
+// the other side sees the cable unplugged and receives 0xFF from then on
+void disconnect_link(struct emulator *gameboy) {
+    struct gameboy_link *link = &gameboy->link;
+
+    if (!link->connected) {
+        return;
+    }
+
+    link->connected = false;
+
+    if (link->channel != NULL) {
+        atomic_store(&link->channel->closed, true);
+
+        if (atomic_fetch_sub(&link->channel->ends, 1) == 1) {
+            free(link->channel);
+        }
+
+        link->channel = NULL;
+    } else {
+        close(link->socket);
+        link->socket = -1;
+    }
+}
+
+static bool push_link_ring(struct link_ring *ring, const struct link_message *message) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == GB_LINK_RING_LENGTH) {
+        return false;
+    }
+
+    ring->messages[tail % GB_LINK_RING_LENGTH] = *message;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+static bool pop_link_ring(struct link_ring *ring, struct link_message *message) {
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+        return false;
+    }
+
+    *message = ring->messages[head % GB_LINK_RING_LENGTH];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+// a full ring only waits for room if the message can't be dropped ; times are superseded by the next one anyway
+// the cable is unplugged if the other side doesn't make room in time, like when it stops answering
+static void send_link_message(struct emulator *gameboy, uint8_t type, uint8_t value, uint64_t stamp) {
+    struct gameboy_link *link = &gameboy->link;
+    struct link_message message = { type, value, stamp };
+
+    if (!link->connected) {
+        return;
+    }
+
+    if (link->channel != NULL) {
+        struct link_ring *ring = &link->channel->rings[link->side ^ 1];
+        double deadline = 0;
+        unsigned yields = 0;
+
+        while (!push_link_ring(ring, &message)) {
+            if (type == GB_LINK_TIME || atomic_load(&link->channel->closed)) {
+                return;
+            }
+
+            if (yields < LINK_SPIN_YIELDS) {
+                sched_yield();
+                yields++;
+            } else if (deadline == 0) {
+                deadline = get_link_time() + GB_LINK_TIMEOUT_SECONDS; // only read the clock once the other side is slow
+            } else if (get_link_time() > deadline) {
+                fprintf(stderr, "Link cable unplugged ; the other side stopped reading\n");
+                disconnect_link(gameboy);
+                return;
+            } else {
+                struct timespec delay = { 0, 50000 };
+
+                nanosleep(&delay, NULL);
+            }
+        }
+    } else {
+        uint8_t bytes[GB_LINK_MESSAGE_LENGTH] = { type, value };
+
+        for (unsigned i = 0; i < 8; i++) {
+            bytes[2 + i] = stamp >> (56 - 8 * i);
+        }
+
+        if (send(link->socket, bytes, sizeof(bytes), MSG_NOSIGNAL) != sizeof(bytes)) {
+            fprintf(stderr, "Link cable unplugged\n");
+            disconnect_link(gameboy);
+        }
+    }
+}
+
+// never blocks ; false if there is no message yet
+static bool receive_link_message(struct emulator *gameboy, struct link_message *message) {
+    struct gameboy_link *link = &gameboy->link;
+    ssize_t length;
+
+    if (link->channel != NULL) {
+        struct link_ring *ring = &link->channel->rings[link->side];
+
+        if (pop_link_ring(ring, message)) {
+            return true;
+        }
+
+        // messages sent before the other side was disconnected are still delivered
+        if (atomic_load(&link->channel->closed)) {
+            if (pop_link_ring(ring, message)) {
+                return true;
+            }
+
+            disconnect_link(gameboy);
+        }
+
+        return false;
+    }
+
+    length = recv(link->socket, link->received + link->received_length, GB_LINK_MESSAGE_LENGTH - link->received_length, MSG_DONTWAIT);
+
+    if (length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        fprintf(stderr, "Link cable unplugged\n");
+        disconnect_link(gameboy);
+        return false;
+    }
+
+    if (length < 0) {
+        return false;
+    }
+
+    link->received_length += length;
+
+    if (link->received_length < GB_LINK_MESSAGE_LENGTH) {
+        return false;
+    }
+
+    link->received_length = 0;
+    message->type = link->received[0];
+    message->value = link->received[1];
+    message->stamp = 0;
+
+    for (unsigned i = 0; i < 8; i++) {
+        message->stamp = message->stamp << 8 | link->received[2 + i];
+    }
+
+    return true;
+}
+
+static void handle_link_message(struct emulator *gameboy, const struct link_message *message) {
+    struct gameboy_link *link = &gameboy->link;
+
+    switch (message->type) {
+        case GB_LINK_TRANSFER:
+            link->has_transfer = true;
+            link->transfer_stamp = message->stamp;
+            link->transfer_value = message->value;
+            break;
+        case GB_LINK_REPLY:
+            if (link->outstanding > 0) {
+                link->outstanding--;
+                link->reply = message->value;
+            }
+
+            link->peer_listening = false; // the transfer of the other side completed with this one
+            break;
+        case GB_LINK_LISTEN:
+            link->peer_listening = message->value;
+            link->peer_timestamp = message->stamp;
+
+            if (link->peer_listening) {
+                send_link_message(gameboy, GB_LINK_TIME, 0, gameboy->timestamp); // it may already be waiting for this side
+            }
+            break;
+        case GB_LINK_TIME:
+            link->peer_timestamp = message->stamp;
+            break;
+        default:
+            fprintf(stderr, "Unknown link cable message %u\n", message->type);
+            disconnect_link(gameboy);
+            break;
+    }
+}
+
+// handles the next message of the other side, waiting for it if needed ; false once the cable is unplugged
+static bool wait_link_message(struct emulator *gameboy) {
+    struct gameboy_link *link = &gameboy->link;
+    struct link_message message;
+    double deadline = get_link_time() + GB_LINK_TIMEOUT_SECONDS;
+    unsigned yields = 0;
+
+    while (link->connected) {
+        if (receive_link_message(gameboy, &message)) {
+            handle_link_message(gameboy, &message);
+            return link->connected;
+        }
+
+        if (!link->connected) {
+            break;
+        }
+
+        if (get_link_time() > deadline) {
+            fprintf(stderr, "Link cable unplugged ; the other side stopped answering\n");
+            disconnect_link(gameboy);
+            break;
+        }
+
+        if (link->channel == NULL) {
+            struct pollfd descriptor = { link->socket, POLLIN, 0 };
+
+            poll(&descriptor, 1, 100);
+        } else if (yields < LINK_SPIN_YIELDS) {
+            sched_yield(); // the other side most likely runs on another thread of this process
+            yields++;
+        } else {
+            struct timespec delay = { 0, 50000 };
+
+            nanosleep(&delay, NULL);
+        }
+    }
+
+    return false;
+}
+
+// the other side clocked a transfer ; the byte received is sent back to it
+static void complete_link_transfer(struct emulator *gameboy) {
+    struct gameboy_link *link = &gameboy->link;
+    uint8_t value = clock_serial_transfer(gameboy, link->transfer_value);
+
+    link->has_transfer = false;
+    link->listening = false; // the other side learns it from the reply
+
+    send_link_message(gameboy, GB_LINK_REPLY, value, gameboy->timestamp);
+}
+
+void start_link_transfer(struct emulator *gameboy, uint8_t value, uint64_t stamp) {
+    struct gameboy_link *link = &gameboy->link;
+
+    if (!link->connected) {
+        return;
+    }
+
+    link->outstanding++;
+    send_link_message(gameboy, GB_LINK_TRANSFER, value, stamp);
+}
+
+// the other side had the whole transfer to answer ; only waits if it's further behind than that
+uint8_t finish_link_transfer(struct emulator *gameboy) {
+    struct gameboy_link *link = &gameboy->link;
+
+    while (link->connected && link->outstanding > 0) {
+        if (!wait_link_message(gameboy)) {
+            break;
+        }
+
+        // both sides started a transfer on their internal clock ; neither is listening, the other side gets 0xFF right away
+        if (link->has_transfer) {
+            complete_link_transfer(gameboy);
+        }
+    }
+
+    return link->connected ? link->reply : 0xFF;
+}
+
+void update_link_listening(struct emulator *gameboy, bool listening) {
+    struct gameboy_link *link = &gameboy->link;
+
+    if (!link->connected || link->listening == listening) {
+        return;
+    }
+
+    link->listening = listening;
+    send_link_message(gameboy, GB_LINK_LISTEN, listening, gameboy->timestamp);
+}
+
+int32_t poll_link(struct emulator *gameboy) {
+    struct gameboy_link *link = &gameboy->link;
+    struct link_message message;
+
+    if (gameboy->timestamp >= link->next_poll) {
+        link->next_poll = gameboy->timestamp + GB_LINK_POLL_CYCLES;
+
+        while (receive_link_message(gameboy, &message)) {
+            handle_link_message(gameboy, &message);
+        }
+
+        if (link->peer_listening) {
+            send_link_message(gameboy, GB_LINK_TIME, 0, gameboy->timestamp);
+        }
+
+        // a transfer clocked by the other side must land on its date ; a listening side doesn't run far past the other side meanwhile
+        if (link->listening && !link->has_transfer && gameboy->timestamp > link->peer_timestamp + GB_LINK_LOOKAHEAD_CYCLES) {
+            while (!link->has_transfer && gameboy->timestamp > link->peer_timestamp + GB_LINK_LOOKAHEAD_CYCLES) {
+                if (!wait_link_message(gameboy)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!link->connected) {
+        return GB_SYNC_NEVER;
+    }
+
+    if (link->has_transfer) {
+        if (gameboy->timestamp >= link->transfer_stamp) {
+            complete_link_transfer(gameboy); // late by less than a poll if this side was ahead
+        } else if (link->transfer_stamp < link->next_poll) {
+            return (int32_t)(link->transfer_stamp - gameboy->timestamp);
+        }
+    }
+
+    return (int32_t)(link->next_poll - gameboy->timestamp);
+}
@@ -6,66 +6,338 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <math.h>
 
 #include "emulator.h"
 #include "sdl.h"
+#include "headless.h"
 
 // TODO fix dmg-acid2.gb's output ; window internal line counter is incorrect
 // TODO fix cgb-acid2.gbc'2 output ; master priority (bit 0) is incorrect
 
+static double get_wall_time(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#define FRAME_SKIP_TARGET_FPS 60 // frames handed to the UI each second of wall time when the frame skip is tuned
+#define FRAME_SKIP_PERIOD 0.25 // seconds of wall time between two adjustments of the frame skip
+
+// skip enough frames to hand about FRAME_SKIP_TARGET_FPS to the UI ; none below real time, most of them when running flat out
+static void tune_frame_skip(struct emulator *gameboy, double *tune_time, uint64_t *tune_frames) {
+    double now = get_wall_time();
+    double frame_rate;
+
+    if (now - *tune_time < FRAME_SKIP_PERIOD) {
+        return;
+    }
+
+    frame_rate = (gameboy->ppu.frames - *tune_frames) / (now - *tune_time);
+    gameboy->ppu.frame_skip = (frame_rate > FRAME_SKIP_TARGET_FPS) ? (unsigned)lround(frame_rate / FRAME_SKIP_TARGET_FPS) - 1 : 0;
+
+    *tune_time = now;
+    *tune_frames = gameboy->ppu.frames;
+}
+
+// sleep until the wall clock catches up with the emulated time ; pace_time is moved forward instead if the emulation fell too far behind
+static void pace_wall_time(double *pace_time, uint64_t cycles, double speed) {
+    double delay;
+    struct timespec duration;
+
+    if (speed == GB_SPEED_UNBOUNDED) {
+        *pace_time = get_wall_time(); // picks up from now once the speed is bounded again
+        return;
+    }
+
+    *pace_time += cycles / (CPU_FREQUENCY_HZ * speed);
+    delay = *pace_time - get_wall_time();
+
+    if (delay < -0.1) {
+        *pace_time -= delay; // don't run flat out to catch up after a stall
+        return;
+    }
+
+    if (delay <= 0) {
+        return;
+    }
+
+    duration.tv_sec = (time_t)delay;
+    duration.tv_nsec = (long)((delay - duration.tv_sec) * 1e9);
+
+    nanosleep(&duration, NULL);
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <ROM_FILE>\n", program);
+    fprintf(stderr, "  --headless     run without a window or audio device, as fast as possible\n");
+    fprintf(stderr, "  --frames N     stop after N frames\n");
+    fprintf(stderr, "  --cycles N     stop after N CPU cycles\n");
+    fprintf(stderr, "  --seconds N    stop after N seconds of wall time\n");
+    fprintf(stderr, "  --speed N      run at N times real time, from %g to %g ; 0 runs as fast as possible (default 1, or 0 when headless)\n", GB_SPEED_MIN, GB_SPEED_MAX);
+    fprintf(stderr, "  --turbo-speed N  speed while turbo is on ; Tab toggles it (default 0)\n");
+    fprintf(stderr, "  --frame-skip N draw one frame out of N + 1 ; 'auto' tunes N to show about %u frames per second (default auto, or 0 when headless)\n",
+            FRAME_SKIP_TARGET_FPS);
+    fprintf(stderr, "  --jit          translate hot code to native code (x86-64 only)\n");
+    fprintf(stderr, "  --scale2x      smooth diagonal edges with the Scale2x filter\n");
+    fprintf(stderr, "  --rewind       keep a few minutes of history ; hold Backspace to go back in time\n");
+    fprintf(stderr, "  --serial       print what the game sends over the link port ; stop at \"Passed\" or \"Failed\" and exit with that verdict\n");
+    fprintf(stderr, "  --link-listen PATH   plug a link cable into a Unix domain socket at PATH and wait for the other side\n");
+    fprintf(stderr, "  --link-connect PATH  plug a link cable into the other side listening at PATH\n");
+    fprintf(stderr, "  --point-audio  sample the sounds every 64 cycles instead of synthesizing band-limited steps ; headless runs produce no audio\n");
+}
+
 int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        { "headless", no_argument, NULL, 'H' },
+        { "frames", required_argument, NULL, 'f' },
+        { "cycles", required_argument, NULL, 'c' },
+        { "seconds", required_argument, NULL, 's' },
+        { "speed", required_argument, NULL, 'v' },
+        { "turbo-speed", required_argument, NULL, 't' },
+        { "frame-skip", required_argument, NULL, 'k' },
+        { "jit", no_argument, NULL, 'j' },
+        { "scale2x", no_argument, NULL, 'x' },
+        { "rewind", no_argument, NULL, 'r' },
+        { "serial", no_argument, NULL, 'S' },
+        { "link-listen", required_argument, NULL, 'l' },
+        { "link-connect", required_argument, NULL, 'L' },
+        { "point-audio", no_argument, NULL, 'p' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
     struct emulator *gameboy;
     const char *rom_file;
+    bool headless = false;
+    bool jit = false;
+    bool rewind = false;
+    bool serial = false;
+    const char *link_listen = NULL;
+    const char *link_connect = NULL;
+    static struct serial_capture capture; // a few KiB ; kept off the stack
+    int status = 0;
+    enum sdl_filter filter = GB_SDL_FILTER_NONE;
+    enum spu_synthesis synthesis = GB_SPU_SYNTHESIS_BLEP;
+    uint64_t max_frames = 0; // 0 means no limit
+    uint64_t max_cycles = 0; // 0 means no limit
+    double max_seconds = 0; // 0 means no limit
+    double speed = -1; // negative until set ; the default depends on the UI
+    double turbo_speed = GB_SPEED_UNBOUNDED;
+    int frame_skip = -2; // -1 tunes the frame skip ; -2 until set, the default depends on the UI
+    double tune_time;
+    uint64_t tune_frames = 0;
+    uint64_t cycles = 0;
+    uint64_t slice_cycles;
+    uint64_t ran;
+    double start_time;
+    double pace_time;
+    double elapsed_time;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (option) {
+            case 'H':
+                headless = true;
+                break;
+            case 'f':
+                max_frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'c':
+                max_cycles = strtoull(optarg, NULL, 0);
+                break;
+            case 's':
+                max_seconds = strtod(optarg, NULL);
+                break;
+            case 'v':
+                speed = strtod(optarg, NULL);
+                break;
+            case 't':
+                turbo_speed = strtod(optarg, NULL);
+                break;
+            case 'k':
+                frame_skip = (strcmp(optarg, "auto") == 0) ? -1 : atoi(optarg);
+                break;
+            case 'j':
+                jit = true;
+                break;
+            case 'x':
+                filter = GB_SDL_FILTER_SCALE2X;
+                break;
+            case 'r':
+                rewind = true;
+                break;
+            case 'S':
+                serial = true;
+                break;
+            case 'l':
+                link_listen = optarg;
+                break;
+            case 'L':
+                link_connect = optarg;
+                break;
+            case 'p':
+                synthesis = GB_SPU_SYNTHESIS_POINT;
+                break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
 
-    if (argc < 2) {
+    if (optind >= argc) {
         fprintf(stderr, "Not enough command line arguments provided!\n");
+        print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    gameboy = calloc(1, sizeof(*gameboy)); // context contains semaphores ; allocate to the heap so it is visible on all threads
+    gameboy = calloc(1, sizeof(*gameboy)); // context contains the sample ring ; allocate to the heap so it is visible on all threads
     if (gameboy == NULL) {
         perror("GameBoy memory allocation failed!\n");
         return EXIT_FAILURE;
     }
 
-    // initialize semaphores before we start the UI
-    for (unsigned i = 0; i < GB_SPU_SAMPLE_BUFFER_COUNT; i++) {
-        struct spu_sample_buffer *buffer = &gameboy->spu.buffers[i];
+    if (headless) {
+        init_headless_ui(gameboy);
+    } else {
+        init_sdl_ui(gameboy, filter);
+    }
 
-        memset(buffer->samples, 0, sizeof(buffer->samples));
+    rom_file = argv[optind];
 
-        sem_init(&buffer->free, 0, 0);
-        sem_init(&buffer->ready, 0, 1);
+    if (!load_cart(gameboy, rom_file)) {
+        gameboy->ui.destroy(gameboy);
+        free(gameboy);
+        return EXIT_FAILURE;
     }
 
-    init_sdl_ui(gameboy);
+    reset_emulator(gameboy);
 
-    rom_file = argv[1];
+    if (!headless) {
+        gameboy->spu.synthesis = synthesis; // the headless UI keeps the SPU registers only
+    }
 
-    load_cart(gameboy, rom_file);
-    reset_sync(gameboy);
-    reset_interrupt_request(gameboy);
-    reset_cpu(gameboy);
-    reset_ppu(gameboy);
-    reset_gamepad(gameboy);
-    reset_dma(gameboy);
-    reset_timer(gameboy);
-    reset_spu(gameboy);
+    if (speed < 0) {
+        speed = headless ? GB_SPEED_UNBOUNDED : 1;
+    }
 
-    gameboy->internal_ram_high_bank = 1;
-    gameboy->video_ram_high_bank = false;
-    gameboy->quit = false;
+    gameboy->speed.turbo_speed = turbo_speed;
+    set_emulator_speed(gameboy, speed);
+
+    if (frame_skip == -2) {
+        frame_skip = headless ? 0 : -1;
+    }
+
+    gameboy->ppu.frame_skip = (frame_skip > 0) ? frame_skip : 0;
+
+    if (jit) {
+        init_jit(gameboy); // falls back to the interpreter if the JIT isn't available
+    }
+
+    if (rewind) {
+        init_rewind(gameboy); // runs without history if it can't be allocated
+    }
+
+    if ((link_listen != NULL && !listen_link_socket(gameboy, link_listen)) || (link_connect != NULL && !connect_link_socket(gameboy, link_connect))) {
+        gameboy->ui.destroy(gameboy);
+        destroy_jit(gameboy);
+        destroy_rewind(gameboy);
+        unload_cart(gameboy);
+        free(gameboy);
+        return EXIT_FAILURE;
+    }
+
+    if (serial) {
+        capture.echo = true;
+        capture.stop = true;
+        set_serial_sink(gameboy, capture_serial, &capture);
+    }
+
+    start_time = get_wall_time();
+    pace_time = start_time;
+    tune_time = start_time;
 
     while (!gameboy->quit) {
         gameboy->ui.refresh_gamepad(gameboy);
 
-        run_cpu_cycles(gameboy, CPU_FREQUENCY_HZ / 120); // refresh at 120Hz to maintain performance
+        // the window and the gamepad are refreshed at 120Hz of wall time to maintain performance ; headless runs about a frame per call
+        if (headless) {
+            slice_cycles = CPU_FREQUENCY_HZ / 60;
+        } else if (get_emulator_speed(gameboy) == GB_SPEED_UNBOUNDED) {
+            slice_cycles = CPU_FREQUENCY_HZ / 30;
+        } else {
+            slice_cycles = CPU_FREQUENCY_HZ / 120 * get_emulator_speed(gameboy);
+        }
+
+        // each step back shows a whole frame from the restored snapshot ; nothing is captured meanwhile
+        if (gameboy->rewind.rewinding && step_rewind(gameboy)) {
+            ran = run_cpu_cycles(gameboy, CPU_FREQUENCY_HZ / 60);
+        } else {
+            ran = run_cpu_cycles(gameboy, slice_cycles);
+            capture_rewind(gameboy);
+        }
+
+        cycles += ran;
+
+        // the audio follows through the resampler's rate control ; its pitch follows the speed
+        pace_wall_time(&pace_time, ran, get_emulator_speed(gameboy));
+
+        if (frame_skip < 0) {
+            tune_frame_skip(gameboy, &tune_time, &tune_frames);
+        }
+
+        if (max_frames != 0 && gameboy->ppu.frames >= max_frames) {
+            gameboy->quit = true;
+        }
+
+        if (max_cycles != 0 && cycles >= max_cycles) {
+            gameboy->quit = true;
+        }
+
+        if (max_seconds != 0 && get_wall_time() - start_time >= max_seconds) {
+            gameboy->quit = true;
+        }
+    }
+
+    elapsed_time = get_wall_time() - start_time;
+
+    if (serial) {
+        if (capture.length != 0 && capture.text[capture.length - 1] != '\n') {
+            putchar('\n');
+        }
+
+        if (capture.verdict != GB_SERIAL_VERDICT_PASSED) {
+            status = EXIT_FAILURE; // a test which never reported counts as failed
+        }
+    }
+
+    if (headless) {
+        printf("Ran %llu frames (%llu cycles) in %.3fs ; %.2fMHz\n", (unsigned long long)gameboy->ppu.frames, (unsigned long long)cycles, elapsed_time,
+                cycles / elapsed_time / 1e6);
+
+        if (gameboy->ppu.skipped_frames != 0) {
+            printf("Skipped %llu frames\n", (unsigned long long)gameboy->ppu.skipped_frames);
+        }
+    }
+
+    if (headless && gameboy->rewind.enabled && gameboy->rewind.captures != 0) {
+        printf("Rewind: %llu snapshots, %u kept in %.1fMiB ; %.1fus per capture, %.1fus at most, %llu over budget\n",
+                (unsigned long long)gameboy->rewind.captures, gameboy->rewind.deltas + 1, gameboy->rewind.ring_used / 1048576.0,
+                gameboy->rewind.capture_ns / 1e3 / gameboy->rewind.captures, gameboy->rewind.max_capture_ns / 1e3,
+                (unsigned long long)gameboy->rewind.over_budget);
     }
 
     gameboy->ui.destroy(gameboy);
+    disconnect_link(gameboy);
+    destroy_jit(gameboy);
+    destroy_rewind(gameboy);
     unload_cart(gameboy);
 
     free(gameboy);
 
-    return 0;
+    return status;
 }
@@ -4,8 +4,14 @@
  * February 8, 2023
  */
 
+#include <string.h>
+
 #include "emulator.h"
 
+#if !defined(GB_PPU_REFERENCE_RENDERER) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* ppu timings:
  * - one line:
  *      | Mode 2: 80 cycles | Mode 3: 172 cycles | Mode 0: 204 cycles |
@@ -60,10 +66,21 @@ void reset_ppu(struct emulator *gameboy) {
     ppu->window_x = 0;
     ppu->window_y = 0;
     ppu->line_position = 0;
+    ppu->frames = 0;
+    ppu->skip_counter = 0;
+    ppu->skipped_frames = 0;
 
     for (unsigned i = 0; i < sizeof(ppu->oam); i++) {
         ppu->oam[i] = 0;
     }
+
+    for (unsigned i = 0; i < GB_PPU_TILE_BANKS * GB_PPU_TILES; i++) {
+        ppu->tile_dirty[i] = true;
+    }
+
+    if (ppu->framebuffer.count == 0) {
+        set_ppu_framebuffer(gameboy, GB_PIXEL_XRGB8888, 2); // the UI didn't pick a framebuffer
+    }
 }
 
 static uint8_t get_ppu_mode(struct emulator *gameboy) {
@@ -84,39 +101,62 @@ static uint8_t get_ppu_mode(struct emulator *gameboy) {
     return 0; // Mode 0 : horizontal blanking 
 }
 
-struct ppu_pixel {
-    union lcd_colour colour;
-    bool opaque;
-    bool priority; // GBC only: true if the background pixel has priority
-} ppu_pixel;
-
-// get a pixel value from the tileset
-static enum dmg_colour get_ppu_tile_colour(struct emulator *gameboy, uint8_t tile_index, uint8_t x, uint8_t y, bool use_sprite_tile_set, bool use_high_bank) {
-    unsigned tile_address;
+// decode the 8 rows of a tile into one colour index per pixel
+static void decode_ppu_tile(struct emulator *gameboy, unsigned tile) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
 
     // each tile is 8x8 pixels and stores 2bits per pixels for a total of 16bytes per tile
-    const unsigned tile_size = 16;
-    unsigned lsb;
-    unsigned msb;
+    const uint8_t *data = gameboy->video_ram + (tile / GB_PPU_TILES) * 0x2000 + (tile % GB_PPU_TILES) * 16;
+
+    for (unsigned y = 0; y < 8; y++) {
+        // the pixel value is two bits split across two contiguous bytes
+        unsigned lsb = data[y * 2 + 0];
+        unsigned msb = data[y * 2 + 1];
+
+        for (unsigned x = 0; x < 8; x++) {
+            unsigned shift = 7 - x; // pixel data is stored backwards in VRAM: the leftmost pixel (x = 0) is stored in the MSB (byte >> 7)
+
+            ppu->tile_cache[tile][y][x] = (((msb >> shift) & 1) << 1) | ((lsb >> shift) & 1);
+        }
+    }
+
+    ppu->tile_dirty[tile] = false;
+}
+
+// get the 8 colour indices of a tile row from the tileset ; y goes up to 15 for 8x16 sprites which continue in the next tile
+static const uint8_t *get_ppu_tile_row(struct emulator *gameboy, uint8_t tile_index, unsigned y, bool use_sprite_tile_set, bool use_high_bank) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+    unsigned tile;
 
     if (use_sprite_tile_set) {
-        tile_address = tile_index * tile_size; // sprite tile set starts at the beginning of VRAM
+        tile = tile_index; // sprite tile set starts at the beginning of VRAM
     } else {
-        tile_address = 0x1000 + (int8_t)tile_index * tile_size; // other tile set
+        tile = 0x100 + (int8_t)tile_index; // other tile set
     }
 
+    tile += y / 8;
+
     // GBC-only: use the high bank if requested
     if (use_high_bank) {
-        tile_address += 0x2000;
+        tile += GB_PPU_TILES;
     }
 
-    x = 7 - x; // pixel data is stored backwards in VRAM: the leftmost pixel (x = 0) is stored in the MSB (byte >> 7)
+    if (ppu->tile_dirty[tile]) {
+        decode_ppu_tile(gameboy, tile);
+    }
+
+    return ppu->tile_cache[tile][y % 8];
+}
 
-    // the pixel value is two bits split across two contiguous bytes
-    lsb = (gameboy->video_ram[tile_address + y * 2 + 0] >> x) & 1;
-    msb = (gameboy->video_ram[tile_address + y * 2 + 1] >> x) & 1;
+// called on every write to VRAM ; offset includes the bank
+void invalidate_ppu_tile(struct emulator *gameboy, uint16_t offset) {
+    unsigned bank_offset = offset % 0x2000;
 
-    return (msb << 1) | lsb;
+    if (bank_offset >= GB_PPU_TILES * 16) {
+        return; // tile maps aren't cached
+    }
+
+    gameboy->ppu.tile_dirty[(offset / 0x2000) * GB_PPU_TILES + bank_offset / 16] = true;
 }
 
 static enum dmg_colour ppu_palette_transform(enum dmg_colour colour, uint8_t palette) {
@@ -125,79 +165,28 @@ static enum dmg_colour ppu_palette_transform(enum dmg_colour colour, uint8_t pal
     return (palette >> offset) & 3;
 }
 
-static struct ppu_pixel get_ppu_background_window_pixel(struct emulator *gameboy, uint8_t x, uint8_t y, bool use_high_tile_map) {
-    struct gameboy_ppu *ppu = &gameboy->ppu;
-
-    // coordinates of the tile in the tile map (each tile is 8x8 pixels)
-    unsigned tile_map_x = x / 8;
-    unsigned tile_map_y = y / 8;
+#define GB_PALETTE_INDICES(palette) { (palette) * 4, (palette) * 4 + 1, (palette) * 4 + 2, (palette) * 4 + 3 }
 
-    // coordinates of the pixel within the tile
-    unsigned tile_x = x % 8;
-    unsigned tile_y = y % 8;
+// colours of a GBC palette as they are drawn ; the palette entries themselves if the framebuffer stores indices
+static const uint16_t *get_ppu_gbc_colours(struct emulator *gameboy, bool sprite, unsigned palette) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
 
-    unsigned tile_map_address; // offset of the tile map entry in the VRAM
-    uint8_t tile_index; // index of the tile entry in the tile set
-    struct ppu_pixel pixel;
-    bool use_sprite_tile_set = ppu->background_window_use_sprite_tile_set;
+    static const uint16_t palette_indices[16][4] = {
+        GB_PALETTE_INDICES(0), GB_PALETTE_INDICES(1), GB_PALETTE_INDICES(2), GB_PALETTE_INDICES(3),
+        GB_PALETTE_INDICES(4), GB_PALETTE_INDICES(5), GB_PALETTE_INDICES(6), GB_PALETTE_INDICES(7),
+        GB_PALETTE_INDICES(8), GB_PALETTE_INDICES(9), GB_PALETTE_INDICES(10), GB_PALETTE_INDICES(11),
+        GB_PALETTE_INDICES(12), GB_PALETTE_INDICES(13), GB_PALETTE_INDICES(14), GB_PALETTE_INDICES(15)
+    };
 
-    // there are two independent tile maps the game can use
-    if (use_high_tile_map) {
-        tile_map_address = 0x1C00;
-    } else {
-        tile_map_address = 0x1800;
+    if (ppu->framebuffer.format == GB_PIXEL_INDEX) {
+        return palette_indices[sprite * 8 + palette];
     }
 
-    tile_map_address += tile_map_y * 32 + tile_map_x; // the tile map is a square map of 32 * 32 tiles ; for each tile it contains one byte which is an index in the tile set
-    tile_index = gameboy->video_ram[tile_map_address]; // lookup the tile map entry in VRAM
-
-    if (gameboy->gbc) {
-        // on the GBC we have additional attributes in the 2nd VRAM bank
-        uint8_t attrs = gameboy->video_ram[tile_map_address + 0x2000];
-        bool priority = attrs & 0x80;
-        bool y_flip = attrs & 0x40;
-        bool x_flip = attrs & 0x20;
-        bool high_bank = attrs & 0x08;
-        uint8_t palette = attrs & 0x07;
-        enum dmg_colour colour;
-
-        pixel.priority = priority;
-
-        if (x_flip) {
-            tile_x = 7 - tile_x;
-        }
-
-        if (y_flip) {
-            tile_y = 7 - tile_y;
-        }
-
-        colour = get_ppu_tile_colour(gameboy, tile_index, tile_x, tile_y, use_sprite_tile_set, high_bank);
-        pixel.opaque = colour != WHITE;
-        pixel.colour.dmg = ppu->background_palettes.colours[palette][colour];
+    if (sprite) {
+        return ppu->sprite_palettes.colours[palette];
     } else {
-        pixel.priority = false;
-        pixel.colour.dmg = get_ppu_tile_colour(gameboy, tile_index, tile_x, tile_y, use_sprite_tile_set, false);
-        pixel.opaque = pixel.colour.dmg != WHITE;
-        pixel.colour.dmg = ppu_palette_transform(pixel.colour.dmg, ppu->background_palette);
+        return ppu->background_palettes.colours[palette];
     }
-
-    return pixel;
-}
-
-static struct ppu_pixel get_ppu_background_pixel(struct emulator *gameboy, unsigned x, unsigned y) {
-    struct gameboy_ppu *ppu = &gameboy->ppu;
-    uint8_t background_x = (x + ppu->scroll_x) & 0xFF;
-    uint8_t background_y = (y + ppu->scroll_y) & 0xFF;
-
-    return get_ppu_background_window_pixel(gameboy, background_x, background_y, ppu->background_use_high_tile_map);
-}
-
-static struct ppu_pixel get_ppu_window_pixel(struct emulator *gameboy, unsigned x, unsigned y) {
-    struct gameboy_ppu *ppu = &gameboy->ppu;
-    uint8_t window_x = x + 7 - ppu->window_x;
-    uint8_t window_y = y - ppu->window_y;
-
-    return get_ppu_background_window_pixel(gameboy, window_x, window_y, ppu->window_use_high_tile_map);
 }
 
 struct sprite {
@@ -211,7 +200,7 @@ struct sprite {
     bool use_sprite_palette1; // GB-only: true if sprite uses palette sprite_palette1, otherwise use sprite_palette0
     bool high_bank; // GBC-only: true, if the tile is in the high bank
     uint8_t palette; // GBC-only: select which palette to use
-} sprite;
+};
 
 static struct sprite get_oam_sprite(struct emulator *gameboy, unsigned index) {
     struct gameboy_ppu *ppu = &gameboy->ppu;
@@ -298,6 +287,80 @@ static void get_ppu_line_sprites(struct emulator *gameboy, unsigned ly, struct s
     }
 }
 
+// build with -DGB_PPU_REFERENCE_RENDERER to resolve each pixel on its own ; slow but simple, both renderers must produce the same lines
+#ifdef GB_PPU_REFERENCE_RENDERER
+struct ppu_pixel {
+    union lcd_colour colour;
+    bool opaque;
+    bool priority; // GBC only: true if the background pixel has priority
+};
+
+// fetch the background or window pixels of the screen columns [x, end) one tile row at a time ; map_x and map_y are the tile map coordinates of the pixel at x
+static void get_ppu_background_window_span(struct emulator *gameboy, struct ppu_pixel *pixels, unsigned x, unsigned end, uint8_t map_x, uint8_t map_y, bool use_high_tile_map) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+    unsigned tile_map_address; // offset of the tile map row in the VRAM
+    bool use_sprite_tile_set = ppu->background_window_use_sprite_tile_set;
+
+    // there are two independent tile maps the game can use
+    if (use_high_tile_map) {
+        tile_map_address = 0x1C00;
+    } else {
+        tile_map_address = 0x1800;
+    }
+
+    tile_map_address += (map_y / 8) * 32; // the tile map is a square map of 32 * 32 tiles ; for each tile it contains one byte which is an index in the tile set
+
+    while (x < end) {
+        // coordinates of the pixel within the tile
+        unsigned tile_x = map_x % 8;
+        unsigned tile_y = map_y % 8;
+        unsigned count = 8 - tile_x; // pixels left in this tile
+        uint8_t tile_index = gameboy->video_ram[tile_map_address + map_x / 8]; // lookup the tile map entry in VRAM
+        const uint8_t *row;
+
+        if (count > end - x) {
+            count = end - x;
+        }
+
+        if (gameboy->gbc) {
+            // on the GBC we have additional attributes in the 2nd VRAM bank
+            uint8_t attrs = gameboy->video_ram[tile_map_address + map_x / 8 + 0x2000];
+            bool priority = attrs & 0x80;
+            bool y_flip = attrs & 0x40;
+            bool x_flip = attrs & 0x20;
+            bool high_bank = attrs & 0x08;
+            const uint16_t *colours = get_ppu_gbc_colours(gameboy, false, attrs & 0x07);
+
+            if (y_flip) {
+                tile_y = 7 - tile_y;
+            }
+
+            row = get_ppu_tile_row(gameboy, tile_index, tile_y, use_sprite_tile_set, high_bank);
+
+            for (unsigned i = 0; i < count; i++) {
+                enum dmg_colour colour = row[x_flip ? 7 - (tile_x + i) : tile_x + i];
+
+                pixels[x + i].colour.gbc = colours[colour];
+                pixels[x + i].opaque = colour != WHITE;
+                pixels[x + i].priority = priority;
+            }
+        } else {
+            row = get_ppu_tile_row(gameboy, tile_index, tile_y, use_sprite_tile_set, false);
+
+            for (unsigned i = 0; i < count; i++) {
+                enum dmg_colour colour = row[tile_x + i];
+
+                pixels[x + i].colour.dmg = ppu_palette_transform(colour, ppu->background_palette);
+                pixels[x + i].opaque = colour != WHITE;
+                pixels[x + i].priority = false;
+            }
+        }
+
+        x += count;
+        map_x += count; // wraps around the 32 tiles of the map
+    }
+}
+
 static bool get_ppu_sprite_colour(struct emulator *gameboy, const struct sprite *sprite, unsigned x, unsigned y, struct ppu_pixel *p) {
     struct gameboy_ppu *ppu = &gameboy->ppu;
     unsigned sprite_x;
@@ -330,7 +393,7 @@ static bool get_ppu_sprite_colour(struct emulator *gameboy, const struct sprite
         sprite_y = sprite_flip_height - sprite_y;
     }
 
-    colour = get_ppu_tile_colour(gameboy, tile_index, sprite_x, sprite_y, true, sprite->high_bank);
+    colour = get_ppu_tile_row(gameboy, tile_index, sprite_y, true, sprite->high_bank)[sprite_x];
 
     // white pixel colour denotes a transparent pixel
     if (colour == WHITE) {
@@ -338,7 +401,7 @@ static bool get_ppu_sprite_colour(struct emulator *gameboy, const struct sprite
     }
 
     if (gameboy->gbc) {
-        p->colour.gbc = ppu->sprite_palettes.colours[sprite->palette][colour];
+        p->colour.gbc = get_ppu_gbc_colours(gameboy, true, sprite->palette)[colour];
     } else {
         uint8_t palette;
 
@@ -354,36 +417,42 @@ static bool get_ppu_sprite_colour(struct emulator *gameboy, const struct sprite
     return true;
 }
 
-// returns true if the given screen coordinates lie within the window
-static bool get_ppu_pixel_in_window(struct emulator *gameboy, unsigned x, unsigned y) {
-    struct gameboy_ppu *ppu = &gameboy->ppu;
-    int window_x = (int)ppu->window_x - 7;
-
-    return (int)x >= window_x && y >= ppu->window_y;
-}
-
-static void ppu_draw_current_line(struct emulator *gameboy) {
+// reference renderer ; resolves every pixel on its own
+static void render_ppu_line(struct emulator *gameboy, uint16_t line[GB_LCD_WIDTH]) {
     struct gameboy_ppu *ppu = &gameboy->ppu;
-    union lcd_colour line[GB_LCD_WIDTH];
+    struct ppu_pixel pixels[GB_LCD_WIDTH];
     struct sprite line_sprites[GB_LINE_SPRITES + 1]; // fake, out-of-frame sprite at the end to avoid checking for bounds while we draw the line
+    unsigned window_start = GB_LCD_WIDTH; // first column of the window
     unsigned x;
     unsigned next_sprite = 0;
 
     get_ppu_line_sprites(gameboy, ppu->ly, line_sprites);
 
     for (x = 0; x < GB_LCD_WIDTH; x++) {
-        struct ppu_pixel pixel;
-        struct sprite s;
+        pixels[x].colour.dmg = WHITE;
+        pixels[x].opaque = false;
+        pixels[x].priority = false;
+    }
 
-        pixel.colour.dmg = WHITE;
-        pixel.opaque = false;
-        pixel.priority = false;
+    if (ppu->window_enable && ppu->ly >= ppu->window_y) {
+        window_start = (ppu->window_x < 7) ? 0 : ppu->window_x - 7;
 
-        if (ppu->window_enable && get_ppu_pixel_in_window(gameboy, x, ppu->ly)) {
-            pixel = get_ppu_window_pixel(gameboy, x, ppu->ly); // pixel lies within the window
-        } else if (ppu->background_enable) {
-            pixel = get_ppu_background_pixel(gameboy, x, ppu->ly);
+        if (window_start > GB_LCD_WIDTH) {
+            window_start = GB_LCD_WIDTH;
         }
+    }
+
+    if (ppu->background_enable) {
+        get_ppu_background_window_span(gameboy, pixels, 0, window_start, ppu->scroll_x, ppu->ly + ppu->scroll_y, ppu->background_use_high_tile_map);
+    }
+
+    // the window covers the rest of the line
+    get_ppu_background_window_span(gameboy, pixels, window_start, GB_LCD_WIDTH, window_start + 7 - ppu->window_x, ppu->ly - ppu->window_y,
+            ppu->window_use_high_tile_map);
+
+    for (x = 0; x < GB_LCD_WIDTH; x++) {
+        struct ppu_pixel pixel = pixels[x];
+        struct sprite s;
 
         if (!pixel.priority || !pixel.opaque) {
             if (gameboy->gbc) {
@@ -418,14 +487,358 @@ static void ppu_draw_current_line(struct emulator *gameboy) {
             }
         }
 
-        line[x] = pixel.colour;
+        line[x] = gameboy->gbc ? pixel.colour.gbc : pixel.colour.dmg;
+    }
+}
+#else
+#define GB_LINE_PADDING 8 // tiles and sprites are drawn 8 pixels at a time ; partly visible ones spill into the padding on each side of the line
+
+// line being composited ; every buffer is indexed by the screen column plus GB_LINE_PADDING
+struct ppu_line {
+    uint16_t colours[GB_LINE_PADDING + GB_LCD_WIDTH + GB_LINE_PADDING]; // DMG shade or GBC xRGB 1555 colour of each pixel
+    uint16_t opaque[GB_LINE_PADDING + GB_LCD_WIDTH + GB_LINE_PADDING]; // 0xFFFF where the background or window colour isn't WHITE
+    uint16_t priority[GB_LINE_PADDING + GB_LCD_WIDTH + GB_LINE_PADDING]; // 0xFFFF where an opaque GBC background pixel is drawn over every sprite
+};
+
+static void get_ppu_dmg_colours(uint8_t palette, uint16_t colours[4]) {
+    for (unsigned i = 0; i < 4; i++) {
+        colours[i] = ppu_palette_transform(i, palette);
+    }
+}
+
+// pixel data of an x-flipped tile row
+static const uint8_t *get_ppu_flipped_row(const uint8_t *row, uint8_t flipped[8]) {
+    for (unsigned x = 0; x < 8; x++) {
+        flipped[x] = row[7 - x];
     }
 
-    if (gameboy->gbc) {
-        gameboy->ui.draw_line_gbc(gameboy, ppu->ly, line);
+    return flipped;
+}
+
+#ifdef __SSE2__
+// widen the 8 colour indices of a tile row to one 16 bits lane per pixel
+static inline __m128i load_ppu_tile_row(const uint8_t row[8]) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)row), _mm_setzero_si128());
+}
+
+// replace every colour index with its colour from the palette
+static inline __m128i lookup_ppu_palette(__m128i index, const uint16_t colours[4]) {
+    __m128i result = _mm_setzero_si128();
+
+    for (unsigned i = 0; i < 4; i++) {
+        __m128i match = _mm_cmpeq_epi16(index, _mm_set1_epi16(i));
+
+        result = _mm_or_si128(result, _mm_and_si128(match, _mm_set1_epi16(colours[i])));
+    }
+
+    return result;
+}
+#endif
+
+// draw the 8 pixels of a background or window tile row starting at position
+static void draw_ppu_tile_span(struct ppu_line *line, unsigned position, const uint8_t row[8], const uint16_t colours[4], bool priority) {
+#ifdef __SSE2__
+    __m128i index = load_ppu_tile_row(row);
+    __m128i opaque = _mm_xor_si128(_mm_cmpeq_epi16(index, _mm_setzero_si128()), _mm_set1_epi16(-1));
+
+    _mm_storeu_si128((__m128i *)&line->colours[position], lookup_ppu_palette(index, colours));
+    _mm_storeu_si128((__m128i *)&line->opaque[position], opaque);
+    _mm_storeu_si128((__m128i *)&line->priority[position], priority ? opaque : _mm_setzero_si128());
+#else
+    for (unsigned i = 0; i < 8; i++) {
+        uint16_t opaque = (row[i] != WHITE) ? 0xFFFF : 0;
+
+        line->colours[position + i] = colours[row[i]];
+        line->opaque[position + i] = opaque;
+        line->priority[position + i] = priority ? opaque : 0;
+    }
+#endif
+}
+
+// draw the 8 pixels of a sprite row starting at position over whatever is already on the line
+static void draw_ppu_sprite_span(struct ppu_line *line, unsigned position, const uint8_t row[8], const uint16_t colours[4], bool background) {
+#ifdef __SSE2__
+    __m128i index = load_ppu_tile_row(row);
+    __m128i hidden = _mm_loadu_si128((const __m128i *)&line->priority[position]);
+    __m128i visible;
+    __m128i current = _mm_loadu_si128((const __m128i *)&line->colours[position]);
+
+    if (background) {
+        hidden = _mm_or_si128(hidden, _mm_loadu_si128((const __m128i *)&line->opaque[position])); // sprite is behind opaque background pixels
+    }
+
+    // white pixels are transparent
+    hidden = _mm_or_si128(hidden, _mm_cmpeq_epi16(index, _mm_setzero_si128()));
+    visible = _mm_and_si128(_mm_xor_si128(hidden, _mm_set1_epi16(-1)), lookup_ppu_palette(index, colours));
+
+    _mm_storeu_si128((__m128i *)&line->colours[position], _mm_or_si128(_mm_and_si128(hidden, current), visible));
+#else
+    for (unsigned i = 0; i < 8; i++) {
+        bool hidden = line->priority[position + i] || (background && line->opaque[position + i]) || row[i] == WHITE;
+
+        if (!hidden) {
+            line->colours[position + i] = colours[row[i]];
+        }
+    }
+#endif
+}
+
+// draw whole tiles of the background or window from screen column x until end is covered ; map_x and map_y are the tile map coordinates of the pixel at x
+static void draw_ppu_background_window(struct emulator *gameboy, struct ppu_line *line, unsigned x, unsigned end, uint8_t map_x, uint8_t map_y,
+        bool use_high_tile_map, const uint16_t dmg_colours[4]) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+    unsigned tile_map_address; // offset of the tile map row in the VRAM
+    unsigned tile_map_x = map_x / 8;
+    unsigned tile_y = map_y % 8;
+    unsigned position = GB_LINE_PADDING + x - map_x % 8; // a partly visible first tile starts in the padding or under the background
+    bool use_sprite_tile_set = ppu->background_window_use_sprite_tile_set;
+
+    // there are two independent tile maps the game can use
+    if (use_high_tile_map) {
+        tile_map_address = 0x1C00;
+    } else {
+        tile_map_address = 0x1800;
+    }
+
+    tile_map_address += (map_y / 8) * 32; // the tile map is a square map of 32 * 32 tiles ; for each tile it contains one byte which is an index in the tile set
+
+    for (; position < GB_LINE_PADDING + end; position += 8) {
+        uint8_t tile_index = gameboy->video_ram[tile_map_address + tile_map_x]; // lookup the tile map entry in VRAM
+
+        if (gameboy->gbc) {
+            // on the GBC we have additional attributes in the 2nd VRAM bank
+            uint8_t attrs = gameboy->video_ram[tile_map_address + tile_map_x + 0x2000];
+            bool priority = attrs & 0x80;
+            bool y_flip = attrs & 0x40;
+            bool x_flip = attrs & 0x20;
+            bool high_bank = attrs & 0x08;
+            const uint8_t *row = get_ppu_tile_row(gameboy, tile_index, y_flip ? 7 - tile_y : tile_y, use_sprite_tile_set, high_bank);
+            uint8_t flipped[8];
+
+            if (x_flip) {
+                row = get_ppu_flipped_row(row, flipped);
+            }
+
+            draw_ppu_tile_span(line, position, row, get_ppu_gbc_colours(gameboy, false, attrs & 0x07), priority);
+        } else {
+            draw_ppu_tile_span(line, position, get_ppu_tile_row(gameboy, tile_index, tile_y, use_sprite_tile_set, false), dmg_colours, false);
+        }
+
+        tile_map_x = (tile_map_x + 1) % 32; // wrap around the tile map
+    }
+}
+
+// draw the sprites of the line from the lowest to the highest priority so the first visible sprite of each pixel is drawn last
+static void draw_ppu_line_sprites(struct emulator *gameboy, struct ppu_line *line, const struct sprite sprites[GB_LINE_SPRITES + 1]) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+    unsigned n_sprites = 0;
+
+    while (sprites[n_sprites].x < GB_LCD_WIDTH * 2) {
+        n_sprites++;
+    }
+
+    while (n_sprites--) {
+        const struct sprite *s = &sprites[n_sprites];
+        unsigned sprite_y = ppu->ly - s->y;
+        uint8_t tile_index = s->tile_index;
+        const uint8_t *row;
+        uint8_t flipped[8];
+        uint16_t dmg_colours[4];
+        const uint16_t *colours;
+
+        if (s->x <= -8 || s->x >= GB_LCD_WIDTH) {
+            continue; // sprite is outside of the screen
+        }
+
+        if (ppu->tall_sprites) {
+            // 8 * 16 sprites use two consecutive tiles ; The first tile's index's LSB is always assumed to be 0
+            tile_index &= 0xFE;
+
+            if (s->y_flip) {
+                sprite_y = 15 - sprite_y;
+            }
+        } else if (s->y_flip) {
+            sprite_y = 7 - sprite_y;
+        }
+
+        row = get_ppu_tile_row(gameboy, tile_index, sprite_y, true, s->high_bank);
+
+        if (s->x_flip) {
+            row = get_ppu_flipped_row(row, flipped);
+        }
+
+        if (gameboy->gbc) {
+            colours = get_ppu_gbc_colours(gameboy, true, s->palette);
+        } else {
+            get_ppu_dmg_colours(s->use_sprite_palette1 ? ppu->sprite_palette1 : ppu->sprite_palette0, dmg_colours);
+            colours = dmg_colours;
+        }
+
+        draw_ppu_sprite_span(line, GB_LINE_PADDING + s->x, row, colours, s->background);
+    }
+}
+
+// span renderer ; composites whole tile rows of the background, window and sprites
+static void render_ppu_line(struct emulator *gameboy, uint16_t line[GB_LCD_WIDTH]) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+    struct ppu_line pixels;
+    struct sprite line_sprites[GB_LINE_SPRITES + 1]; // fake, out-of-frame sprite at the end of the list
+    uint16_t dmg_colours[4];
+    unsigned window_start = GB_LCD_WIDTH; // first column of the window
+
+    get_ppu_line_sprites(gameboy, ppu->ly, line_sprites);
+    get_ppu_dmg_colours(ppu->background_palette, dmg_colours);
+
+    memset(&pixels, 0, sizeof(pixels)); // WHITE and transparent
+
+    if (ppu->window_enable && ppu->ly >= ppu->window_y) {
+        window_start = (ppu->window_x < 7) ? 0 : ppu->window_x - 7;
+
+        if (window_start > GB_LCD_WIDTH) {
+            window_start = GB_LCD_WIDTH;
+        }
+    }
+
+    if (ppu->background_enable && window_start > 0) {
+        draw_ppu_background_window(gameboy, &pixels, 0, window_start, ppu->scroll_x, ppu->ly + ppu->scroll_y, ppu->background_use_high_tile_map, dmg_colours);
+    }
+
+    // the window covers the rest of the line, including any background tile which spilled past its first column
+    if (window_start < GB_LCD_WIDTH) {
+        draw_ppu_background_window(gameboy, &pixels, window_start, GB_LCD_WIDTH, window_start + 7 - ppu->window_x, ppu->ly - ppu->window_y,
+                ppu->window_use_high_tile_map, dmg_colours);
+    }
+
+    draw_ppu_line_sprites(gameboy, &pixels, line_sprites);
+
+    memcpy(line, &pixels.colours[GB_LINE_PADDING], GB_LCD_WIDTH * sizeof(line[0]));
+}
+#endif
+
+static unsigned get_ppu_pixel_size(enum gameboy_pixel_format format) {
+    switch (format) {
+        case GB_PIXEL_INDEX:
+            return sizeof(uint8_t);
+        case GB_PIXEL_RGB555:
+            return sizeof(uint16_t);
+        default:
+            return sizeof(uint32_t);
+    }
+}
+
+static uint32_t ppu_5_to_8bits(uint32_t value) {
+    return (value << 3) | (value >> 2);
+}
+
+static uint32_t gbc_to_xrgb8888(uint16_t colour) {
+    uint32_t r = ppu_5_to_8bits(colour & 0x1F);
+    uint32_t g = ppu_5_to_8bits((colour >> 5) & 0x1F);
+    uint32_t b = ppu_5_to_8bits((colour >> 10) & 0x1F);
+
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+// store a line of DMG shades or GBC colours into the frame being drawn
+static void store_ppu_line(struct emulator *gameboy, unsigned ly, const uint16_t *restrict line, bool gbc) {
+    struct gameboy_framebuffer *framebuffer = &gameboy->ppu.framebuffer;
+    void *restrict row = (uint8_t *)framebuffer->buffers[framebuffer->drawing] + ly * GB_LCD_WIDTH * get_ppu_pixel_size(framebuffer->format);
+
+    // the shades of the original green LCD
+    static const uint16_t dmg_rgb555[4] = {
+        [WHITE] = 0x168E,
+        [LIGHT_GREY] = 0x11E7,
+        [DARK_GREY] = 0x0944,
+        [BLACK] = 0x04A2,
+    };
+
+    static const uint32_t dmg_xrgb8888[4] = {
+        [WHITE] = 0xFF75A32C,
+        [LIGHT_GREY] = 0xFF387A21,
+        [DARK_GREY] = 0xFF255116,
+        [BLACK] = 0xFF12280B,
+    };
+
+    switch (framebuffer->format) {
+        case GB_PIXEL_INDEX: {
+            uint8_t *pixels = row;
+
+            for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+                pixels[x] = line[x];
+            }
+            break;
+        }
+        case GB_PIXEL_RGB555: {
+            uint16_t *pixels = row;
+
+            for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+                pixels[x] = gbc ? (line[x] & 0x7FFF) : dmg_rgb555[line[x]];
+            }
+            break;
+        }
+        case GB_PIXEL_XRGB8888: {
+            uint32_t *pixels = row;
+
+            for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+                pixels[x] = gbc ? gbc_to_xrgb8888(line[x]) : dmg_xrgb8888[line[x]];
+            }
+            break;
+        }
+    }
+}
+
+static void ppu_draw_current_line(struct emulator *gameboy) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+    uint16_t line[GB_LCD_WIDTH];
+
+    render_ppu_line(gameboy, line);
+    store_ppu_line(gameboy, ppu->ly, line, gameboy->gbc);
+}
+
+// hand the completed frame to the UI and move on to the next buffer
+static void flip_ppu_framebuffer(struct emulator *gameboy) {
+    struct gameboy_framebuffer *framebuffer = &gameboy->ppu.framebuffer;
+    struct gameboy_frame frame;
+
+    frame.pixels = framebuffer->buffers[framebuffer->drawing];
+    frame.pitch = GB_LCD_WIDTH * get_ppu_pixel_size(framebuffer->format);
+    frame.format = framebuffer->format;
+
+    framebuffer->drawing = (framebuffer->drawing + 1) % framebuffer->count;
+
+    gameboy->ui.flip(gameboy, &frame);
+}
+
+// skipped frames go through every mode and interrupt like the others, only the pixels aren't drawn ; the decision is taken between frames so none is torn
+static void update_ppu_frame_skip(struct emulator *gameboy) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+
+    if (ppu->skip_counter == 0) {
+        flip_ppu_framebuffer(gameboy);
+        ppu->skip_counter = ppu->frame_skip;
     } else {
-        gameboy->ui.draw_line_dmg(gameboy, ppu->ly, line);
+        ppu->skipped_frames++;
+        ppu->skip_counter--;
+
+        if (ppu->skip_counter > ppu->frame_skip) {
+            ppu->skip_counter = ppu->frame_skip; // the UI skips fewer frames now
+        }
+    }
+}
+
+// select the format and number of buffers of the frames ; called by the UI
+void set_ppu_framebuffer(struct emulator *gameboy, enum gameboy_pixel_format format, unsigned count) {
+    struct gameboy_framebuffer *framebuffer = &gameboy->ppu.framebuffer;
+
+    if (count < 2 || count > GB_PPU_MAX_FRAMEBUFFERS) {
+        fprintf(stderr, "Unsupported number of framebuffers %u\n", count);
+        exit(EXIT_FAILURE);
     }
+
+    framebuffer->format = format;
+    framebuffer->count = count;
+    framebuffer->drawing = 0;
+
+    memset(framebuffer->buffers, 0, sizeof(framebuffer->buffers));
 }
 
 void sync_ppu(struct emulator *gameboy) {
@@ -450,7 +863,9 @@ void sync_ppu(struct emulator *gameboy) {
 
             if (prev_mode != 0 && get_ppu_mode(gameboy) == 0) {
                 // didn't finish the line but we did cross the Mode 3 -> Mode 0 boundary ; draw the current line
-                ppu_draw_current_line(gameboy);
+                if (ppu->skip_counter == 0) {
+                    ppu_draw_current_line(gameboy);
+                }
 
                 if (ppu->mode0_flag) {
                     trigger_interrupt_request(gameboy, GB_INTERRUPT_REQUEST_LCD_STAT);
@@ -465,7 +880,9 @@ void sync_ppu(struct emulator *gameboy) {
 
             if (prev_mode == 2 || prev_mode == 3) {
                 // about to finish the current line, but hadn't reached the Mode 0 boundary yet, which means that has still yet to be drawn
-                ppu_draw_current_line(gameboy);
+                if (ppu->skip_counter == 0) {
+                    ppu_draw_current_line(gameboy);
+                }
 
                 if (ppu->mode0_flag) {
                     trigger_interrupt_request(gameboy, GB_INTERRUPT_REQUEST_LCD_STAT);
@@ -482,7 +899,8 @@ void sync_ppu(struct emulator *gameboy) {
 
             if (ppu->ly == VSYNC_START) {
                 // finished drawing the current frame
-                gameboy->ui.flip(gameboy);
+                ppu->frames++;
+                update_ppu_frame_skip(gameboy);
                 trigger_interrupt_request(gameboy, GB_INTERRUPT_REQUEST_VSYNC);
 
                 if (ppu->mode1_flag) {
@@ -570,14 +988,15 @@ void set_lcdc(struct emulator *gameboy, uint8_t lcdc) {
         ppu->master_enable = master_enable;
 
         if (master_enable == false) {
-            union lcd_colour line[GB_LCD_WIDTH];
+            uint16_t line[GB_LCD_WIDTH];
 
+            // the screen goes blank
             for (unsigned i = 0; i < GB_LCD_WIDTH; i++) {
-                line[i].dmg = WHITE;
+                line[i] = WHITE;
             }
 
             for (unsigned i = 0; i < GB_LCD_HEIGHT; i++) {
-                gameboy->ui.draw_line_dmg(gameboy, i, line);
+                store_ppu_line(gameboy, i, line, false);
             }
 
             ppu->ly = 0;
@@ -0,0 +1,153 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "emulator.h"
+
+#define RESAMPLER_ONE (1ULL << 32) // one input frame in 32.32 fixed point
+#define RESAMPLER_CUTOFF 0.85 // fraction of the lower Nyquist frequency kept ; the transition band ends up above the audible range
+
+static double sinc(double x) {
+    if (x == 0) {
+        return 1;
+    }
+
+    return sin(M_PI * x) / (M_PI * x);
+}
+
+// Blackman window over the length of the filter ; t is in input frames from its centre
+static double blackman(double t) {
+    double x = 2 * M_PI * t / GB_RESAMPLER_TAPS;
+
+    return 0.42 + 0.5 * cos(x) + 0.08 * cos(2 * x);
+}
+
+// speed seconds of SPU frames are played per second of output ; the pitch goes up with the speed
+static void update_resampler_kernel(struct spu_resampler *resampler) {
+    double input_rate = GB_SPU_SAMPLE_RATE_HZ * resampler->speed;
+    double ratio = resampler->output_rate / input_rate;
+    double cutoff = 0.5 * RESAMPLER_CUTOFF * (ratio < 1 ? ratio : 1); // in cycles per input frame ; filters out what would alias at the output rate
+
+    resampler->nominal_step = (uint64_t)(input_rate * 4294967296.0 / resampler->output_rate);
+    resampler->step = resampler->nominal_step;
+
+    for (unsigned phase = 0; phase < GB_RESAMPLER_PHASES; phase++) {
+        float *coefficients = resampler->kernel[phase];
+        double sum = 0;
+
+        for (unsigned tap = 0; tap < GB_RESAMPLER_TAPS; tap++) {
+            // distance from the input frame to the output frame, which sits between the two middle taps
+            double t = (int)tap - (GB_RESAMPLER_TAPS / 2 - 1) - (double)phase / GB_RESAMPLER_PHASES;
+
+            coefficients[tap] = 2 * cutoff * sinc(2 * cutoff * t) * blackman(t);
+            sum += coefficients[tap];
+        }
+
+        // unity gain so a constant input stays at the same level
+        for (unsigned tap = 0; tap < GB_RESAMPLER_TAPS; tap++) {
+            coefficients[tap] /= sum;
+        }
+    }
+}
+
+// rate is the sample rate of the audio device ; 0 disables the resampler and the SPU frames go straight to the sample ring
+void set_spu_output_rate(struct emulator *gameboy, unsigned rate) {
+    struct spu_resampler *resampler = &gameboy->spu.resampler;
+
+    memset(resampler, 0, sizeof(*resampler));
+
+    if (rate == 0) {
+        return;
+    }
+
+    resampler->output_rate = rate;
+    resampler->speed = 1;
+
+    update_resampler_kernel(resampler);
+}
+
+// the frames already in the ring are played as they are ; only the following ones change pitch
+void set_spu_speed(struct emulator *gameboy, double speed) {
+    struct spu_resampler *resampler = &gameboy->spu.resampler;
+
+    if (resampler->output_rate == 0 || resampler->speed == speed) {
+        return;
+    }
+
+    resampler->speed = speed;
+
+    if (speed != GB_SPEED_UNBOUNDED) {
+        update_resampler_kernel(resampler);
+    }
+}
+
+// keep the sample ring half full ; the ratio goes up when the device drains it slower than the emulation fills it and down otherwise
+void update_spu_rate_control(struct emulator *gameboy) {
+    struct spu_resampler *resampler = &gameboy->spu.resampler;
+    struct spu_sample_ring *ring = &gameboy->spu.ring;
+    uint32_t length = ring->mask + 1;
+    uint32_t fill = atomic_load_explicit(&ring->head, memory_order_relaxed) - atomic_load_explicit(&ring->tail, memory_order_acquire);
+    double adjust;
+
+    if (fill > length) {
+        fill = length;
+    }
+
+    adjust = GB_RESAMPLER_MAX_ADJUST * (2.0 * fill / length - 1);
+
+    resampler->step = resampler->nominal_step + (int64_t)(resampler->nominal_step * adjust);
+}
+
+static int16_t clamp_resampler_sample(float sample) {
+    // the filter rings slightly around steep edges
+    if (sample > INT16_MAX) {
+        return INT16_MAX;
+    }
+
+    if (sample < INT16_MIN) {
+        return INT16_MIN;
+    }
+
+    return (int16_t)lrintf(sample);
+}
+
+// add an SPU frame to the filter and write every output frame that falls before the next one to the sample ring
+void resample_spu_frame(struct emulator *gameboy, int16_t sample_left, int16_t sample_right) {
+    struct spu_resampler *resampler = &gameboy->spu.resampler;
+    const float (*window)[2];
+
+    // flat out there is no telling how fast the ring should fill ; stay silent rather than play scraps
+    if (resampler->speed == GB_SPEED_UNBOUNDED) {
+        return;
+    }
+
+    resampler->history[resampler->history_index][0] = sample_left;
+    resampler->history[resampler->history_index][1] = sample_right;
+    resampler->history[resampler->history_index + GB_RESAMPLER_TAPS][0] = sample_left;
+    resampler->history[resampler->history_index + GB_RESAMPLER_TAPS][1] = sample_right;
+
+    resampler->history_index = (resampler->history_index + 1) % GB_RESAMPLER_TAPS;
+    window = (const float (*)[2])resampler->history[resampler->history_index];
+
+    while (resampler->position < RESAMPLER_ONE) {
+        const float *coefficients = resampler->kernel[resampler->position >> (32 - GB_RESAMPLER_PHASE_BITS)];
+        float left = 0;
+        float right = 0;
+
+        for (unsigned tap = 0; tap < GB_RESAMPLER_TAPS; tap++) {
+            left += window[tap][0] * coefficients[tap];
+            right += window[tap][1] * coefficients[tap];
+        }
+
+        write_spu_sample_ring(gameboy, clamp_resampler_sample(left), clamp_resampler_sample(right));
+
+        resampler->position += resampler->step;
+    }
+
+    resampler->position -= RESAMPLER_ONE;
+}
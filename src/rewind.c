@@ -0,0 +1,293 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "emulator.h"
+
+#define REWIND_FRAME_LENGTH sizeof(uint32_t) // length of a delta, stored before and after it in the ring
+#define REWIND_DELTA_SLACK 16 // a delta is at most this much longer than the state ; when every word changed
+
+static uint64_t get_rewind_time(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000U + now.tv_nsec;
+}
+
+static size_t get_rewind_words(struct gameboy_rewind *rewind) {
+    return (rewind->state_length + 7) / 8;
+}
+
+static size_t put_rewind_varint(uint8_t *out, size_t value) {
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        out[length++] = value | 0x80;
+        value >>= 7;
+    }
+
+    out[length++] = value;
+
+    return length;
+}
+
+static const uint8_t *get_rewind_varint(const uint8_t *in, size_t *value) {
+    unsigned shift = 0;
+
+    *value = 0;
+
+    do {
+        *value |= (size_t)(*in & 0x7F) << shift;
+        shift += 7;
+    } while (*in++ & 0x80);
+
+    return in;
+}
+
+// runs of unchanged words are skipped and the changed ones are stored XOR'd ; applying the delta to current gives back previous
+static size_t encode_rewind_delta(uint8_t *out, const uint64_t *previous, const uint64_t *current, size_t words) {
+    size_t length = 0;
+    size_t i = 0;
+
+    while (i < words) {
+        size_t start = i;
+
+        while (i < words && previous[i] == current[i]) {
+            i++;
+        }
+
+        length += put_rewind_varint(out + length, i - start);
+        start = i;
+
+        while (i < words && previous[i] != current[i]) {
+            i++;
+        }
+
+        length += put_rewind_varint(out + length, i - start);
+
+        for (size_t j = start; j < i; j++) {
+            uint64_t word = previous[j] ^ current[j];
+
+            memcpy(out + length, &word, sizeof(word));
+            length += sizeof(word);
+        }
+    }
+
+    return length;
+}
+
+static void apply_rewind_delta(uint64_t *state, const uint8_t *delta, size_t length) {
+    const uint8_t *end = delta + length;
+    size_t i = 0;
+
+    while (delta < end) {
+        size_t skip;
+        size_t count;
+
+        delta = get_rewind_varint(delta, &skip);
+        delta = get_rewind_varint(delta, &count);
+        i += skip;
+
+        for (; count > 0; count--) {
+            uint64_t word;
+
+            memcpy(&word, delta, sizeof(word));
+            state[i++] ^= word;
+            delta += sizeof(word);
+        }
+    }
+}
+
+static void write_rewind_ring(struct gameboy_rewind *rewind, size_t position, const void *data, size_t length) {
+    size_t first = GB_REWIND_RING_LENGTH - position;
+
+    if (first > length) {
+        first = length;
+    }
+
+    memcpy(rewind->ring + position, data, first);
+    memcpy(rewind->ring, (const uint8_t *)data + first, length - first);
+}
+
+static void read_rewind_ring(struct gameboy_rewind *rewind, size_t position, void *data, size_t length) {
+    size_t first = GB_REWIND_RING_LENGTH - position;
+
+    if (first > length) {
+        first = length;
+    }
+
+    memcpy(data, rewind->ring + position, first);
+    memcpy((uint8_t *)data + first, rewind->ring, length - first);
+}
+
+// the oldest deltas make room for the new one ; the history is only as long as the ring
+static void push_rewind_delta(struct gameboy_rewind *rewind, size_t length) {
+    uint32_t frame = length;
+    size_t total = length + 2 * REWIND_FRAME_LENGTH;
+    size_t tail;
+
+    if (total > GB_REWIND_RING_LENGTH) {
+        rewind->ring_head = 0; // can't be stored ; the history starts over from the newest snapshot
+        rewind->ring_used = 0;
+        rewind->deltas = 0;
+        return;
+    }
+
+    while (rewind->ring_used + total > GB_REWIND_RING_LENGTH) {
+        uint32_t oldest;
+
+        read_rewind_ring(rewind, rewind->ring_head, &oldest, REWIND_FRAME_LENGTH);
+
+        rewind->ring_head = (rewind->ring_head + oldest + 2 * REWIND_FRAME_LENGTH) % GB_REWIND_RING_LENGTH;
+        rewind->ring_used -= oldest + 2 * REWIND_FRAME_LENGTH;
+        rewind->deltas--;
+    }
+
+    tail = (rewind->ring_head + rewind->ring_used) % GB_REWIND_RING_LENGTH;
+
+    write_rewind_ring(rewind, tail, &frame, REWIND_FRAME_LENGTH);
+    write_rewind_ring(rewind, (tail + REWIND_FRAME_LENGTH) % GB_REWIND_RING_LENGTH, rewind->delta, length);
+    write_rewind_ring(rewind, (tail + REWIND_FRAME_LENGTH + length) % GB_REWIND_RING_LENGTH, &frame, REWIND_FRAME_LENGTH);
+
+    rewind->ring_used += total;
+    rewind->deltas++;
+}
+
+// returns the length of the newest delta, copied to rewind->delta and removed from the ring
+static size_t pop_rewind_delta(struct gameboy_rewind *rewind) {
+    size_t tail = rewind->ring_head + rewind->ring_used;
+    uint32_t frame;
+
+    read_rewind_ring(rewind, (tail - REWIND_FRAME_LENGTH) % GB_REWIND_RING_LENGTH, &frame, REWIND_FRAME_LENGTH);
+    read_rewind_ring(rewind, (tail - REWIND_FRAME_LENGTH - frame) % GB_REWIND_RING_LENGTH, rewind->delta, frame);
+
+    rewind->ring_used -= frame + 2 * REWIND_FRAME_LENGTH;
+    rewind->deltas--;
+
+    return frame;
+}
+
+// must be called once the cart is loaded ; the length of the snapshots depends on its RAM
+bool init_rewind(struct emulator *gameboy) {
+    struct gameboy_rewind *rewind = &gameboy->rewind;
+    size_t length;
+
+    rewind->state_length = save_state(gameboy, NULL, 0);
+    length = get_rewind_words(rewind) * 8;
+
+    rewind->state = calloc(1, length); // the padding of the last word stays zero in both snapshots
+    rewind->capture = calloc(1, length);
+    rewind->delta = malloc(length + REWIND_DELTA_SLACK);
+    rewind->ring = malloc(GB_REWIND_RING_LENGTH);
+
+    if (rewind->state == NULL || rewind->capture == NULL || rewind->delta == NULL || rewind->ring == NULL) {
+        perror("Rewind history allocation failed ; rewinding is disabled");
+        destroy_rewind(gameboy);
+        return false;
+    }
+
+    rewind->enabled = true;
+    rewind->rewinding = false;
+    rewind->interval = GB_REWIND_INTERVAL;
+    rewind->next_frame = gameboy->ppu.frames;
+    rewind->has_state = false;
+    rewind->ring_head = 0;
+    rewind->ring_used = 0;
+    rewind->deltas = 0;
+    rewind->captures = 0;
+    rewind->capture_ns = 0;
+    rewind->max_capture_ns = 0;
+    rewind->over_budget = 0;
+
+    return true;
+}
+
+void destroy_rewind(struct emulator *gameboy) {
+    struct gameboy_rewind *rewind = &gameboy->rewind;
+
+    free(rewind->state);
+    free(rewind->capture);
+    free(rewind->delta);
+    free(rewind->ring);
+
+    rewind->state = NULL;
+    rewind->capture = NULL;
+    rewind->delta = NULL;
+    rewind->ring = NULL;
+    rewind->enabled = false;
+}
+
+// called between two runs of the CPU ; captures a snapshot once every interval frames
+void capture_rewind(struct emulator *gameboy) {
+    struct gameboy_rewind *rewind = &gameboy->rewind;
+    uint64_t start;
+    uint64_t duration;
+    uint8_t *previous;
+
+    if (!rewind->enabled || rewind->rewinding || gameboy->ppu.frames < rewind->next_frame) {
+        return;
+    }
+
+    start = get_rewind_time();
+
+    save_state(gameboy, rewind->capture, rewind->state_length);
+
+    if (rewind->has_state) {
+        push_rewind_delta(rewind, encode_rewind_delta(rewind->delta, (const uint64_t *)rewind->state, (const uint64_t *)rewind->capture,
+                get_rewind_words(rewind)));
+    }
+
+    previous = rewind->state;
+    rewind->state = rewind->capture;
+    rewind->capture = previous;
+    rewind->has_state = true;
+    rewind->next_frame = gameboy->ppu.frames + rewind->interval;
+
+    duration = get_rewind_time() - start;
+
+    rewind->captures++;
+    rewind->capture_ns += duration;
+
+    if (duration > rewind->max_capture_ns) {
+        rewind->max_capture_ns = duration;
+    }
+
+    if (duration > (uint64_t)GB_REWIND_BUDGET_NS * rewind->interval) {
+        rewind->over_budget++;
+    }
+
+    // the game changes too much between snapshots for the host ; capture less often rather than slowing the emulation down
+    if (rewind->capture_ns > (uint64_t)GB_REWIND_BUDGET_NS * rewind->interval * rewind->captures && rewind->interval < GB_REWIND_MAX_INTERVAL) {
+        rewind->interval *= 2;
+    }
+}
+
+// go back to the newest snapshot and drop it from the history ; returns false once the history is exhausted
+bool step_rewind(struct emulator *gameboy) {
+    struct gameboy_rewind *rewind = &gameboy->rewind;
+
+    if (!rewind->enabled || !rewind->has_state) {
+        return false;
+    }
+
+    if (!load_state(gameboy, rewind->state, rewind->state_length)) {
+        rewind->has_state = false;
+        return false;
+    }
+
+    if (rewind->deltas > 0) {
+        apply_rewind_delta((uint64_t *)rewind->state, rewind->delta, pop_rewind_delta(rewind));
+    } else {
+        rewind->has_state = false;
+    }
+
+    rewind->next_frame = gameboy->ppu.frames + rewind->interval;
+
+    return true;
+}
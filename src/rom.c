@@ -0,0 +1,270 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "emulator.h"
+
+#define ROM_HASH_PRIME 0x100000001B3ULL
+
+// file systems whose files may change behind the mapping without this host knowing
+#define ROM_NFS_MAGIC 0x6969
+#define ROM_SMB_MAGIC 0x517B
+#define ROM_CIFS_MAGIC 0xFF534D42
+#define ROM_SMB2_MAGIC 0xFE534D42
+#define ROM_FUSE_MAGIC 0x65735546
+#define ROM_9P_MAGIC 0x01021997
+
+// every emulator of the process loads its ROM through this list
+static pthread_mutex_t rom_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rom_image *rom_cache;
+static unsigned rom_cache_idle; // images of the list no emulator uses
+
+// FNV-1a over whole words ; the ROMs are hashed once when they are first mapped
+static uint64_t hash_rom_data(const uint8_t *data, size_t length) {
+    uint64_t hash = 0xCBF29CE484222325ULL ^ length;
+    size_t i;
+
+    for (i = 0; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * ROM_HASH_PRIME;
+        hash ^= hash >> 32; // the high bits of each word reach the low bits of the hash
+    }
+
+    for (; i < length; i++) {
+        hash = (hash ^ data[i]) * ROM_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+static bool is_same_rom_time(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static bool is_rom_image_file(const struct rom_image *image, const struct stat *status) {
+    return image->device == status->st_dev && image->inode == status->st_ino && image->length == (size_t)status->st_size
+            && is_same_rom_time(&image->modified, &status->st_mtim) && is_same_rom_time(&image->changed, &status->st_ctim);
+}
+
+static void set_rom_image_file(struct rom_image *image, const struct stat *status) {
+    image->device = status->st_dev;
+    image->inode = status->st_ino;
+    image->modified = status->st_mtim;
+    image->changed = status->st_ctim;
+}
+
+// a mapped file which shrinks while it is in use crashes the process with SIGBUS ; only large files on local disks are worth the risk
+static bool is_rom_file_mappable(int descriptor, size_t length) {
+    struct statfs file_system;
+
+    if (length < GB_ROM_MAP_MIN_LENGTH || fstatfs(descriptor, &file_system) != 0) {
+        return false;
+    }
+
+    switch ((unsigned long)file_system.f_type) {
+        case ROM_NFS_MAGIC:
+        case ROM_SMB_MAGIC:
+        case ROM_CIFS_MAGIC:
+        case ROM_SMB2_MAGIC:
+        case ROM_FUSE_MAGIC:
+        case ROM_9P_MAGIC:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void retain_rom_image(struct rom_image *image) {
+    if (image->references++ == 0) {
+        rom_cache_idle--;
+    }
+}
+
+static void free_rom_data(const uint8_t *data, size_t length, bool mapped) {
+    if (mapped) {
+        munmap((void *)data, length);
+    } else {
+        free((void *)data);
+    }
+}
+
+// files which aren't mapped, or can't be, are read into an allocation instead ; images of both kinds are shared the same way
+static const uint8_t *read_rom_data(int descriptor, size_t length, bool *mapped) {
+    uint8_t *data = MAP_FAILED;
+    size_t position = 0;
+
+    if (is_rom_file_mappable(descriptor, length)) {
+        data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    }
+
+    *mapped = (data != MAP_FAILED);
+
+    if (*mapped) {
+        return data;
+    }
+
+    data = malloc(length);
+    if (data == NULL) {
+        perror("Can't allocate ROM buffer");
+        return NULL;
+    }
+
+    while (position < length) {
+        ssize_t nread = read(descriptor, data + position, length - position);
+
+        if (nread <= 0) {
+            fprintf(stderr, "Failed to load ROM file (read %zu bytes, expected %zu)\n", position, length);
+            free(data);
+            return NULL;
+        }
+
+        position += nread;
+    }
+
+    return data;
+}
+
+// returns the image of the ROM at path, mapped read-only ; NULL if it can't be opened, the reason is printed
+struct rom_image *open_rom_image(const char *path, size_t max_length) {
+    int descriptor = open(path, O_RDONLY);
+    struct stat status;
+    struct rom_image *image;
+    const uint8_t *data;
+    bool mapped;
+    uint64_t hash;
+
+    if (descriptor < 0) {
+        perror("Can't open ROM file");
+        return NULL;
+    }
+
+    if (fstat(descriptor, &status) != 0) {
+        perror("Can't get ROM file length");
+        close(descriptor);
+        return NULL;
+    }
+
+    if (status.st_size == 0) {
+        fprintf(stderr, "ROM file is empty!\n");
+        close(descriptor);
+        return NULL;
+    }
+
+    if ((uintmax_t)status.st_size > max_length) {
+        fprintf(stderr, "ROM file is too big!\n");
+        close(descriptor);
+        return NULL;
+    }
+
+    // the file was opened before and didn't change ; nothing to map or hash
+    pthread_mutex_lock(&rom_cache_lock);
+
+    for (image = rom_cache; image != NULL; image = image->next) {
+        if (is_rom_image_file(image, &status)) {
+            retain_rom_image(image);
+            pthread_mutex_unlock(&rom_cache_lock);
+            close(descriptor);
+            return image;
+        }
+    }
+
+    pthread_mutex_unlock(&rom_cache_lock);
+
+    // mapped and hashed outside of the lock so the other emulators keep loading meanwhile
+    data = read_rom_data(descriptor, status.st_size, &mapped);
+    close(descriptor); // the mapping stays valid
+
+    if (data == NULL) {
+        return NULL;
+    }
+
+    hash = hash_rom_data(data, status.st_size);
+
+    pthread_mutex_lock(&rom_cache_lock);
+
+    // another file with the same contents, or the same file opened by another emulator meanwhile
+    for (image = rom_cache; image != NULL; image = image->next) {
+        if (image->hash == hash && image->length == (size_t)status.st_size && memcmp(image->data, data, image->length) == 0) {
+            set_rom_image_file(image, &status);
+            retain_rom_image(image);
+            pthread_mutex_unlock(&rom_cache_lock);
+            free_rom_data(data, status.st_size, mapped);
+            return image;
+        }
+    }
+
+    image = calloc(1, sizeof(*image));
+    if (image == NULL) {
+        pthread_mutex_unlock(&rom_cache_lock);
+        perror("Can't allocate ROM image");
+        free_rom_data(data, status.st_size, mapped);
+        return NULL;
+    }
+
+    image->data = data;
+    image->length = status.st_size;
+    image->hash = hash;
+    image->mapped = mapped;
+    image->references = 1;
+    set_rom_image_file(image, &status);
+
+    image->next = rom_cache;
+    rom_cache = image;
+
+    pthread_mutex_unlock(&rom_cache_lock);
+
+    return image;
+}
+
+// the image stays mapped for a while in case the same game is loaded again ; the least recently released idle image goes first
+void close_rom_image(struct rom_image *image) {
+    struct rom_image **link = &rom_cache;
+    struct rom_image **oldest = NULL;
+
+    if (image == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&rom_cache_lock);
+
+    // images going idle move to the head of the list ; the last idle image of the list was released first
+    if (--image->references == 0) {
+        while (*link != image) {
+            link = &(*link)->next;
+        }
+
+        *link = image->next;
+        image->next = rom_cache;
+        rom_cache = image;
+        rom_cache_idle++;
+    }
+
+    if (rom_cache_idle > GB_ROM_CACHE_IDLE) {
+        for (link = &rom_cache; *link != NULL; link = &(*link)->next) {
+            if ((*link)->references == 0) {
+                oldest = link;
+            }
+        }
+
+        image = *oldest;
+        *oldest = image->next;
+        rom_cache_idle--;
+
+        free_rom_data(image->data, image->length, image->mapped);
+        free(image);
+    }
+
+    pthread_mutex_unlock(&rom_cache_lock);
+}
@@ -158,11 +158,10 @@ void write_rtc(struct emulator *gameboy, unsigned address, uint8_t value) {
     get_latch_date(gameboy, &date);
 }
 
-static void dump_u8(FILE *file, uint8_t value) {
-    if (fwrite(&value, 1, 1, file) < 0) {
-        perror("fwrite failed\n");
-        exit(EXIT_FAILURE);
-    }
+static uint8_t *dump_u8(uint8_t *data, uint8_t value) {
+    *data = value;
+
+    return data + 1;
 }
 
 static uint8_t load_u8(FILE *file) {
@@ -176,15 +175,16 @@ static uint8_t load_u8(FILE *file) {
     return value;
 }
 
-static void dump_u64(FILE *file, uint64_t value) {
-    dump_u8(file, value >> 56);
-    dump_u8(file, value >> 48);
-    dump_u8(file, value >> 40);
-    dump_u8(file, value >> 32);
-    dump_u8(file, value >> 24);
-    dump_u8(file, value >> 16);
-    dump_u8(file, value >> 8);
-    dump_u8(file, value);
+static uint8_t *dump_u64(uint8_t *data, uint64_t value) {
+    data = dump_u8(data, value >> 56);
+    data = dump_u8(data, value >> 48);
+    data = dump_u8(data, value >> 40);
+    data = dump_u8(data, value >> 32);
+    data = dump_u8(data, value >> 24);
+    data = dump_u8(data, value >> 16);
+    data = dump_u8(data, value >> 8);
+
+    return dump_u8(data, value);
 }
 
 static uint64_t load_u64(FILE *file) {
@@ -202,17 +202,18 @@ static uint64_t load_u64(FILE *file) {
     return value;
 }
 
-void dump_rtc(struct emulator *gameboy, FILE *file) {
+// same layout as load_rtc reads ; data must hold GB_RTC_DUMP_LENGTH bytes
+void dump_rtc(struct emulator *gameboy, uint8_t *data) {
     struct gameboy_rtc *rtc = &gameboy->cart.rtc;
 
-    dump_u64(file, rtc->base);
-    dump_u64(file, rtc->halt_date);
-    dump_u8(file, rtc->latch);
-    dump_u8(file, rtc->latched_date.seconds);
-    dump_u8(file, rtc->latched_date.minutes);
-    dump_u8(file, rtc->latched_date.hours);
-    dump_u8(file, rtc->latched_date.days_low);
-    dump_u8(file, rtc->latched_date.days_high);
+    data = dump_u64(data, rtc->base);
+    data = dump_u64(data, rtc->halt_date);
+    data = dump_u8(data, rtc->latch);
+    data = dump_u8(data, rtc->latched_date.seconds);
+    data = dump_u8(data, rtc->latched_date.minutes);
+    data = dump_u8(data, rtc->latched_date.hours);
+    data = dump_u8(data, rtc->latched_date.days_low);
+    dump_u8(data, rtc->latched_date.days_high);
 }
 
 void load_rtc(struct emulator *gameboy, FILE *file) {
@@ -9,74 +9,24 @@
 #include "emulator.h"
 #include "sdl.h"
 
-#define UPSCALE_FACTOR 4
+#define UPSCALE_FACTOR 4 // initial size of the window ; the renderer scales the canvas to whatever the window is
+#define SDL_RGB555_COLOURS 0x8000
+#define SDL_AUDIO_RATE 48000 // preferred device rate ; the SPU frames are resampled to whatever the device picks
+#define SDL_AUDIO_FRAMES 512 // frames the device asks for at a time ; about 11ms
+#define SDL_AUDIO_RING_FRAMES 2048 // the rate control keeps the ring about half full ; about 21ms
+#define SDL_SUBSYSTEMS (SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER | SDL_INIT_AUDIO) // reference counted by SDL ; every UI initializes and quits its own
 
 struct sdl_context {
     SDL_Window *window;
     SDL_Renderer *renderer;
     SDL_Texture *canvas;
+    enum sdl_filter filter;
+    uint32_t rgb555_to_xrgb8888[SDL_RGB555_COLOURS]; // every colour the PPU can output
+    uint32_t native[GB_LCD_WIDTH * GB_LCD_HEIGHT]; // frame converted to XRGB8888 before it goes through the filter
     SDL_GameController *controller;
     SDL_AudioSpec audio_spec;
     SDL_AudioDeviceID audio_device;
-    uint32_t pixels[GB_LCD_WIDTH * GB_LCD_HEIGHT * UPSCALE_FACTOR * UPSCALE_FACTOR];
-    unsigned audio_buffer_index;
-} sdl_context;
-
-static void draw_line_dmg(struct emulator *gameboy, unsigned ly, union lcd_colour line[GB_LCD_WIDTH]) {
-    struct sdl_context *context = gameboy->ui.data;
-
-    static const uint32_t colour_map[4] = {
-        [WHITE] = 0xFF75A32C,
-        [LIGHT_GREY] = 0xFF387A21,
-        [DARK_GREY] = 0xFF255116,
-        [BLACK] = 0xFF12280B,
-    };
-
-    for (unsigned i = 0; i < GB_LCD_WIDTH; i++) {
-        for (unsigned y = 0; y < UPSCALE_FACTOR; y++) {
-            for (unsigned x = 0; x < UPSCALE_FACTOR; x++) {
-                context->pixels[(ly + y) * GB_LCD_WIDTH * UPSCALE_FACTOR + i + x] = colour_map[line[i].dmg];
-            }
-        }
-    }
-}
-
-static uint32_t sdl_5_to_8bits(uint32_t value) {
-    return (value << 3) | (value >> 2);
-}
-
-static uint32_t gbc_to_xrgb8888(uint16_t colour) {
-    uint32_t r = colour & 0x1F;
-    uint32_t g = (colour >> 5) & 0x1F;
-    uint32_t b = (colour >> 10) & 0x1F;
-    uint32_t p;
-
-    // extend from 5 to 8 bits
-    r = sdl_5_to_8bits(r);
-    g = sdl_5_to_8bits(g);
-    b = sdl_5_to_8bits(b);
-
-    p = 0xFF000000;
-    p |= r << 16;
-    p |= g << 8;
-    p |= b;
-
-    return p;
-}
-
-static void draw_line_gbc(struct emulator *gameboy, unsigned ly, union lcd_colour line[GB_LCD_WIDTH]) {
-    struct sdl_context *context = gameboy->ui.data;
-
-    for (unsigned i = 0; i < GB_LCD_WIDTH; i++) {
-        uint16_t colour = line[i].gbc;
-
-        for (unsigned y = 0; y < UPSCALE_FACTOR; y++) {
-            for (unsigned x = 0; x < UPSCALE_FACTOR; x++) {
-                context->pixels[(ly + y) * GB_LCD_WIDTH * UPSCALE_FACTOR + i + x] = gbc_to_xrgb8888(colour);
-            }
-        }
-    }
-}
+};
 
 static void handle_key(struct emulator *gameboy, SDL_Keycode key, bool pressed) {
     switch (key) {
@@ -112,6 +62,24 @@ static void handle_key(struct emulator *gameboy, SDL_Keycode key, bool pressed)
         case SDLK_RIGHT:
             set_gamepad(gameboy, GB_INPUT_RIGHT, pressed);
             break;
+        case SDLK_BACKSPACE:
+            gameboy->rewind.rewinding = pressed;
+            break;
+        case SDLK_TAB:
+            if (pressed) {
+                set_emulator_turbo(gameboy, !gameboy->speed.turbo);
+            }
+            break;
+        case SDLK_MINUS:
+            if (pressed && gameboy->speed.speed != GB_SPEED_UNBOUNDED) {
+                set_emulator_speed(gameboy, gameboy->speed.speed / 2);
+            }
+            break;
+        case SDLK_EQUALS:
+            if (pressed && gameboy->speed.speed != GB_SPEED_UNBOUNDED) {
+                set_emulator_speed(gameboy, gameboy->speed.speed * 2);
+            }
+            break;
     }
 }
 
@@ -142,6 +110,14 @@ static void handle_button(struct emulator *gameboy, unsigned button, bool presse
         case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
             set_gamepad(gameboy, GB_INPUT_RIGHT, pressed);
             break;
+        case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
+            gameboy->rewind.rewinding = pressed;
+            break;
+        case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
+            if (pressed) {
+                set_emulator_turbo(gameboy, !gameboy->speed.turbo);
+            }
+            break;
     }
 }
 
@@ -205,7 +181,10 @@ static void refresh_gamepad(struct emulator *gameboy) {
                 break;
             case SDL_KEYDOWN:
             case SDL_KEYUP:
-                handle_key(gameboy, event.key.keysym.sym, (event.key.state == SDL_PRESSED));
+                // held keys repeat ; the toggles would flip back and forth
+                if (event.key.repeat == 0) {
+                    handle_key(gameboy, event.key.keysym.sym, (event.key.state == SDL_PRESSED));
+                }
                 break;
             case SDL_CONTROLLERBUTTONDOWN:
             case SDL_CONTROLLERBUTTONUP:
@@ -221,11 +200,84 @@ static void refresh_gamepad(struct emulator *gameboy) {
     }
 }
 
-static void flip(struct emulator *gameboy) {
+static void init_sdl_colours(struct sdl_context *context) {
+    for (uint32_t colour = 0; colour < SDL_RGB555_COLOURS; colour++) {
+        // extend from 5 to 8 bits
+        uint32_t r = colour & 0x1F;
+        uint32_t g = (colour >> 5) & 0x1F;
+        uint32_t b = (colour >> 10) & 0x1F;
+
+        r = (r << 3) | (r >> 2);
+        g = (g << 3) | (g >> 2);
+        b = (b << 3) | (b >> 2);
+
+        context->rgb555_to_xrgb8888[colour] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+// convert a frame to XRGB8888 lines of pitch bytes
+static void convert_sdl_frame(struct sdl_context *context, const struct gameboy_frame *frame, uint32_t *pixels, unsigned pitch) {
+    for (unsigned y = 0; y < GB_LCD_HEIGHT; y++) {
+        const uint16_t *source = (const uint16_t *)((const uint8_t *)frame->pixels + y * frame->pitch);
+        uint32_t *destination = (uint32_t *)((uint8_t *)pixels + y * pitch);
+
+        for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+            destination[x] = context->rgb555_to_xrgb8888[source[x] & 0x7FFF];
+        }
+    }
+}
+
+// Scale2x ; doubles the frame and rounds off diagonal edges without blurring the pixel art
+static void scale2x_sdl_frame(const uint32_t *source, uint32_t *pixels, unsigned pitch) {
+    for (unsigned y = 0; y < GB_LCD_HEIGHT; y++) {
+        const uint32_t *line = source + y * GB_LCD_WIDTH;
+        const uint32_t *above = (y > 0) ? line - GB_LCD_WIDTH : line;
+        const uint32_t *below = (y < GB_LCD_HEIGHT - 1) ? line + GB_LCD_WIDTH : line;
+        uint32_t *top = (uint32_t *)((uint8_t *)pixels + y * 2 * pitch);
+        uint32_t *bottom = (uint32_t *)((uint8_t *)pixels + (y * 2 + 1) * pitch);
+
+        for (unsigned x = 0; x < GB_LCD_WIDTH; x++) {
+            uint32_t p = line[x];
+            uint32_t a = above[x];
+            uint32_t d = below[x];
+            uint32_t c = line[(x > 0) ? x - 1 : x];
+            uint32_t b = line[(x < GB_LCD_WIDTH - 1) ? x + 1 : x];
+
+            if (a != d && c != b) {
+                top[x * 2 + 0] = (c == a) ? a : p;
+                top[x * 2 + 1] = (a == b) ? b : p;
+                bottom[x * 2 + 0] = (c == d) ? c : p;
+                bottom[x * 2 + 1] = (d == b) ? d : p;
+            } else {
+                top[x * 2 + 0] = p;
+                top[x * 2 + 1] = p;
+                bottom[x * 2 + 0] = p;
+                bottom[x * 2 + 1] = p;
+            }
+        }
+    }
+}
+
+static void flip(struct emulator *gameboy, const struct gameboy_frame *frame) {
     struct sdl_context *context = gameboy->ui.data;
+    void *pixels;
+    int pitch;
 
-    SDL_UpdateTexture(context->canvas, NULL, context->pixels, GB_LCD_WIDTH * UPSCALE_FACTOR * sizeof(context->pixels[0])); // copy pixels to canvas
-    SDL_RenderCopy(context->renderer, context->canvas, NULL, NULL); // render canvas
+    // write straight into the streaming texture
+    if (SDL_LockTexture(context->canvas, NULL, &pixels, &pitch) < 0) {
+        fprintf(stderr, "SDL_LockTexture failed: %s\n", SDL_GetError());
+        return;
+    }
+
+    if (context->filter == GB_SDL_FILTER_SCALE2X) {
+        convert_sdl_frame(context, frame, context->native, GB_LCD_WIDTH * sizeof(context->native[0]));
+        scale2x_sdl_frame(context->native, pixels, pitch);
+    } else {
+        convert_sdl_frame(context, frame, pixels, pitch);
+    }
+
+    SDL_UnlockTexture(context->canvas);
+    SDL_RenderCopy(context->renderer, context->canvas, NULL, NULL); // render canvas ; the renderer scales it to the window
     SDL_RenderPresent(context->renderer);
 }
 
@@ -236,10 +288,11 @@ static void destroy(struct emulator *gameboy) {
         SDL_GameControllerClose(context->controller);
     }
 
+    SDL_CloseAudioDevice(context->audio_device); // waits for the callback ; it must not read the ring of a destroyed emulator
     SDL_DestroyTexture(context->canvas);
     SDL_DestroyRenderer(context->renderer);
     SDL_DestroyWindow(context->window);
-    SDL_Quit();
+    SDL_QuitSubSystem(SDL_SUBSYSTEMS); // other UIs of the process keep SDL running
 
     free(context);
 
@@ -248,22 +301,17 @@ static void destroy(struct emulator *gameboy) {
 
 static void audio_callback(void *userdata, Uint8 *stream, int length) {
     struct emulator *gameboy = userdata;
-    struct sdl_context *context = gameboy->ui.data;
-    struct spu_sample_buffer *buffer = &gameboy->spu.buffers[context->audio_buffer_index];
-
-    if (sem_trywait(&buffer->ready) == 0) {
-        memcpy(stream, buffer->samples, sizeof(buffer->samples));
-        sem_post(&buffer->free); // refill SPU buffer
+    int16_t (*frames)[2] = (int16_t (*)[2])stream;
+    unsigned count = length / sizeof(*frames);
+    unsigned copied = read_spu_samples(gameboy, frames, count);
 
-        context->audio_buffer_index = (context->audio_buffer_index + 1) % GB_SPU_SAMPLE_BUFFER_COUNT; // continue to next buffer
-    } else {
-        memset(stream, 0, sizeof(buffer->samples)); // buffer is not ready
-    }
+    memset(frames + copied, 0, (count - copied) * sizeof(*frames)); // the SPU fell behind ; only the missing frames are silent
 }
 
-void init_sdl_ui(struct emulator *gameboy) {
+void init_sdl_ui(struct emulator *gameboy, enum sdl_filter filter) {
     struct sdl_context *context;
     SDL_AudioSpec want;
+    unsigned canvas_scale = (filter == GB_SDL_FILTER_SCALE2X) ? 2 : 1;
 
     context = malloc(sizeof(*context));
     if (context == NULL) {
@@ -272,10 +320,12 @@ void init_sdl_ui(struct emulator *gameboy) {
     }
 
     gameboy->ui.data = context;
-    context->audio_buffer_index = 0;
+    context->filter = filter;
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER | SDL_INIT_AUDIO) < 0) {
-        fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+    init_sdl_colours(context);
+
+    if (SDL_InitSubSystem(SDL_SUBSYSTEMS) < 0) {
+        fprintf(stderr, "SDL_InitSubSystem failed: %s\n", SDL_GetError());
         exit(EXIT_FAILURE);
     }
 
@@ -286,7 +336,13 @@ void init_sdl_ui(struct emulator *gameboy) {
 
     SDL_SetWindowTitle(context->window, "GameBoy C");
 
-    context->canvas = SDL_CreateTexture(context->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, GB_LCD_WIDTH, GB_LCD_HEIGHT);
+    // nearest neighbour scaling by whole factors keeps the pixels square and sharp
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+    SDL_RenderSetLogicalSize(context->renderer, GB_LCD_WIDTH, GB_LCD_HEIGHT);
+    SDL_RenderSetIntegerScale(context->renderer, SDL_TRUE);
+
+    context->canvas = SDL_CreateTexture(context->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, GB_LCD_WIDTH * canvas_scale,
+            GB_LCD_HEIGHT * canvas_scale);
     
     if (context->canvas == NULL) {
         fprintf(stderr, "SDL_CreateTexture failed: %s\n", SDL_GetError());
@@ -294,30 +350,36 @@ void init_sdl_ui(struct emulator *gameboy) {
     }
 
     SDL_memset(&want, 0, sizeof(want));
-    want.freq = GB_SPU_SAMPLE_RATE_HZ;
+    want.freq = SDL_AUDIO_RATE;
     want.format = AUDIO_S16SYS;
     want.channels = 2;
-    want.samples = GB_SPU_SAMPLE_BUFFER_LENGTH;
+    want.samples = SDL_AUDIO_FRAMES;
     want.callback = audio_callback;
     want.userdata = gameboy;
-    context->audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &context->audio_spec, 0);
+    set_spu_sample_ring(gameboy, SDL_AUDIO_RING_FRAMES);
+
+    // take the device's native rate so SDL doesn't resample a second time
+    context->audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &context->audio_spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
 
     if (context->audio_device == 0) {
         fprintf(stderr, "SDL_OpenAudioDevice failed: %s\n", SDL_GetError());
         exit(EXIT_FAILURE);
     }
 
+    set_spu_output_rate(gameboy, context->audio_spec.freq);
+
     // start audio
     SDL_PauseAudioDevice(context->audio_device, 0);
 
-    gameboy->ui.draw_line_dmg = draw_line_dmg;
-    gameboy->ui.draw_line_gbc = draw_line_gbc;
     gameboy->ui.flip = flip;
     gameboy->ui.refresh_gamepad = refresh_gamepad;
     gameboy->ui.destroy = destroy;
 
-    memset(context->pixels, 0, sizeof(context->pixels)); // clear canvas
-    flip(gameboy);
+    set_ppu_framebuffer(gameboy, GB_PIXEL_RGB555, 2); // converted through rgb555_to_xrgb8888 ; frames are presented right away so two buffers are enough
+
+    // clear canvas
+    SDL_RenderClear(context->renderer);
+    SDL_RenderPresent(context->renderer);
 
     context->controller = NULL;
     
@@ -0,0 +1,165 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <string.h>
+
+#include "emulator.h"
+
+// the sink stays plugged in across resets ; it belongs to the UI
+void reset_serial(struct emulator *gameboy) {
+    struct gameboy_serial *serial = &gameboy->serial;
+
+    serial->data = 0;
+    serial->running = false;
+    serial->fast_clock = false;
+    serial->internal_clock = false;
+    serial->remaining = 0;
+}
+
+// the 8 bits were shifted out ; the byte shifted in replaces them all at once
+static void finish_serial_transfer(struct emulator *gameboy, uint8_t received) {
+    struct gameboy_serial *serial = &gameboy->serial;
+
+    serial->data = received;
+    serial->running = false;
+    serial->remaining = 0;
+
+    trigger_interrupt_request(gameboy, GB_INTERRUPT_REQUEST_SERIAL);
+}
+
+void sync_serial(struct emulator *gameboy) {
+    struct gameboy_serial *serial = &gameboy->serial;
+    int32_t elapsed = resync_sync(gameboy, GB_SYNC_SERIAL);
+    int32_t next = GB_SYNC_NEVER;
+
+    if (serial->running && serial->internal_clock) {
+        if ((uint32_t)elapsed < serial->remaining) {
+            serial->remaining -= elapsed;
+            next = serial->remaining;
+        } else {
+            bool linked = gameboy->link.connected;
+            uint8_t received = linked ? finish_link_transfer(gameboy) : 0xFF;
+            uint8_t answer = (serial->sink != NULL) ? serial->sink(gameboy, serial->data, serial->sink_data) : 0xFF;
+
+            finish_serial_transfer(gameboy, linked ? received : answer);
+        }
+    }
+
+    // transfers on the external clock are clocked by the other side of the cable ; it is checked regularly for them
+    if (gameboy->link.connected) {
+        int32_t poll = poll_link(gameboy);
+
+        if (poll < next) {
+            next = poll;
+        }
+    }
+
+    sync_next(gameboy, GB_SYNC_SERIAL, next);
+}
+
+// the other side of the cable shifted value in on the external clock ; returns the byte shifted out, 0xFF if no transfer was waiting
+uint8_t clock_serial_transfer(struct emulator *gameboy, uint8_t value) {
+    struct gameboy_serial *serial = &gameboy->serial;
+    uint8_t sent = serial->data;
+
+    if (!serial->running || serial->internal_clock) {
+        return 0xFF;
+    }
+
+    if (serial->sink != NULL) {
+        serial->sink(gameboy, sent, serial->sink_data); // only watches ; the byte received comes from the cable
+    }
+
+    finish_serial_transfer(gameboy, value);
+
+    return sent;
+}
+
+void set_serial_sink(struct emulator *gameboy, serial_sink sink, void *data) {
+    gameboy->serial.sink = sink;
+    gameboy->serial.sink_data = data;
+}
+
+void set_serial_control(struct emulator *gameboy, uint8_t control) {
+    struct gameboy_serial *serial = &gameboy->serial;
+
+    sync_serial(gameboy);
+
+    serial->running = control & 0x80;
+    serial->fast_clock = gameboy->gbc && (control & 0x02);
+    serial->internal_clock = control & 0x01;
+
+    if (serial->running) {
+        serial->remaining = 8 * (serial->fast_clock ? GB_SERIAL_FAST_BIT_CYCLES : GB_SERIAL_BIT_CYCLES);
+    }
+
+    if (serial->running && serial->internal_clock) {
+        start_link_transfer(gameboy, serial->data, gameboy->timestamp + serial->remaining);
+    }
+
+    update_link_listening(gameboy, serial->running && !serial->internal_clock);
+
+    sync_serial(gameboy);
+}
+
+uint8_t get_serial_control(struct emulator *gameboy) {
+    struct gameboy_serial *serial = &gameboy->serial;
+    uint8_t control = gameboy->gbc ? 0x7C : 0x7E; // unused bits read as 1 ; the clock speed bit only exists on GBC
+
+    sync_serial(gameboy);
+
+    if (serial->running) {
+        control |= 0x80;
+    }
+
+    if (serial->fast_clock) {
+        control |= 0x02;
+    }
+
+    if (serial->internal_clock) {
+        control |= 0x01;
+    }
+
+    return control;
+}
+
+static bool has_serial_suffix(const struct serial_capture *capture, const char *suffix) {
+    size_t length = strlen(suffix);
+
+    return capture->length >= length && memcmp(capture->text + capture->length - length, suffix, length) == 0;
+}
+
+// nothing answers ; the console receives 0xFF like with no cable
+uint8_t capture_serial(struct emulator *gameboy, uint8_t value, void *data) {
+    struct serial_capture *capture = data;
+
+    if (capture->echo) {
+        putchar(value);
+        fflush(stdout);
+    }
+
+    if (capture->length == GB_SERIAL_CAPTURE_LENGTH) {
+        capture->length = GB_SERIAL_CAPTURE_LENGTH / 2;
+        memmove(capture->text, capture->text + GB_SERIAL_CAPTURE_LENGTH / 2, capture->length);
+    }
+
+    capture->text[capture->length++] = value;
+    capture->text[capture->length] = '\0';
+
+    if (capture->verdict == GB_SERIAL_VERDICT_NONE) {
+        if (has_serial_suffix(capture, "Passed")) {
+            capture->verdict = GB_SERIAL_VERDICT_PASSED;
+        } else if (has_serial_suffix(capture, "Failed")) {
+            capture->verdict = GB_SERIAL_VERDICT_FAILED;
+        }
+
+        if (capture->verdict != GB_SERIAL_VERDICT_NONE && capture->stop) {
+            gameboy->quit = true;
+        }
+    }
+
+    return 0xFF;
+}
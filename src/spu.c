@@ -4,9 +4,24 @@
  * February 15, 2023
  */
 
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "emulator.h"
 
 #define SPU_NPHASES 16
+#define SPU_BLEP_CUTOFF 0.45 // in cycles per sample ; what folds back below 20kHz is far into the stop band, the rest is removed by the resampler
+
+static const uint8_t spu_rectangle_waveforms[4][SPU_NPHASES / 2] = {
+    {1, 0, 0, 0, 0, 0, 0, 0}, // 1/8
+    {1, 1, 0, 0, 0, 0, 0, 0}, // 1/4
+    {1, 1, 1, 1, 0, 0, 0, 0}, // 1/2
+    {1, 1, 1, 1, 1, 1, 0, 0}, // 3/4
+};
 
 void update_spu_sound_amp(struct emulator *gameboy) {
     struct gameboy_spu *spu = &gameboy->spu;
@@ -40,17 +55,23 @@ static void reload_spu_frequency(struct spu_divider *f) {
     f->counter = 2 * (0x800U - f->offset);
 }
 
-static void reload_spu_lfsr_counter(struct spu_nr4 *nr4) {
+// cycles between two LFSR shifts
+static uint32_t get_spu_lfsr_period(const struct spu_nr4 *nr4) {
     uint8_t div = nr4->lfsr_configuration & 7;
     uint8_t shift = (nr4->lfsr_configuration >> 4) + 1;
+    uint32_t period;
 
     if (div == 0) {
-        nr4->counter = 4;
+        period = 4;
     } else {
-        nr4->counter = 8 * div;
+        period = 8 * div;
     }
 
-    nr4->counter <<= shift;
+    return period << shift;
+}
+
+static void reload_spu_lfsr_counter(struct spu_nr4 *nr4) {
+    nr4->counter = get_spu_lfsr_period(nr4);
 }
 
 void reload_spu_sweep(struct spu_sweep *f, uint8_t configuration) {
@@ -61,6 +82,39 @@ void reload_spu_sweep(struct spu_sweep *f, uint8_t configuration) {
     f->counter = 0x8000 * f->time;
 }
 
+// windowed sinc impulse for each position of a level change between two samples
+static void init_spu_blep(struct spu_blep *blep) {
+    for (unsigned phase = 0; phase < GB_SPU_BLEP_PHASES; phase++) {
+        int32_t *kernel = blep->kernel[phase];
+        double impulse[GB_SPU_BLEP_TAPS];
+        double sum = 0;
+        int32_t total = 0;
+        unsigned centre = GB_SPU_BLEP_TAPS / 2 - 1;
+
+        for (unsigned tap = 0; tap < GB_SPU_BLEP_TAPS; tap++) {
+            // distance from the level change to the sample ; the change is delayed by GB_SPU_BLEP_TAPS / 2 - 1 samples so the kernel is causal
+            double t = (int)tap - (int)centre - (double)phase / GB_SPU_BLEP_PHASES;
+            double x = 2 * SPU_BLEP_CUTOFF * t;
+            double window = 0.42 + 0.5 * cos(2 * M_PI * t / GB_SPU_BLEP_TAPS) + 0.08 * cos(4 * M_PI * t / GB_SPU_BLEP_TAPS); // Blackman
+
+            impulse[tap] = window * ((x == 0) ? 1 : sin(M_PI * x) / (M_PI * x));
+            sum += impulse[tap];
+        }
+
+        for (unsigned tap = 0; tap < GB_SPU_BLEP_TAPS; tap++) {
+            kernel[tap] = (int32_t)lrint(impulse[tap] / sum * 0x8000);
+            total += kernel[tap];
+        }
+
+        // rounding errors go to the largest tap so the step is exactly 1 once integrated
+        if (impulse[centre + 1] > impulse[centre]) {
+            centre++;
+        }
+
+        kernel[centre] += 0x8000 - total;
+    }
+}
+
 void reset_spu(struct emulator *gameboy) {
     struct gameboy_spu *spu = &gameboy->spu;
 
@@ -107,118 +161,132 @@ void reset_spu(struct emulator *gameboy) {
     spu->nr4.envelope_configuration = 0;
     spu->nr4.lfsr_configuration = 0;
     spu->nr4.lfsr = 0x7FFF;
-}
 
-void reload_spu_duration(struct spu_duration *d, unsigned duration_max, uint8_t t1) {
-    d->counter = (duration_max + 1 - t1) * 0x4000U;
+    // the step buffer isn't cleared ; the sounds that were playing fade out through it
+    init_spu_blep(&spu->blep);
+
+    if (spu->ring.mask == 0) {
+        set_spu_sample_ring(gameboy, GB_SPU_SAMPLE_RING_LENGTH); // the UI didn't pick a ring length
+    }
 }
 
-// run the duration counter if it's enabled ; returns true, if the counter reached zero and the channel should be disabled
-static bool update_spu_duration(struct spu_duration *d, unsigned duration_max, unsigned cycles) {
-    bool elapsed = false;
+// length is the number of frames the SPU can be ahead of the UI ; must be called before the UI starts reading
+void set_spu_sample_ring(struct emulator *gameboy, unsigned length) {
+    struct spu_sample_ring *ring = &gameboy->spu.ring;
 
-    if (!d->enable) {
-        return false;
+    if (length < GB_SPU_SAMPLE_RING_MIN_LENGTH || length > GB_SPU_SAMPLE_RING_MAX_LENGTH || (length & (length - 1)) != 0) {
+        fprintf(stderr, "Unsupported sample ring length %u\n", length);
+        exit(EXIT_FAILURE);
     }
 
-    while (cycles) {
-        if (d->counter > cycles) {
-            d->counter -= cycles;
-            cycles = 0;
-        } else {
-            elapsed = true;
-            cycles -= d->counter;
+    ring->mask = length - 1;
 
-            reload_spu_duration(d, duration_max, 0);
-        }
-    }
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->tail, 0);
 
-    return elapsed;
+    memset(ring->frames, 0, sizeof(ring->frames));
 }
 
-// update the frequency counter ; return the number of times it ran out
-static unsigned update_spu_frequency(struct spu_divider *f, unsigned cycles) {
-    unsigned count = 0;
+// copy up to count frames out of the ring ; called from the UI's audio thread, returns the number of frames copied
+unsigned read_spu_samples(struct emulator *gameboy, int16_t (*frames)[2], unsigned count) {
+    struct spu_sample_ring *ring = &gameboy->spu.ring;
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t available = atomic_load_explicit(&ring->head, memory_order_acquire) - tail; // frames are visible once head moves past them
+    uint32_t position = tail & ring->mask;
+    uint32_t first;
 
-    while (cycles) {
-        if (f->counter > cycles) {
-            f->counter -= cycles;
-            cycles = 0;
-        } else {
-            count++;
-            cycles -= f->counter;
+    if (count > available) {
+        count = available;
+    }
 
-            reload_spu_frequency(f);
-        }
+    // the frames may wrap around the end of the ring
+    first = ring->mask + 1 - position;
+    if (first > count) {
+        first = count;
     }
 
+    memcpy(frames, ring->frames[position], first * sizeof(*frames));
+    memcpy(frames + first, ring->frames[0], (count - first) * sizeof(*frames));
+
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release); // hand the space back to the SPU
+
     return count;
 }
 
-// update the sweep function and the frequency counter ; return the number of times it ran out
-static unsigned update_spu_sweep(struct spu_sweep *s, unsigned cycles, bool *disable) {
-    unsigned count = 0;
-    *disable = false;
+void reload_spu_duration(struct spu_duration *d, unsigned duration_max, uint8_t t1) {
+    d->counter = (duration_max + 1 - t1) * 0x4000U;
+}
+
+// run a counter which is reloaded with period every time it runs out ; returns the number of times it ran out
+static unsigned run_spu_counter(uint32_t *counter, uint32_t period, unsigned cycles) {
+    unsigned count;
 
-    if (s->time == 0) {
-        return update_spu_frequency(&s->divider, cycles); // sweep is disabled
+    // a counter which was never loaded is 0 and runs out right away, even if no time passes
+    if (*counter > cycles) {
+        *counter -= cycles;
+        return 0;
     }
 
-    // need to step the sweep function and the frequency function alongside since the frequency changes with the sweep
-    while (cycles) {
-        unsigned to_run = cycles;
+    cycles -= *counter;
 
-        if (s->counter < to_run) {
-            to_run = s->counter;
-        }
+    // short runs, such as a sample period, rarely wrap more than once ; avoid the division
+    if (cycles < period) {
+        *counter = period - cycles;
+        return 1;
+    }
 
-        if (s->divider.counter < to_run) {
-            to_run = s->divider.counter;
-        }
+    count = 1 + cycles / period;
+    *counter = period - cycles % period;
 
-        s->counter -= to_run;
-        if (s->counter == 0) {
-            uint16_t delta = s->divider.offset >> s->shift; // sweep step elapsed
+    return count;
+}
 
-            if (s->subtract) {
-                if (s->shift != 0 && delta <= s->divider.offset) {
-                    s->divider.offset -= delta;
-                }
-            } else {
-                uint32_t o = s->divider.offset;
+// run the duration counter if it's enabled ; returns true, if the counter reached zero and the channel should be disabled
+static bool update_spu_duration(struct spu_duration *d, unsigned duration_max, unsigned cycles) {
+    if (!d->enable) {
+        return false;
+    }
 
-                o += delta;
+    return run_spu_counter(&d->counter, (duration_max + 1) * 0x4000U, cycles) != 0;
+}
 
-                if (o > 0x7FF) {
-                    // if the addition overflows, then the sound is disabled
-                    *disable = true;
-                    break;
-                }
+// update the frequency counter ; return the number of times it ran out
+static unsigned update_spu_frequency(struct spu_divider *f, unsigned cycles) {
+    uint32_t counter = f->counter;
+    unsigned count = run_spu_counter(&counter, 2 * (0x800U - f->offset), cycles);
 
-                s->divider.offset = o;
-            }
+    f->counter = counter;
 
-            s->counter = 0x8000 * s->time; // reload counter
+    return count;
+}
+
+// sweep step elapsed ; returns true if the frequency overflowed and the sound must be disabled
+static bool step_spu_sweep(struct spu_sweep *s) {
+    uint16_t delta = s->divider.offset >> s->shift;
+
+    if (s->subtract) {
+        if (s->shift != 0 && delta <= s->divider.offset) {
+            s->divider.offset -= delta;
         }
+    } else {
+        uint32_t o = s->divider.offset;
 
-        count += update_spu_frequency(&s->divider, to_run);
-        cycles -= to_run;
-    }
+        o += delta;
 
-    return count;
-}
+        if (o > 0x7FF) {
+            return true; // if the addition overflows, then the sound is disabled
+        }
 
-static uint8_t spu_next_wave_sample(struct spu_rectangle_wave *wave, unsigned phase_steps) {
-    static const uint8_t waveforms[4][SPU_NPHASES / 2] = {
-        {1, 0, 0, 0, 0, 0, 0, 0}, // 1/8
-        {1, 1, 0, 0, 0, 0, 0, 0}, // 1/4
-        {1, 1, 1, 1, 0, 0, 0, 0}, // 1/2
-        {1, 1, 1, 1, 1, 1, 0, 0}, // 3/4
-    };
+        s->divider.offset = o;
+    }
 
-    wave->phase = (wave->phase + phase_steps) % SPU_NPHASES;
+    s->counter = 0x8000 * s->time; // reload counter
 
-    return waveforms[wave->duty_cycle][wave->phase / 2];
+    return false;
+}
+
+static uint8_t get_spu_wave_sample(const struct spu_rectangle_wave *wave) {
+    return spu_rectangle_waveforms[wave->duty_cycle][wave->phase / 2];
 }
 
 static void spu_envelope_reload_counter(struct spu_envelope *e) {
@@ -242,260 +310,546 @@ static bool spu_envelope_active(struct spu_envelope *e) {
 // run the envelope if it's enabled ; returns true, if the envelope reached an inactive state and the channel should be disabled
 static bool spu_envelope_update(struct spu_envelope *e, unsigned cycles) {
     if (e->step_duration != 0) {
-        while (cycles) {
-            if (e->counter > cycles) {
-                e->counter -= cycles;
-                cycles = 0;
-            } else {
-                // step counter elapsed ; apply envelope function
-                cycles -= e->counter;
-
-                if (e->increment) {
-                        if (e->value < 0xf) {
-                            e->value++;
-                        }
-                } else {
-                        if (e->value > 0) {
-                            e->value--;
-                        }
-                }
+        unsigned steps = run_spu_counter(&e->counter, e->step_duration * 0x10000, cycles);
 
-                spu_envelope_reload_counter(e);
-            }
+        // the value saturates at both ends
+        if (e->increment) {
+            e->value = (e->value + steps > 0xF) ? 0xF : e->value + steps;
+        } else {
+            e->value = (steps > e->value) ? 0 : e->value - steps;
         }
     }
 
     return !spu_envelope_active(e);
 }
 
-static uint8_t spu_next_nr1_sample(struct emulator *gameboy, unsigned cycles) {
-    struct gameboy_spu *spu = &gameboy->spu;
+static uint8_t get_spu_nr3_sample(const struct spu_nr3 *nr3) {
     uint8_t sample;
-    unsigned sound_cycles;
-    bool disable;
-
-    // the duration counter runs even if the sound itself is not running
-    if (update_spu_duration(&spu->nr1.duration, GB_SPU_NR1_T1_MAX, cycles)) {
-        spu->nr1.running = false;
-    }
 
-    if (!spu->nr1.running) {
+    if (nr3->volume_shift == 0) {
+        // sound is muted
         return 0;
     }
 
-    if (spu_envelope_update(&spu->nr1.envelope, cycles)) {
-        spu->nr1.running = false;
+    // two samples are packed per byte
+    sample = nr3->ram[nr3->index / 2];
+
+    if (nr3->index & 1) {
+        sample &= 0xF;
+    } else {
+        sample >>= 4;
     }
 
-    if (!spu->nr1.running) {
-        return 0;
+    return sample >> (nr3->volume_shift - 1);
+}
+
+static void spu_lfsr_step(struct spu_nr4 *nr4) {
+    // true, if the lfsr only uses 7 bits for the effective register period
+    bool period_7bits = nr4->lfsr_configuration & 0x8;
+    uint16_t shifted;
+    uint16_t carry;
+
+    shifted = nr4->lfsr >> 1;
+    carry = (nr4->lfsr ^ shifted) & 1;
+
+    nr4->lfsr = shifted;
+    nr4->lfsr |= carry << 14;
+
+    if (period_7bits) {
+        // carry is also copied to bit 6
+        nr4->lfsr &= ~(1U << 6);
+        nr4->lfsr |= carry << 6;
     }
+}
 
-    sound_cycles = update_spu_sweep(&spu->nr1.sweep, cycles, &disable);
-    if (disable) {
-        spu->nr1.running = false;
-        return 0;
+// add a frame to the sample ring ; called by the SPU or the resampler
+void write_spu_sample_ring(struct emulator *gameboy, int16_t sample_left, int16_t sample_right) {
+    struct spu_sample_ring *ring = &gameboy->spu.ring;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    // the ring is full ; the UI fell behind so drop the frame rather than stall the emulation, the rate control brings the fill level back down
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) > ring->mask) {
+        return;
     }
 
-    sample = spu_next_wave_sample(&spu->nr1.wave, sound_cycles);
-    sample *= spu->nr1.envelope.value;
+    ring->frames[head & ring->mask][0] = sample_left;
+    ring->frames[head & ring->mask][1] = sample_right;
 
-    return sample;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release); // publish the frame
 }
 
-static uint8_t spu_next_nr2_sample(struct emulator *gameboy, unsigned cycles) {
+// send a pair of left / right samples to the ui
+static void send_spu_sample_to_ui(struct emulator *gameboy, int16_t sample_left, int16_t sample_right) {
     struct gameboy_spu *spu = &gameboy->spu;
-    uint8_t sample;
-    unsigned sound_cycles;
 
-    // the duration counter runs even if the sound itself is not running
-    if (update_spu_duration(&spu->nr2.duration, GB_SPU_NR2_T1_MAX, cycles)) {
-        spu->nr2.running = false;
+    if (spu->resampler.output_rate != 0) {
+        resample_spu_frame(gameboy, sample_left, sample_right);
+    } else {
+        write_spu_sample_ring(gameboy, sample_left, sample_right);
     }
+}
 
-    if (!spu->nr2.running) {
-        return 0;
-    }
+// true if the level changes of a sound make it to the output ; the others only need their counters to be right
+static bool is_spu_sound_audible(struct emulator *gameboy, unsigned sound) {
+    struct gameboy_spu *spu = &gameboy->spu;
+
+    return spu->synthesis != GB_SPU_SYNTHESIS_NONE && (spu->sound_amp[sound][0] | spu->sound_amp[sound][1]) != 0;
+}
+
+// add a band-limited step to the step buffer if the level changed
+static void set_spu_blep_level(struct gameboy_spu *spu, unsigned sound, unsigned time, uint8_t sample) {
+    struct spu_blep *blep = &spu->blep;
+    const int32_t *kernel = blep->kernel[time % GB_SPU_BLEP_PHASES];
+
+    for (unsigned channel = 0; channel < 2; channel++) {
+        int32_t level = sample * spu->sound_amp[sound][channel];
+        int32_t delta = level - blep->levels[sound][channel];
+        int32_t *deltas = &blep->deltas[channel][time / GB_SPU_BLEP_PHASES];
+
+        if (delta == 0) {
+            continue;
+        }
 
-    if (spu_envelope_update(&spu->nr2.envelope, cycles)) {
-        spu->nr2.running = false;
+        blep->levels[sound][channel] = level;
+
+        for (unsigned tap = 0; tap < GB_SPU_BLEP_TAPS; tap++) {
+            deltas[tap] += delta * kernel[tap];
+        }
     }
+}
 
-    if (!spu->nr2.running) {
-        return 0;
+// the sampling points before time keep the previous level ; sample i of the chunk is taken (i + 1) * GB_SPU_SAMPLE_RATE_DIVISOR cycles after its start
+static void set_spu_point_level(struct spu_point *point, unsigned sound, unsigned time, uint8_t sample) {
+    unsigned filled = (time + GB_SPU_SAMPLE_RATE_DIVISOR - 1) / GB_SPU_SAMPLE_RATE_DIVISOR;
+
+    if (sample == point->levels[sound]) {
+        return;
     }
 
-    sound_cycles = update_spu_frequency(&spu->nr2.divider, cycles);
+    if (filled > 0) {
+        filled--; // a level change on a sampling point is part of the sample
+    }
 
-    sample = spu_next_wave_sample(&spu->nr2.wave, sound_cycles);
-    sample *= spu->nr2.envelope.value;
+    if (filled > point->filled[sound]) {
+        memset(&point->samples[sound][point->filled[sound]], point->levels[sound], filled - point->filled[sound]);
+        point->filled[sound] = filled;
+    }
 
-    return sample;
+    point->levels[sound] = sample;
 }
 
-static uint8_t spu_next_nr3_sample(struct emulator *gameboy, unsigned cycles) {
+// move a sound to a new level time cycles after the start of the chunk
+static void set_spu_sound_level(struct emulator *gameboy, unsigned sound, unsigned time, uint8_t sample) {
     struct gameboy_spu *spu = &gameboy->spu;
-    uint8_t sample;
-    unsigned sound_cycles;
 
-    // the duration counter runs even if the sound itself is not running */
-    if (update_spu_duration(&spu->nr3.duration, GB_SPU_NR3_T1_MAX, cycles)) {
-        spu->nr3.running = false;
+    if (spu->synthesis == GB_SPU_SYNTHESIS_BLEP) {
+        set_spu_blep_level(spu, sound, time, sample);
+    } else if (spu->synthesis == GB_SPU_SYNTHESIS_POINT) {
+        set_spu_point_level(&spu->point, sound, time, sample);
     }
+}
 
-    if (!spu->nr3.running) {
-        return 0;
+// run the frequency divider of a rectangle wave for cycles and move the sound to the level of each phase as it's reached
+static void render_spu_rectangle(struct emulator *gameboy, unsigned sound, struct spu_rectangle_wave *wave, struct spu_divider *divider,
+        uint8_t volume, unsigned time, unsigned cycles) {
+    if (!is_spu_sound_audible(gameboy, sound)) {
+        // nobody hears the edges ; jump straight to the phase at the end of the run
+        wave->phase = (wave->phase + update_spu_frequency(divider, cycles)) % SPU_NPHASES;
+        return;
     }
 
-    sound_cycles = update_spu_frequency(&spu->nr3.divider, cycles);
+    while (divider->counter <= cycles) {
+        time += divider->counter;
+        cycles -= divider->counter;
 
-    spu->nr3.index = (spu->nr3.index + sound_cycles) % (GB_NR3_RAM_SIZE * 2);
+        reload_spu_frequency(divider);
+        wave->phase = (wave->phase + 1) % SPU_NPHASES;
 
-    if (spu->nr3.volume_shift == 0) {
-        // sound is muted
-        return 0;
+        set_spu_sound_level(gameboy, sound, time, get_spu_wave_sample(wave) * volume);
     }
 
-    // two samples are packed per byte
-    sample = spu->nr3.ram[spu->nr3.index / 2];
+    divider->counter -= cycles;
+}
 
-    if (spu->nr3.index & 1) {
-        sample &= 0xF;
-    } else {
-        sample >>= 4;
+// cycles until the next step of the duration counter or the envelope, at most cycles ; the sound's volume is constant until then
+static unsigned get_spu_control_run(const struct spu_duration *d, const struct spu_envelope *e, unsigned cycles) {
+    if (d->enable && d->counter < cycles) {
+        cycles = d->counter;
+    }
+
+    if (e != NULL && e->step_duration != 0 && e->counter < cycles) {
+        cycles = e->counter;
     }
 
-    return sample >> (spu->nr3.volume_shift - 1);
+    return cycles;
 }
 
-static void spu_lfsr_step(struct spu_nr4 *nr4) {
-    // true, if the lfsr only uses 7 bits for the effective register period
-    bool period_7bits = nr4->lfsr_configuration & 0x8;
-    uint16_t shifted;
-    uint16_t carry;
+static uint8_t get_spu_nr1_level(const struct spu_nr1 *nr1) {
+    return nr1->running ? get_spu_wave_sample(&nr1->wave) * nr1->envelope.value : 0;
+}
 
-    shifted = nr4->lfsr >> 1;
-    carry = (nr4->lfsr ^ shifted) & 1;
+static uint8_t get_spu_nr2_level(const struct spu_nr2 *nr2) {
+    return nr2->running ? get_spu_wave_sample(&nr2->wave) * nr2->envelope.value : 0;
+}
 
-    nr4->lfsr = shifted;
-    nr4->lfsr |= carry << 14;
+static uint8_t get_spu_nr3_level(const struct spu_nr3 *nr3) {
+    return nr3->running ? get_spu_nr3_sample(nr3) : 0;
+}
 
-    if (period_7bits) {
-        // carry is also copied to bit 6
-        nr4->lfsr &= ~(1U << 6);
-        nr4->lfsr |= carry << 6;
-    }
+static uint8_t get_spu_nr4_level(const struct spu_nr4 *nr4) {
+    return nr4->running ? (nr4->lfsr & 1) * nr4->envelope.value : 0;
 }
 
-static uint8_t spu_next_nr4_sample(struct emulator *gameboy, unsigned cycles) {
-    struct gameboy_spu *spu = &gameboy->spu;
-    uint8_t sample;
+// the render functions run a sound for cycles, splitting the run at every duration, envelope or sweep step so the counters are exact however
+// the time is sliced ; time is the position of the run in the chunk
+static void render_spu_nr1(struct emulator *gameboy, unsigned time, unsigned cycles) {
+    struct spu_nr1 *nr1 = &gameboy->spu.nr1;
 
-    // the duration counter runs even if the sound itself is not running
-    if (update_spu_duration(&spu->nr4.duration, GB_SPU_NR4_T1_MAX, cycles)) {
-        spu->nr4.running = false;
-    }
+    // runs at least once so a sound started with a silent envelope stops at the first sync, even if no time passed
+    while (nr1->running) {
+        unsigned run;
 
-    if (!spu->nr4.running) {
-        return 0;
+        // the sweep counter is left at 0 when a frequency overflow disabled the sound ; the step is applied again as soon as it restarts
+        if (nr1->sweep.time != 0 && nr1->sweep.counter == 0 && step_spu_sweep(&nr1->sweep)) {
+            nr1->running = false;
+            break;
+        }
+
+        run = get_spu_control_run(&nr1->duration, &nr1->envelope, cycles);
+
+        if (nr1->sweep.time != 0 && nr1->sweep.counter < run) {
+            run = nr1->sweep.counter;
+        }
+
+        set_spu_sound_level(gameboy, 0, time, get_spu_nr1_level(nr1));
+        render_spu_rectangle(gameboy, 0, &nr1->wave, &nr1->sweep.divider, nr1->envelope.value, time, run);
+
+        if (update_spu_duration(&nr1->duration, GB_SPU_NR1_T1_MAX, run) || spu_envelope_update(&nr1->envelope, run)) {
+            nr1->running = false;
+        } else if (nr1->sweep.time != 0) {
+            nr1->sweep.counter -= run;
+
+            if (nr1->sweep.counter == 0 && step_spu_sweep(&nr1->sweep)) {
+                nr1->running = false;
+            }
+        }
+
+        time += run;
+        cycles -= run;
+
+        if (cycles == 0) {
+            break;
+        }
     }
 
-    if (spu_envelope_update(&spu->nr4.envelope, cycles)) {
-        spu->nr4.running = false;
+    // the duration counter runs even if the sound itself is not running
+    update_spu_duration(&nr1->duration, GB_SPU_NR1_T1_MAX, cycles);
+
+    set_spu_sound_level(gameboy, 0, time, get_spu_nr1_level(nr1));
+}
+
+static void render_spu_nr2(struct emulator *gameboy, unsigned time, unsigned cycles) {
+    struct spu_nr2 *nr2 = &gameboy->spu.nr2;
+
+    while (nr2->running) {
+        unsigned run = get_spu_control_run(&nr2->duration, &nr2->envelope, cycles);
+
+        set_spu_sound_level(gameboy, 1, time, get_spu_nr2_level(nr2));
+        render_spu_rectangle(gameboy, 1, &nr2->wave, &nr2->divider, nr2->envelope.value, time, run);
+
+        if (update_spu_duration(&nr2->duration, GB_SPU_NR2_T1_MAX, run) || spu_envelope_update(&nr2->envelope, run)) {
+            nr2->running = false;
+        }
+
+        time += run;
+        cycles -= run;
+
+        if (cycles == 0) {
+            break;
+        }
     }
 
-    if (!spu->nr4.running) {
-        return 0;
+    // the duration counter runs even if the sound itself is not running
+    update_spu_duration(&nr2->duration, GB_SPU_NR2_T1_MAX, cycles);
+
+    set_spu_sound_level(gameboy, 1, time, get_spu_nr2_level(nr2));
+}
+
+static void render_spu_nr3(struct emulator *gameboy, unsigned time, unsigned cycles) {
+    struct spu_nr3 *nr3 = &gameboy->spu.nr3;
+
+    while (nr3->running) {
+        unsigned run = get_spu_control_run(&nr3->duration, NULL, cycles);
+
+        set_spu_sound_level(gameboy, 2, time, get_spu_nr3_level(nr3));
+
+        if (is_spu_sound_audible(gameboy, 2)) {
+            unsigned left = run;
+            unsigned t = time;
+
+            // step through the wave RAM
+            while (nr3->divider.counter <= left) {
+                t += nr3->divider.counter;
+                left -= nr3->divider.counter;
+
+                reload_spu_frequency(&nr3->divider);
+                nr3->index = (nr3->index + 1) % (GB_NR3_RAM_SIZE * 2);
+
+                set_spu_sound_level(gameboy, 2, t, get_spu_nr3_sample(nr3));
+            }
+
+            nr3->divider.counter -= left;
+        } else {
+            nr3->index = (nr3->index + update_spu_frequency(&nr3->divider, run)) % (GB_NR3_RAM_SIZE * 2);
+        }
+
+        if (update_spu_duration(&nr3->duration, GB_SPU_NR3_T1_MAX, run)) {
+            nr3->running = false;
+        }
+
+        time += run;
+        cycles -= run;
+
+        if (cycles == 0) {
+            break;
+        }
     }
 
-    while (cycles) {
-        if (spu->nr4.counter > cycles) {
-            spu->nr4.counter -= cycles;
-            cycles = 0;
+    // the duration counter runs even if the sound itself is not running
+    update_spu_duration(&nr3->duration, GB_SPU_NR3_T1_MAX, cycles);
+
+    set_spu_sound_level(gameboy, 2, time, get_spu_nr3_level(nr3));
+}
+
+static void render_spu_nr4(struct emulator *gameboy, unsigned time, unsigned cycles) {
+    struct gameboy_spu *spu = &gameboy->spu;
+    struct spu_nr4 *nr4 = &spu->nr4;
+
+    while (nr4->running) {
+        unsigned run = get_spu_control_run(&nr4->duration, &nr4->envelope, cycles);
+
+        set_spu_sound_level(gameboy, 3, time, get_spu_nr4_level(nr4));
+
+        if (is_spu_sound_audible(gameboy, 3)) {
+            unsigned left = run;
+            unsigned t = time;
+
+            // shift the LFSR ; the level only changes when its LSB does
+            while (nr4->counter <= left) {
+                t += nr4->counter;
+                left -= nr4->counter;
+
+                reload_spu_lfsr_counter(nr4);
+                spu_lfsr_step(nr4);
+
+                set_spu_sound_level(gameboy, 3, t, get_spu_nr4_level(nr4));
+            }
+
+            nr4->counter -= left;
         } else {
-            cycles -= spu->nr4.counter;
-            reload_spu_lfsr_counter(&spu->nr4);
-            spu_lfsr_step(&spu->nr4);
+            unsigned shifts = run_spu_counter(&nr4->counter, get_spu_lfsr_period(nr4), run);
+
+            // the LFSR only shapes the output ; it isn't worth shifting if no samples are produced
+            if (spu->synthesis != GB_SPU_SYNTHESIS_NONE) {
+                while (shifts--) {
+                    spu_lfsr_step(nr4);
+                }
+            }
+        }
+
+        if (update_spu_duration(&nr4->duration, GB_SPU_NR4_T1_MAX, run) || spu_envelope_update(&nr4->envelope, run)) {
+            nr4->running = false;
         }
+
+        time += run;
+        cycles -= run;
+
+        if (cycles == 0) {
+            break;
+        }
+    }
+
+    // the duration counter runs even if the sound itself is not running
+    update_spu_duration(&nr4->duration, GB_SPU_NR4_T1_MAX, cycles);
+
+    set_spu_sound_level(gameboy, 3, time, get_spu_nr4_level(nr4));
+}
+
+static void render_spu_sounds(struct emulator *gameboy, unsigned time, unsigned cycles) {
+    render_spu_nr1(gameboy, time, cycles);
+    render_spu_nr2(gameboy, time, cycles);
+    render_spu_nr3(gameboy, time, cycles);
+    render_spu_nr4(gameboy, time, cycles);
+}
+
+static int16_t get_spu_blep_sample(int32_t sum) {
+    int32_t sample = (sum + 0x4000) >> 15;
+
+    // the impulses ring slightly around steep edges
+    if (sample > INT16_MAX) {
+        return INT16_MAX;
     }
 
-    // sample is 0 if the LFSR's LSB is 0, otherwise it's the envelope's value
-    sample = spu->nr4.lfsr & 1;
-    sample *= spu->nr4.envelope.value;
+    if (sample < INT16_MIN) {
+        return INT16_MIN;
+    }
 
     return sample;
 }
 
-// send a pair of left / right samples to the ui
-static void send_spu_sample_to_ui(struct emulator *gameboy, int16_t sample_left, int16_t sample_right) {
-    struct gameboy_spu *spu = &gameboy->spu;
-    struct spu_sample_buffer *buffer;
+// integrate the first count samples of the step buffer, send them to the ui and move the rest of the buffer to the front
+static void flush_spu_blep(struct emulator *gameboy, unsigned count) {
+    struct spu_blep *blep = &gameboy->spu.blep;
+    unsigned length = GB_SPU_CHUNK + GB_SPU_BLEP_TAPS;
 
-    buffer = &spu->buffers[spu->buffer_index];
+    for (unsigned i = 0; i < count; i++) {
+        blep->sums[0] += blep->deltas[0][i];
+        blep->sums[1] += blep->deltas[1][i];
 
-    if (spu->sample_index == 0) {
-        sem_wait(&buffer->free); // wait unitl buffer is free, if necessary
+        send_spu_sample_to_ui(gameboy, get_spu_blep_sample(blep->sums[0]), get_spu_blep_sample(blep->sums[1]));
     }
 
-    buffer->samples[spu->sample_index][0] = sample_left;
-    buffer->samples[spu->sample_index][1] = sample_right;
+    for (unsigned channel = 0; channel < 2; channel++) {
+        memmove(blep->deltas[channel], blep->deltas[channel] + count, (length - count) * sizeof(int32_t));
+        memset(blep->deltas[channel] + length - count, 0, count * sizeof(int32_t));
+    }
+}
 
-    spu->sample_index++;
+// add the samples of a sound times its amplification to the stereo frames ; the 16 bits sums wrap exactly like the scalar mix
+static void mix_spu_point_sound(int16_t (*frames)[2], const uint8_t *samples, const int16_t amp[2], unsigned count) {
+    unsigned i = 0;
 
-    if (spu->sample_index == GB_SPU_SAMPLE_BUFFER_LENGTH) {
-        sem_post(&buffer->ready);
+#ifdef __SSE2__
+    __m128i amp_left = _mm_set1_epi16(amp[0]);
+    __m128i amp_right = _mm_set1_epi16(amp[1]);
 
-        spu->buffer_index = (spu->buffer_index + 1)% GB_SPU_SAMPLE_BUFFER_COUNT;
-        spu->sample_index = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i sample = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&samples[i]), _mm_setzero_si128());
+        __m128i left = _mm_mullo_epi16(sample, amp_left);
+        __m128i right = _mm_mullo_epi16(sample, amp_right);
+        __m128i *destination = (__m128i *)frames[i];
+
+        // interleave the channels back into frames
+        _mm_storeu_si128(destination, _mm_add_epi16(_mm_loadu_si128(destination), _mm_unpacklo_epi16(left, right)));
+        _mm_storeu_si128(destination + 1, _mm_add_epi16(_mm_loadu_si128(destination + 1), _mm_unpackhi_epi16(left, right)));
+    }
+#endif
+
+    for (; i < count; i++) {
+        frames[i][0] += samples[i] * amp[0];
+        frames[i][1] += samples[i] * amp[1];
     }
 }
 
-void sync_spu(struct emulator *gameboy) {
+// complete the first count samples of every sound, mix them and send them to the ui
+static void flush_spu_point(struct emulator *gameboy, unsigned count) {
     struct gameboy_spu *spu = &gameboy->spu;
-    int32_t elapsed = resync_sync(gameboy, GB_SYNC_SPU);
-    int32_t period = spu->sample_period;
-    int32_t nsamples;
-    int32_t next_sync;
+    struct spu_point *point = &spu->point;
+    int16_t frames[GB_SPU_CHUNK][2];
+    bool constant = true;
 
-    elapsed += period;
+    for (unsigned sound = 0; sound < 4; sound++) {
+        if (point->filled[sound] != 0 && is_spu_sound_audible(gameboy, sound)) {
+            constant = false;
+        }
+    }
+
+    if (constant) {
+        // no audible sound changed level ; the whole chunk is a single frame
+        frames[0][0] = 0;
+        frames[0][1] = 0;
+
+        for (unsigned sound = 0; sound < 4; sound++) {
+            frames[0][0] += point->levels[sound] * spu->sound_amp[sound][0];
+            frames[0][1] += point->levels[sound] * spu->sound_amp[sound][1];
+            point->filled[sound] = 0;
+        }
+
+        for (unsigned i = 1; i < count; i++) {
+            frames[i][0] = frames[0][0];
+            frames[i][1] = frames[0][1];
+        }
+    } else {
+        memset(frames, 0, count * sizeof(frames[0]));
 
-    nsamples = elapsed / GB_SPU_SAMPLE_RATE_DIVISOR;
+        for (unsigned sound = 0; sound < 4; sound++) {
+            if (is_spu_sound_audible(gameboy, sound)) {
+                memset(&point->samples[sound][point->filled[sound]], point->levels[sound], count - point->filled[sound]);
+                mix_spu_point_sound(frames, point->samples[sound], spu->sound_amp[sound], count);
+            }
 
-    while (nsamples--) {
-        int32_t next_sample_delay = GB_SPU_SAMPLE_RATE_DIVISOR - period;
-        unsigned sound;
-        int16_t sound_samples[4];
-        int16_t sample_l = 0;
-        int16_t sample_r = 0;
+            point->filled[sound] = 0;
+        }
+    }
 
-        sound_samples[0] = spu_next_nr1_sample(gameboy, next_sample_delay);
-        sound_samples[1] = spu_next_nr2_sample(gameboy, next_sample_delay);
-        sound_samples[2] = spu_next_nr3_sample(gameboy, next_sample_delay);
-        sound_samples[3] = spu_next_nr4_sample(gameboy, next_sample_delay);
+    for (unsigned i = 0; i < count; i++) {
+        send_spu_sample_to_ui(gameboy, frames[i][0], frames[i][1]);
+    }
+}
 
-        for (sound = 0; sound < 4; sound++) {
-            sample_l += sound_samples[sound] * spu->sound_amp[sound][0];
-            sample_r += sound_samples[sound] * spu->sound_amp[sound][1];
+// every sound runs from one level change to the next, chunk by chunk ; sounds that don't change or can't be heard cost almost nothing
+static void render_spu_chunks(struct emulator *gameboy, int32_t elapsed) {
+    struct gameboy_spu *spu = &gameboy->spu;
+    unsigned time = spu->sample_period; // cycles since the start of the chunk ; the last sample taken was at its start
+
+    // the sounds run even if no time passed so their running flags are updated
+    do {
+        unsigned run = GB_SPU_CHUNK * GB_SPU_SAMPLE_RATE_DIVISOR - time;
+        unsigned count;
+
+        if (run > (unsigned)elapsed) {
+            run = elapsed;
         }
 
-        send_spu_sample_to_ui(gameboy, sample_l, sample_r);
+        render_spu_sounds(gameboy, time, run);
+
+        time += run;
+        elapsed -= run;
 
-        period = 0;
+        // samples before the current time can't change anymore
+        count = time / GB_SPU_SAMPLE_RATE_DIVISOR;
+
+        if (count > 0) {
+            if (spu->synthesis == GB_SPU_SYNTHESIS_BLEP) {
+                flush_spu_blep(gameboy, count);
+            } else {
+                flush_spu_point(gameboy, count);
+            }
+        }
+
+        time %= GB_SPU_SAMPLE_RATE_DIVISOR;
+    } while (elapsed > 0);
+
+    spu->sample_period = time;
+}
+
+void sync_spu(struct emulator *gameboy) {
+    struct gameboy_spu *spu = &gameboy->spu;
+    int32_t elapsed = resync_sync(gameboy, GB_SYNC_SPU);
+    int32_t next_sync;
+
+    if (spu->synthesis == GB_SPU_SYNTHESIS_NONE) {
+        // every counter runs in closed form ; catch up in one go and wait for the CPU to access a register
+        render_spu_sounds(gameboy, 0, elapsed);
+        sync_next(gameboy, GB_SYNC_SPU, GB_SYNC_NEVER);
+        return;
     }
 
-    period = elapsed % GB_SPU_SAMPLE_RATE_DIVISOR;
+    render_spu_chunks(gameboy, elapsed);
+
+    if (spu->resampler.output_rate != 0) {
+        update_spu_rate_control(gameboy);
+    }
 
-    // advance the SPU state even if we don't want the sample yet in order to have the correct value for the running flags
-    spu_next_nr1_sample(gameboy, period);
-    spu_next_nr2_sample(gameboy, period);
-    spu_next_nr3_sample(gameboy, period);
-    spu_next_nr4_sample(gameboy, period);
+    // schedule a sync once a quarter of the ring has been consumed so the UI never runs dry while the CPU is ahead
+    next_sync = ((spu->ring.mask + 1) / 4) * GB_SPU_SAMPLE_RATE_DIVISOR;
 
-    spu->sample_period = period;
+    // below real time the ring drains in fewer emulated cycles
+    if (spu->resampler.output_rate != 0 && spu->resampler.speed != GB_SPEED_UNBOUNDED && spu->resampler.speed < 1) {
+        next_sync *= spu->resampler.speed;
+    }
 
-    // schedule a sync to fill the current buffer
-    next_sync = (GB_SPU_SAMPLE_BUFFER_LENGTH - spu->sample_index) * GB_SPU_SAMPLE_RATE_DIVISOR;
-    next_sync -= period;
+    next_sync -= spu->sample_period;
 
     sync_next(gameboy, GB_SYNC_SPU, next_sync);
 }
@@ -0,0 +1,499 @@
+/*
+ * Dylan Gilson
+ * dylan.gilson@outlook.com
+ * October 16, 2026
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "emulator.h"
+
+#define STATE_MAGIC 0x47425354U // "GBST"
+#define STATE_HEADER_LENGTH 19 // magic, version and the identity of the game
+#define STATE_ROM_CHECKSUM 0x14E // global checksum in the ROM header ; tells which game a state belongs to
+
+// position in a state buffer ; the same walk over the emulator saves or loads it, multi-byte values are stored big endian
+struct state_cursor {
+    uint8_t *out; // buffer being saved ; NULL when loading or only measuring the state
+    const uint8_t *in; // buffer being loaded ; NULL when saving
+    size_t position;
+};
+
+static void state_bytes(struct state_cursor *c, void *value, size_t size) {
+    if (c->in != NULL) {
+        memcpy(value, c->in + c->position, size);
+    } else if (c->out != NULL) {
+        memcpy(c->out + c->position, value, size);
+    }
+
+    c->position += size;
+}
+
+static void state_u8(struct state_cursor *c, uint8_t *value) {
+    state_bytes(c, value, 1);
+}
+
+static void state_bool(struct state_cursor *c, bool *value) {
+    uint8_t byte = *value;
+
+    state_u8(c, &byte);
+    *value = byte != 0;
+}
+
+static void state_u16(struct state_cursor *c, uint16_t *value) {
+    uint8_t bytes[2] = { *value >> 8, *value };
+
+    state_bytes(c, bytes, sizeof(bytes));
+    *value = (bytes[0] << 8) | bytes[1];
+}
+
+static void state_u32(struct state_cursor *c, uint32_t *value) {
+    uint8_t bytes[4];
+
+    for (unsigned i = 0; i < 4; i++) {
+        bytes[i] = *value >> (24 - i * 8);
+    }
+
+    state_bytes(c, bytes, sizeof(bytes));
+    *value = 0;
+
+    for (unsigned i = 0; i < 4; i++) {
+        *value = (*value << 8) | bytes[i];
+    }
+}
+
+static void state_u64(struct state_cursor *c, uint64_t *value) {
+    uint8_t bytes[8];
+
+    for (unsigned i = 0; i < 8; i++) {
+        bytes[i] = *value >> (56 - i * 8);
+    }
+
+    state_bytes(c, bytes, sizeof(bytes));
+    *value = 0;
+
+    for (unsigned i = 0; i < 8; i++) {
+        *value = (*value << 8) | bytes[i];
+    }
+}
+
+static void state_unsigned(struct state_cursor *c, unsigned *value) {
+    uint32_t word = *value;
+
+    state_u32(c, &word);
+    *value = word;
+}
+
+// the header identifies the game ; nothing is loaded if it doesn't match the running one
+static bool visit_state_header(struct state_cursor *c, struct emulator *gameboy) {
+    struct gameboy_cart *cart = &gameboy->cart;
+    uint32_t magic = STATE_MAGIC;
+    uint32_t version = GB_STATE_VERSION;
+    uint32_t rom_length = cart->rom_length;
+    uint16_t rom_checksum = (cart->rom[STATE_ROM_CHECKSUM] << 8) | cart->rom[STATE_ROM_CHECKSUM + 1];
+    uint32_t ram_length = cart->ram_length;
+    bool gbc = gameboy->gbc;
+
+    state_u32(c, &magic);
+    state_u32(c, &version);
+    state_u32(c, &rom_length);
+    state_u16(c, &rom_checksum);
+    state_u32(c, &ram_length);
+    state_bool(c, &gbc);
+
+    if (c->in == NULL) {
+        return true;
+    }
+
+    if (magic != STATE_MAGIC) {
+        fprintf(stderr, "Not a save state\n");
+        return false;
+    }
+
+    if (version != GB_STATE_VERSION) {
+        fprintf(stderr, "Unsupported save state version %u\n", (unsigned)version);
+        return false;
+    }
+
+    if (rom_length != cart->rom_length || rom_checksum != ((cart->rom[STATE_ROM_CHECKSUM] << 8) | cart->rom[STATE_ROM_CHECKSUM + 1])
+            || ram_length != cart->ram_length || gbc != gameboy->gbc) {
+        fprintf(stderr, "Save state belongs to another game\n");
+        return false;
+    }
+
+    return true;
+}
+
+// the date of every scheduled event is kept so the devices run exactly as they would have ; the heap is rebuilt when loading
+static void visit_sync_state(struct state_cursor *c, struct emulator *gameboy) {
+    struct gameboy_sync *sync = &gameboy->sync;
+    uint64_t next_events[GB_SYNC_NUM];
+
+    state_u64(c, &gameboy->timestamp);
+
+    for (unsigned i = 0; i < GB_SYNC_NUM; i++) {
+        next_events[i] = get_sync_next_event(gameboy, i); // UINT64_MAX if nothing is scheduled
+
+        state_u64(c, &sync->last_sync[i]);
+        state_u64(c, &next_events[i]);
+    }
+
+    if (c->in == NULL) {
+        return;
+    }
+
+    for (unsigned i = 0; i < GB_SYNC_NUM; i++) {
+        if (next_events[i] == UINT64_MAX) {
+            sync_cancel(gameboy, i);
+        } else {
+            sync_next(gameboy, i, (int32_t)(next_events[i] - gameboy->timestamp));
+        }
+    }
+}
+
+static void visit_cpu_state(struct state_cursor *c, struct emulator *gameboy) {
+    struct gameboy_cpu *cpu = &gameboy->cpu;
+    struct gameboy_interrupt_request *interrupt_request = &gameboy->interrupt_request;
+
+    state_bool(c, &cpu->interrupt_master_enable);
+    state_bool(c, &cpu->interrupt_request_enable_next);
+    state_bool(c, &cpu->halted);
+    state_u16(c, &cpu->program_counter);
+    state_u16(c, &cpu->stack_pointer);
+    state_u8(c, &cpu->a);
+    state_u8(c, &cpu->b);
+    state_u8(c, &cpu->c);
+    state_u8(c, &cpu->d);
+    state_u8(c, &cpu->e);
+    state_u8(c, &cpu->h);
+    state_u8(c, &cpu->l);
+    state_bool(c, &cpu->zero_flag);
+    state_bool(c, &cpu->null_flag);
+    state_bool(c, &cpu->half_carry_flag);
+    state_bool(c, &cpu->carry_flag);
+
+    state_u8(c, &interrupt_request->interrupt_request_flags);
+    state_u8(c, &interrupt_request->interrupt_request_enable);
+}
+
+static void visit_memory_state(struct state_cursor *c, struct emulator *gameboy) {
+    state_bytes(c, gameboy->internal_ram, sizeof(gameboy->internal_ram));
+    state_u8(c, &gameboy->internal_ram_high_bank);
+    state_bytes(c, gameboy->zero_page_ram, sizeof(gameboy->zero_page_ram));
+    state_bytes(c, gameboy->video_ram, sizeof(gameboy->video_ram));
+    state_bool(c, &gameboy->video_ram_high_bank);
+}
+
+static void visit_cart_state(struct state_cursor *c, struct emulator *gameboy) {
+    struct gameboy_cart *cart = &gameboy->cart;
+    struct gameboy_rtc *rtc = &cart->rtc;
+
+    state_unsigned(c, &cart->current_rom_bank);
+    state_unsigned(c, &cart->current_ram_bank);
+    state_bool(c, &cart->ram_write_protected);
+    state_bool(c, &cart->mbc1_bank_ram);
+    state_bytes(c, cart->ram, cart->ram_length);
+
+    if (cart->has_rtc) {
+        state_u64(c, &rtc->base);
+        state_u64(c, &rtc->halt_date);
+        state_bool(c, &rtc->latch);
+        state_u8(c, &rtc->latched_date.seconds);
+        state_u8(c, &rtc->latched_date.minutes);
+        state_u8(c, &rtc->latched_date.hours);
+        state_u8(c, &rtc->latched_date.days_low);
+        state_u8(c, &rtc->latched_date.days_high);
+    }
+}
+
+static void visit_colour_palette_state(struct state_cursor *c, struct colour_palette *palette) {
+    for (unsigned i = 0; i < 8; i++) {
+        for (unsigned j = 0; j < 4; j++) {
+            state_u16(c, &palette->colours[i][j]);
+        }
+    }
+
+    state_u8(c, &palette->write_index);
+    state_bool(c, &palette->auto_increment);
+}
+
+// the tile cache and the framebuffer are outputs of the PPU ; they aren't part of the state
+static void visit_ppu_state(struct state_cursor *c, struct emulator *gameboy) {
+    struct gameboy_ppu *ppu = &gameboy->ppu;
+
+    state_u8(c, &ppu->scroll_x);
+    state_u8(c, &ppu->scroll_y);
+    state_bool(c, &ppu->lyc_flag);
+    state_bool(c, &ppu->mode0_flag);
+    state_bool(c, &ppu->mode1_flag);
+    state_bool(c, &ppu->mode2_flag);
+    state_bool(c, &ppu->master_enable);
+    state_bool(c, &ppu->background_enable);
+    state_bool(c, &ppu->window_enable);
+    state_bool(c, &ppu->sprite_enable);
+    state_bool(c, &ppu->tall_sprites);
+    state_bool(c, &ppu->background_use_high_tile_map);
+    state_bool(c, &ppu->window_use_high_tile_map);
+    state_bool(c, &ppu->background_window_use_sprite_tile_set);
+    state_u8(c, &ppu->ly);
+    state_u8(c, &ppu->lyc);
+    state_u8(c, &ppu->background_palette);
+    state_u8(c, &ppu->sprite_palette0);
+    state_u8(c, &ppu->sprite_palette1);
+    state_u8(c, &ppu->window_x);
+    state_u8(c, &ppu->window_y);
+    state_u8(c, &ppu->window_line);
+    state_u16(c, &ppu->line_position);
+    state_u64(c, &ppu->frames);
+    state_bytes(c, ppu->oam, sizeof(ppu->oam));
+
+    visit_colour_palette_state(c, &ppu->background_palettes);
+    visit_colour_palette_state(c, &ppu->sprite_palettes);
+}
+
+static void visit_io_state(struct state_cursor *c, struct emulator *gameboy) {
+    struct gameboy_gamepad *gamepad = &gameboy->gamepad;
+    struct gameboy_dma *dma = &gameboy->dma;
+    struct gameboy_hdma *hdma = &gameboy->hdma;
+    struct gameboy_timer *timer = &gameboy->timer;
+    struct gameboy_serial *serial = &gameboy->serial;
+    uint8_t divider = timer->divider;
+
+    state_u8(c, &gamepad->dpad_state);
+    state_bool(c, &gamepad->dpad_selected);
+    state_u8(c, &gamepad->buttons_state);
+    state_bool(c, &gamepad->buttons_selected);
+
+    state_bool(c, &dma->running);
+    state_u16(c, &dma->source_address);
+    state_u8(c, &dma->position);
+
+    state_u16(c, &hdma->source_address);
+    state_u16(c, &hdma->destination_offset);
+    state_u8(c, &hdma->length);
+    state_bool(c, &hdma->run_on_hblank);
+
+    state_u16(c, &timer->divider_counter);
+    state_u8(c, &timer->counter);
+    state_u8(c, &timer->modulo);
+    state_u8(c, &divider);
+    state_bool(c, &timer->started);
+
+    timer->divider = divider;
+
+    // the sink is left as it is ; it belongs to the UI
+    state_u8(c, &serial->data);
+    state_bool(c, &serial->running);
+    state_bool(c, &serial->fast_clock);
+    state_bool(c, &serial->internal_clock);
+    state_u32(c, &serial->remaining);
+}
+
+static void visit_spu_duration_state(struct state_cursor *c, struct spu_duration *duration) {
+    state_bool(c, &duration->enable);
+    state_u32(c, &duration->counter);
+}
+
+static void visit_spu_divider_state(struct state_cursor *c, struct spu_divider *divider) {
+    state_u16(c, &divider->offset);
+    state_u16(c, &divider->counter);
+}
+
+static void visit_spu_envelope_state(struct state_cursor *c, struct spu_envelope *envelope) {
+    state_u8(c, &envelope->step_duration);
+    state_u8(c, &envelope->value);
+    state_bool(c, &envelope->increment);
+    state_u32(c, &envelope->counter);
+}
+
+// only the sounds are saved ; the samples on their way to the UI aren't part of the emulated machine
+static void visit_spu_state(struct state_cursor *c, struct emulator *gameboy) {
+    struct gameboy_spu *spu = &gameboy->spu;
+    struct spu_nr1 *nr1 = &spu->nr1;
+    struct spu_nr2 *nr2 = &spu->nr2;
+    struct spu_nr3 *nr3 = &spu->nr3;
+    struct spu_nr4 *nr4 = &spu->nr4;
+
+    state_bool(c, &spu->enable);
+    state_u8(c, &spu->sample_period);
+    state_u8(c, &spu->output_level);
+    state_u8(c, &spu->sound_mux);
+
+    state_bool(c, &nr1->running);
+    visit_spu_duration_state(c, &nr1->duration);
+    visit_spu_divider_state(c, &nr1->sweep.divider);
+    state_u8(c, &nr1->sweep.shift);
+    state_bool(c, &nr1->sweep.subtract);
+    state_u8(c, &nr1->sweep.time);
+    state_u32(c, &nr1->sweep.counter);
+    state_u8(c, &nr1->wave.phase);
+    state_u8(c, &nr1->wave.duty_cycle);
+    state_u8(c, &nr1->envelope_configuration);
+    visit_spu_envelope_state(c, &nr1->envelope);
+
+    state_bool(c, &nr2->running);
+    visit_spu_duration_state(c, &nr2->duration);
+    visit_spu_divider_state(c, &nr2->divider);
+    state_u8(c, &nr2->wave.phase);
+    state_u8(c, &nr2->wave.duty_cycle);
+    state_u8(c, &nr2->envelope_configuration);
+    visit_spu_envelope_state(c, &nr2->envelope);
+
+    state_bool(c, &nr3->enable);
+    state_bool(c, &nr3->running);
+    visit_spu_duration_state(c, &nr3->duration);
+    state_u8(c, &nr3->t1);
+    visit_spu_divider_state(c, &nr3->divider);
+    state_u8(c, &nr3->volume_shift);
+    state_bytes(c, nr3->ram, sizeof(nr3->ram));
+    state_u8(c, &nr3->index);
+
+    state_bool(c, &nr4->running);
+    visit_spu_duration_state(c, &nr4->duration);
+    state_u8(c, &nr4->envelope_configuration);
+    visit_spu_envelope_state(c, &nr4->envelope);
+    state_u16(c, &nr4->lfsr);
+    state_u8(c, &nr4->lfsr_configuration);
+    state_u32(c, &nr4->counter);
+}
+
+static bool visit_state(struct state_cursor *c, struct emulator *gameboy) {
+    if (!visit_state_header(c, gameboy)) {
+        return false;
+    }
+
+    visit_sync_state(c, gameboy);
+    visit_cpu_state(c, gameboy);
+    visit_memory_state(c, gameboy);
+    visit_cart_state(c, gameboy);
+    visit_ppu_state(c, gameboy);
+    visit_io_state(c, gameboy);
+    visit_spu_state(c, gameboy);
+
+    return true;
+}
+
+size_t save_state(struct emulator *gameboy, uint8_t *buffer, size_t length) {
+    struct state_cursor c = { NULL, NULL, 0 };
+
+    visit_state(&c, gameboy); // measure first so a buffer which is too small is left untouched
+
+    if (buffer != NULL && length >= c.position) {
+        c.out = buffer;
+        c.position = 0;
+
+        visit_state(&c, gameboy);
+    }
+
+    return c.position;
+}
+
+bool load_state(struct emulator *gameboy, const uint8_t *buffer, size_t length) {
+    struct state_cursor c = { NULL, buffer, 0 };
+
+    if (length < STATE_HEADER_LENGTH) {
+        fprintf(stderr, "Not a save state\n");
+        return false;
+    }
+
+    // the header is checked on its own first ; the length of the rest only depends on the game
+    if (!visit_state_header(&c, gameboy)) {
+        return false;
+    }
+
+    if (length != save_state(gameboy, NULL, 0)) {
+        fprintf(stderr, "Save state has the wrong length\n");
+        return false;
+    }
+
+    c.position = 0;
+
+    if (!visit_state(&c, gameboy)) {
+        return false;
+    }
+
+    // caches of the previous memory contents
+    for (unsigned i = 0; i < GB_PPU_TILE_BANKS * GB_PPU_TILES; i++) {
+        gameboy->ppu.tile_dirty[i] = true;
+    }
+
+    flush_cpu_ram_blocks(gameboy); // also maps the restored banks on the bus
+    update_spu_sound_amp(gameboy);
+
+    mark_cart_ram_dirty(gameboy, ~0U); // the battery save follows the loaded RAM
+
+    return true;
+}
+
+bool save_state_file(struct emulator *gameboy, const char *path) {
+    size_t length = save_state(gameboy, NULL, 0);
+    uint8_t *buffer = malloc(length);
+    FILE *file;
+    bool written;
+
+    if (buffer == NULL) {
+        perror("Save state memory allocation failed!\n");
+        return false;
+    }
+
+    save_state(gameboy, buffer, length);
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Can't create or open save state '%s': %s\n", path, strerror(errno));
+        free(buffer);
+        return false;
+    }
+
+    written = fwrite(buffer, 1, length, file) == length;
+
+    if (fclose(file) != 0) {
+        written = false;
+    }
+
+    if (!written) {
+        fprintf(stderr, "Can't write save state '%s'\n", path);
+    }
+
+    free(buffer);
+
+    return written;
+}
+
+bool load_state_file(struct emulator *gameboy, const char *path) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *buffer;
+    long length;
+    bool loaded;
+
+    if (file == NULL) {
+        fprintf(stderr, "Can't open save state '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Can't read save state '%s'\n", path);
+        fclose(file);
+        return false;
+    }
+
+    buffer = malloc(length);
+    if (buffer == NULL) {
+        perror("Save state memory allocation failed!\n");
+        fclose(file);
+        return false;
+    }
+
+    if (fread(buffer, 1, length, file) != (size_t)length) {
+        fprintf(stderr, "Can't read save state '%s'\n", path);
+        loaded = false;
+    } else {
+        loaded = load_state(gameboy, buffer, length);
+    }
+
+    fclose(file);
+    free(buffer);
+
+    return loaded;
+}
@@ -6,83 +6,183 @@
 
 #include "emulator.h"
 
+#define SYNC_TOKEN_BITS 8 // low bits of a heap key hold the token ; events on the same cycle run in token order ; dates keep 56 bits, centuries of emulated time
+
+static uint64_t get_sync_key(uint64_t date, unsigned token) {
+    return (date << SYNC_TOKEN_BITS) | token;
+}
+
+static unsigned get_sync_key_token(uint64_t key) {
+    return key & ((1U << SYNC_TOKEN_BITS) - 1);
+}
+
+static uint64_t get_sync_key_date(uint64_t key) {
+    return key >> SYNC_TOKEN_BITS;
+}
+
+static void set_sync_heap_entry(struct gameboy_sync *sync, unsigned index, uint64_t key) {
+    sync->heap[index] = key;
+    sync->heap_index[get_sync_key_token(key)] = index;
+}
+
+// move the entry at index towards the root until its parent runs before it
+static void sift_sync_up(struct gameboy_sync *sync, unsigned index) {
+    uint64_t key = sync->heap[index];
+
+    while (index > 0) {
+        unsigned parent = (index - 1) / 2;
+
+        if (sync->heap[parent] < key) {
+            break;
+        }
+
+        set_sync_heap_entry(sync, index, sync->heap[parent]);
+        index = parent;
+    }
+
+    set_sync_heap_entry(sync, index, key);
+}
+
+// move the entry at index towards the leaves until it runs before both of its children
+static void sift_sync_down(struct gameboy_sync *sync, unsigned index) {
+    uint64_t key = sync->heap[index];
+
+    for (;;) {
+        unsigned child = index * 2 + 1;
+
+        if (child >= sync->heap_size) {
+            break;
+        }
+
+        if (child + 1 < sync->heap_size && sync->heap[child + 1] < sync->heap[child]) {
+            child++; // pick the earliest child
+        }
+
+        if (key < sync->heap[child]) {
+            break;
+        }
+
+        set_sync_heap_entry(sync, index, sync->heap[child]);
+        index = child;
+    }
+
+    set_sync_heap_entry(sync, index, key);
+}
+
+static void update_first_event(struct gameboy_sync *sync) {
+    if (sync->heap_size > 0) {
+        sync->first_event = get_sync_key_date(sync->heap[0]);
+    } else {
+        sync->first_event = UINT64_MAX;
+    }
+}
+
 void reset_sync(struct emulator *gameboy) {
     struct gameboy_sync *sync = &gameboy->sync;
 
+    sync->handlers[GB_SYNC_PPU] = sync_ppu;
+    sync->handlers[GB_SYNC_DMA] = sync_dma;
+    sync->handlers[GB_SYNC_TIMER] = sync_timer;
+    sync->handlers[GB_SYNC_SPU] = sync_spu;
+    sync->handlers[GB_SYNC_CART] = sync_cart;
+    sync->handlers[GB_SYNC_SERIAL] = sync_serial;
+
+    sync->heap_size = 0;
+    sync->running_token = -1;
+    gameboy->timestamp = 0;
+
+    // every device runs its first sync right away ; keys in token order already form a heap
     for (unsigned i = 0; i < GB_SYNC_NUM; i++) {
         sync->last_sync[i] = 0;
-        sync->next_event[i] = 0;
+        set_sync_heap_entry(sync, sync->heap_size++, get_sync_key(0, i));
     }
 
-    gameboy->timestamp = 0;
-    sync->first_event = 0;
+    update_first_event(sync);
 }
 
+// the timestamp only moves forward and devices sync at least every GB_SYNC_NEVER cycles so the delta always fits
 int32_t resync_sync(struct emulator *gameboy, enum sync_token token) {
     struct gameboy_sync *sync = &gameboy->sync;
-    int32_t elapsed = gameboy->timestamp - sync->last_sync[token];
-
-    if (elapsed < 0) {
-        fprintf(stderr, "Got negative sync %d for token %u\n", elapsed, token);
-    }
+    int32_t elapsed = (int32_t)(gameboy->timestamp - sync->last_sync[token]);
 
     sync->last_sync[token] = gameboy->timestamp;
 
     return elapsed;
 }
 
+// schedule the next event of token in cycles ; replaces the previous event of token if there is one
 void sync_next(struct emulator *gameboy, enum sync_token token, int32_t cycles) {
     struct gameboy_sync *sync = &gameboy->sync;
+    uint64_t key = get_sync_key(gameboy->timestamp + cycles, token);
+    int index = sync->heap_index[token];
+
+    if (index < 0) {
+        index = sync->heap_size++;
+        set_sync_heap_entry(sync, index, key);
+        sift_sync_up(sync, index);
+    } else if (key < sync->heap[index]) {
+        sync->heap[index] = key;
+        sift_sync_up(sync, index);
+    } else {
+        sync->heap[index] = key;
+        sift_sync_down(sync, index);
+    }
 
-    sync->next_event[token] = gameboy->timestamp + cycles;
-    sync->first_event = sync->next_event[0]; // recompute the date of next event
-
-    for (unsigned i = 1; i < GB_SYNC_NUM; i++) {
-        int32_t event = sync->next_event[i];
-
-        if (event < sync->first_event) {
-            sync->first_event = event;
-        }
+    if (token == sync->running_token) {
+        sync->running_rescheduled = true;
     }
+
+    update_first_event(sync);
 }
 
-void check_sync_events(struct emulator *gameboy) {
+// drop the scheduled event of token ; the device won't be synchronized until it schedules a new event
+void sync_cancel(struct emulator *gameboy, enum sync_token token) {
     struct gameboy_sync *sync = &gameboy->sync;
+    int index = sync->heap_index[token];
 
-    while (gameboy->timestamp >= gameboy->sync.first_event) {
-        int32_t timestamp = gameboy->timestamp;
+    if (index < 0) {
+        return; // not scheduled
+    }
 
-        if (timestamp >= sync->next_event[GB_SYNC_PPU]) {
-            sync_ppu(gameboy);
-        }
+    sync->heap_index[token] = -1;
+    sync->heap_size--;
 
-        if (timestamp >= sync->next_event[GB_SYNC_DMA]) {
-            sync_dma(gameboy);
-        }
+    if ((unsigned)index < sync->heap_size) {
+        // fill the hole with the last entry then restore the heap order around it
+        uint64_t last = sync->heap[sync->heap_size];
 
-        if (timestamp >= sync->next_event[GB_SYNC_TIMER]) {
-            sync_timer(gameboy);
-        }
+        set_sync_heap_entry(sync, index, last);
+        sift_sync_up(sync, index);
+        sift_sync_down(sync, sync->heap_index[get_sync_key_token(last)]);
+    }
 
-        if (timestamp >= sync->next_event[GB_SYNC_SPU]) {
-            sync_spu(gameboy);
-        }
+    update_first_event(sync);
+}
 
-        if (timestamp >= sync->next_event[GB_SYNC_CART]) {
-            sync_cart(gameboy);
-        }
-    }
+// timestamp of the next event of token ; UINT64_MAX if the token isn't scheduled
+uint64_t get_sync_next_event(struct emulator *gameboy, enum sync_token token) {
+    struct gameboy_sync *sync = &gameboy->sync;
+    int index = sync->heap_index[token];
+
+    return (index < 0) ? UINT64_MAX : get_sync_key_date(sync->heap[index]);
 }
 
-// subtract current value of timestamp from all last_sync and next_event dates to avoid potential overflows and remain insync
-void rebase_sync(struct emulator *gameboy) {
+void check_sync_events(struct emulator *gameboy) {
     struct gameboy_sync *sync = &gameboy->sync;
 
-    for (unsigned i = 0; i < GB_SYNC_NUM; i++) {
-        sync->last_sync[i] -= gameboy->timestamp;
-        sync->next_event[i] -= gameboy->timestamp;
-    }
+    while (gameboy->timestamp >= sync->first_event) {
+        unsigned token = get_sync_key_token(sync->heap[0]);
 
-    sync->first_event -= gameboy->timestamp;
-    gameboy->timestamp = 0;
+        // the event stays at the top of the heap while its handler runs ; the handler normally moves it by scheduling the next one
+        sync->running_token = token;
+        sync->running_rescheduled = false;
+
+        sync->handlers[token](gameboy);
+
+        if (!sync->running_rescheduled) {
+            sync_cancel(gameboy, token); // nothing else is planned for this token
+        }
+
+        sync->running_token = -1;
+    }
 }